@@ -0,0 +1,108 @@
+use std::{
+    fs,
+    path::Path,
+    time::{Duration, Instant},
+};
+
+use criterion::{criterion_group, Criterion, Throughput};
+
+use risc_sim::{
+    cpu::cpu_core::{Cpu, CpuMode, KERNEL_ADDR},
+    system::{
+        uart::init_uart,
+        virtio::{init_virtio, BlockDevice},
+    },
+};
+
+mod common;
+
+use common::{load_program, record, run_instructions, write_report};
+
+const CHUNK_INSTRUCTIONS: u64 = 100_000;
+// Granularity of the boot marker polling
+const BOOT_POLL_INSTRUCTIONS: u64 = 1_000;
+const BOOT_MAX_INSTRUCTIONS: u64 = 10_000_000;
+
+// Written by boot.S once paging, the timer and the disk are up
+const BOOT_MARKER_ADDR: u64 = KERNEL_ADDR + 0x30040;
+const BOOT_MARKER: u64 = 0x600DB007;
+const TICKS_ADDR: u64 = KERNEL_ADDR + 0x30020;
+const DISK_INTERRUPTS_ADDR: u64 = KERNEL_ADDR + 0x30030;
+
+const DISK_IMAGE_SIZE: usize = 64 * 1024;
+
+fn boot_cpu(image: &Path) -> Cpu {
+    let block_device = BlockDevice::new(image.to_str().unwrap()).unwrap();
+    let mut cpu = Cpu::new_bare(Some(block_device));
+    cpu.load_program_from_opcodes(load_program("boot"), KERNEL_ADDR, CpuMode::RV64)
+        .unwrap();
+    init_uart(&mut cpu);
+    init_virtio(&mut cpu);
+    cpu
+}
+
+// Runs until the kernel stores the boot marker, returns the instructions it took
+fn boot(cpu: &mut Cpu) -> u64 {
+    while cpu.read_mem_u64(BOOT_MARKER_ADDR).unwrap() != BOOT_MARKER {
+        assert!(
+            cpu.instret < BOOT_MAX_INSTRUCTIONS,
+            "Kernel did not boot, pc {:#x}",
+            cpu.read_pc_u64()
+        );
+        cpu.run_cycles(BOOT_POLL_INSTRUCTIONS).unwrap();
+    }
+    cpu.instret
+}
+
+fn bench_boot(c: &mut Criterion) {
+    let image = std::env::temp_dir().join(format!("risc-sim-boot-{}.img", std::process::id()));
+    fs::write(&image, vec![0xA5u8; DISK_IMAGE_SIZE]).unwrap();
+
+    let mut group = c.benchmark_group("Boot");
+    group.warm_up_time(Duration::from_millis(200));
+    group.measurement_time(Duration::from_millis(1000));
+
+    group.bench_function("to_marker", |b| {
+        b.iter_custom(|iters| {
+            let mut elapsed = Duration::ZERO;
+            let mut instructions = 0;
+            for _ in 0..iters {
+                let mut cpu = boot_cpu(&image);
+                let start = Instant::now();
+                instructions += boot(&mut cpu);
+                elapsed += start.elapsed();
+            }
+            record("boot/to_marker", "instructions", instructions, elapsed);
+            elapsed
+        })
+    });
+
+    let mut cpu = boot_cpu(&image);
+    boot(&mut cpu);
+    group.throughput(Throughput::Elements(CHUNK_INSTRUCTIONS));
+    group.bench_function("steady_state", |b| {
+        b.iter_custom(|iters| {
+            run_instructions(&mut cpu, "boot/steady_state", CHUNK_INSTRUCTIONS, iters)
+        })
+    });
+    group.finish();
+
+    // Both interrupt sources must keep firing or the numbers measure a stuck kernel
+    let ticks = cpu.read_mem_u64(TICKS_ADDR).unwrap();
+    let disk_interrupts = cpu.read_mem_u64(DISK_INTERRUPTS_ADDR).unwrap();
+    assert!(ticks > 2 && disk_interrupts > 16);
+    println!(
+        "Steady state: {} instructions, {} timer ticks, {} disk interrupts",
+        cpu.instret, ticks, disk_interrupts
+    );
+
+    fs::remove_file(&image).unwrap();
+}
+
+criterion_group!(benches, bench_boot);
+
+fn main() {
+    benches();
+    Criterion::default().configure_from_args().final_summary();
+    write_report("boot");
+}
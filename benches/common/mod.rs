@@ -0,0 +1,99 @@
+// Shared by the bench targets, each uses a subset
+#![allow(dead_code)]
+
+use std::{
+    fs,
+    path::Path,
+    sync::Mutex,
+    time::{Duration, Instant},
+};
+
+use risc_sim::cpu::cpu_core::Cpu;
+
+// Throughput of every benchmark that ran, written as JSON so results can be compared across commits
+struct ReportEntry {
+    name: String,
+    unit: &'static str,
+    count: u64,
+    elapsed: Duration,
+}
+
+static REPORT: Mutex<Vec<ReportEntry>> = Mutex::new(Vec::new());
+
+const DEFAULT_REPORT_DIR: &str = "target/bench-report";
+
+pub fn record(name: &str, unit: &'static str, count: u64, elapsed: Duration) {
+    let mut report = REPORT.lock().unwrap();
+    match report.iter_mut().find(|entry| entry.name == name) {
+        Some(entry) => {
+            entry.count += count;
+            entry.elapsed += elapsed;
+        }
+        None => report.push(ReportEntry {
+            name: name.to_owned(),
+            unit,
+            count,
+            elapsed,
+        }),
+    }
+}
+
+// Recorded units per second, None if `name` did not run
+pub fn throughput(name: &str) -> Option<f64> {
+    let report = REPORT.lock().unwrap();
+    let entry = report.iter().find(|entry| entry.name == name)?;
+    Some(entry.count as f64 / entry.elapsed.as_secs_f64())
+}
+
+// Runs `iters` chunks of `instructions` and records the guest instruction rate under `name`
+pub fn run_instructions(cpu: &mut Cpu, name: &str, instructions: u64, iters: u64) -> Duration {
+    let start = Instant::now();
+    for _ in 0..iters {
+        cpu.run_cycles(instructions).unwrap();
+    }
+    let elapsed = start.elapsed();
+    record(name, "instructions", instructions * iters, elapsed);
+    elapsed
+}
+
+// Flat binaries assembled from benches/programs by scripts/build-bench-programs.sh
+pub fn load_program(name: &str) -> Vec<u32> {
+    let bytes = fs::read(format!("benches/programs/{}.bin", name)).unwrap();
+    bytes
+        .chunks_exact(4)
+        .map(|word| u32::from_le_bytes(word.try_into().unwrap()))
+        .collect()
+}
+
+// Prints the dashboard and writes `<bench>.json`, BENCH_REPORT overrides the output directory
+pub fn write_report(bench: &str) {
+    let dir = std::env::var("BENCH_REPORT").unwrap_or(DEFAULT_REPORT_DIR.to_owned());
+    let path = Path::new(&dir).join(format!("{}.json", bench));
+    let report = REPORT.lock().unwrap();
+    let entries: Vec<String> = report
+        .iter()
+        .map(|entry| {
+            format!(
+                "    {{\"name\": \"{}\", \"unit\": \"{}\", \"count\": {}, \"seconds\": {:.6}, \"millions_per_second\": {:.3}}}",
+                entry.name,
+                entry.unit,
+                entry.count,
+                entry.elapsed.as_secs_f64(),
+                entry.count as f64 / entry.elapsed.as_secs_f64() / 1e6
+            )
+        })
+        .collect();
+    let json = format!("{{\n  \"results\": [\n{}\n  ]\n}}\n", entries.join(",\n"));
+    fs::create_dir_all(&dir).unwrap();
+    fs::write(&path, json).unwrap();
+
+    for entry in report.iter() {
+        println!(
+            "{:<32} {:>10.2} M {}/s",
+            entry.name,
+            entry.count as f64 / entry.elapsed.as_secs_f64() / 1e6,
+            entry.unit
+        );
+    }
+    println!("Benchmark report written to {}", path.display());
+}
@@ -0,0 +1,112 @@
+use std::{fs, time::Instant};
+
+use risc_sim::{
+    cpu::{
+        cpu_core::{
+            Cpu, CpuMode, ExecutionMode, INITIAL_STACK_POINTER_32, INITIAL_STACK_POINTER_64,
+        },
+        memory::user_memory::{UserMemory, HEAP_SIZE, STACK_SIZE},
+    },
+    elf::elf_loader::{decode_file, WordSize},
+    profiling::host_counters::{HostCounters, HostEvent},
+    system::passthrough_kernel::PassthroughKernel,
+};
+
+mod common;
+
+use common::{record, write_report};
+
+const CHUNK_INSTRUCTIONS: u64 = 100_000;
+
+// Userspace programs with recorded results and coremark
+fn workloads() -> Vec<String> {
+    let mut programs: Vec<String> = fs::read_dir("tests")
+        .unwrap()
+        .filter_map(|entry| {
+            let path = entry.unwrap().path();
+            let name = path.to_str()?.strip_suffix(".res")?.to_owned();
+            Some(name)
+        })
+        .collect();
+    programs.sort();
+    programs.push("tests/coremark.elf".to_owned());
+    programs
+}
+
+fn userspace_cpu(path: &str) -> Cpu {
+    let program = decode_file(path);
+    let (mode, stack_pointer) = match program.header.word_size {
+        WordSize::W32 => (CpuMode::RV32, INITIAL_STACK_POINTER_32 as u64),
+        _ => (CpuMode::RV64, INITIAL_STACK_POINTER_64),
+    };
+    let mut kernel = PassthroughKernel::default();
+    kernel.set_print_stdout(false);
+    let mut cpu = Cpu::new(
+        UserMemory::new(stack_pointer - STACK_SIZE, 0, STACK_SIZE, HEAP_SIZE),
+        kernel,
+        mode,
+        None,
+        ExecutionMode::UserSpace,
+    );
+    cpu.load_program_from_elf(program).unwrap();
+    cpu
+}
+
+// Host events per emulated instruction for each workload, run to completion
+fn main() {
+    let mut counters = match HostCounters::open() {
+        Ok(counters) => counters,
+        Err(e) => {
+            eprintln!(
+                "Host counters unavailable, they need a hardware PMU and perf_event_paranoid <= 2: {}",
+                e
+            );
+            return;
+        }
+    };
+    let events = counters.events();
+
+    print!("{:<28} {:>12} {:>8}", "workload", "guest instr", "host IPC");
+    for event in &events {
+        print!(" {:>17}", format!("{}/instr", event.name()));
+    }
+    println!();
+
+    for path in workloads() {
+        let mut cpu = userspace_cpu(&path);
+        let start = Instant::now();
+        counters.start();
+        while cpu.run_cycles(CHUNK_INSTRUCTIONS).is_ok() {}
+        counters.stop();
+        let elapsed = start.elapsed();
+
+        let name = path.trim_start_matches("tests/");
+        record(
+            &format!("host_counters/{}", name),
+            "instructions",
+            cpu.instret,
+            elapsed,
+        );
+
+        let values = counters.read().unwrap();
+        let value = |event: HostEvent| {
+            values
+                .iter()
+                .find(|(e, _)| *e == event)
+                .map(|(_, value)| *value)
+        };
+        let ipc = match (value(HostEvent::Instructions), value(HostEvent::Cycles)) {
+            (Some(instructions), Some(cycles)) if cycles > 0 => {
+                format!("{:.2}", instructions as f64 / cycles as f64)
+            }
+            _ => "-".to_owned(),
+        };
+        print!("{:<28} {:>12} {:>8}", name, cpu.instret, ipc);
+        for (_, value) in &values {
+            print!(" {:>17.3}", *value as f64 / cpu.instret.max(1) as f64);
+        }
+        println!();
+    }
+
+    write_report("host_counters");
+}
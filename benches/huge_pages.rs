@@ -0,0 +1,101 @@
+use std::time::Instant;
+
+use risc_sim::{
+    cpu::{
+        cpu_core::{Cpu, CpuMode, ExecutionMode, KERNEL_ADDR, KERNEL_SIZE},
+        memory::{
+            huge_page_memory::{HugePageMemory, HugePages},
+            memory_core::Memory,
+            raw_memory::ContinuousMemory,
+        },
+    },
+    profiling::host_counters::{HostCounters, HostEvent},
+    system::passthrough_kernel::PassthroughKernel,
+};
+
+mod common;
+
+use common::{load_program, record, write_report};
+
+const CHUNK_INSTRUCTIONS: u64 = 1_000_000;
+// Enough to touch every page of the 64 MiB working set before measuring
+const WARM_UP_CHUNKS: u64 = 4;
+const MEASURED_CHUNKS: u64 = 20;
+
+fn random_access_cpu<M: Memory + 'static>(memory: M) -> Cpu {
+    let mut cpu = Cpu::new(
+        memory,
+        PassthroughKernel::default(),
+        CpuMode::RV64,
+        None,
+        ExecutionMode::Bare,
+    );
+    cpu.load_program_from_opcodes(load_program("random_access"), KERNEL_ADDR, CpuMode::RV64)
+        .unwrap();
+    cpu
+}
+
+fn run(name: &str, mut cpu: Cpu, counters: &mut Option<HostCounters>) {
+    for _ in 0..WARM_UP_CHUNKS {
+        cpu.run_cycles(CHUNK_INSTRUCTIONS).unwrap();
+    }
+
+    if let Some(counters) = counters {
+        counters.start();
+    }
+    let start = Instant::now();
+    for _ in 0..MEASURED_CHUNKS {
+        cpu.run_cycles(CHUNK_INSTRUCTIONS).unwrap();
+    }
+    let elapsed = start.elapsed();
+    let instructions = CHUNK_INSTRUCTIONS * MEASURED_CHUNKS;
+    record(
+        &format!("huge_pages/{}", name),
+        "instructions",
+        instructions,
+        elapsed,
+    );
+
+    let dtlb_misses = counters.as_mut().and_then(|counters| {
+        counters.stop();
+        let values = counters.read().unwrap();
+        values
+            .iter()
+            .find(|(event, _)| *event == HostEvent::DtlbMisses)
+            .map(|(_, value)| *value as f64 / instructions as f64)
+    });
+    println!(
+        "{:<24} {:>10.2} MIPS {:>14}",
+        name,
+        instructions as f64 / elapsed.as_secs_f64() / 1e6,
+        dtlb_misses.map_or("-".to_owned(), |misses| format!("{:.4}", misses))
+    );
+}
+
+// Random guest accesses over 64 MiB of bare mode RAM, the current Vec backed RAM
+// against mappings with transparent and explicit 2 MiB pages
+fn main() {
+    let mut counters = HostCounters::open()
+        .inspect_err(|e| eprintln!("Host counters unavailable: {}", e))
+        .ok();
+    println!("{:<24} {:>15} {:>14}", "backend", "", "dTLB miss/instr");
+
+    run(
+        "continuous",
+        random_access_cpu(ContinuousMemory::default()),
+        &mut counters,
+    );
+    for huge_pages in [HugePages::None, HugePages::Transparent, HugePages::Explicit] {
+        let memory = HugePageMemory::new(KERNEL_ADDR, KERNEL_SIZE, huge_pages);
+        // Reported as what the host actually provided after fallbacks
+        let name = format!("{:?}", memory.huge_pages()).to_lowercase();
+        let name = if memory.huge_pages() == huge_pages {
+            name
+        } else {
+            format!("{}_fallback", name)
+        };
+        run(&name, random_access_cpu(memory), &mut counters);
+    }
+
+    write_report("huge_pages");
+}
@@ -5,14 +5,49 @@ use criterion::{
     PlotConfiguration,
 };
 use risc_sim::cpu::memory::{
-    btree_memory::BTreeMemory, hashmap_memory::FxHashMemory, memory_core::Memory,
-    raw_memory::ContinuousMemory, raw_table_memory::RawTableMemory, table_memory::TableMemory,
-    vec_binsearch_memory::VecBsearchMemory, vec_memory::VecMemory, vec_u8_memory::VecU8Memory,
+    memory_core::Memory,
+    paged_memory::{BTreeIndex, HashIndex, LinearIndex, PagedMemory, RadixIndex, SortedVecIndex},
+    raw_memory::ContinuousMemory,
 };
 
+use baseline::{BTreeMemory, FxHashMemory, TableMemory, VecBsearchMemory, VecMemory, VecU8Memory};
+
 const TOP_ADDR: u64 = 0x100000;
+// Spreads the locations over enough address space that every one lands on its own page
+const SPARSE_TOP_ADDR: u64 = 0x4000_0000;
+
+// Straddles a 16 MiB, 64 KiB and several 4 KiB page boundaries
+const PACKED_BASE: u64 = 0x1000000 - 0x1a00;
 
-fn read_write_randon_mem(locations: u64, mem: &mut impl Memory) {
+const SPANS: [u64; 11] = [1, 2, 3, 5, 8, 12, 20, 40, 70, 90, 100];
+
+// Every index structure of the generic paged backend at 4 KiB, 64 KiB, 2 MiB and 16 MiB pages
+macro_rules! bench_paged_memory {
+    ($group:expr, $span:expr, $top_addr:expr) => {
+        bench_paged_memory!($group, $span, $top_addr, RadixIndex, [12, 16, 21, 24]);
+        bench_paged_memory!($group, $span, $top_addr, HashIndex, [12, 16, 21, 24]);
+        bench_paged_memory!($group, $span, $top_addr, SortedVecIndex, [12, 16, 21, 24]);
+        bench_paged_memory!($group, $span, $top_addr, BTreeIndex, [12, 24]);
+        bench_paged_memory!($group, $span, $top_addr, LinearIndex, [12, 24]);
+    };
+    ($group:expr, $span:expr, $top_addr:expr, $index:ident, [$($shift:literal),+]) => {
+        $(
+            $group.bench_with_input(
+                BenchmarkId::new(
+                    format!("PagedMemory<{}, {}>", stringify!($index), $shift),
+                    $span,
+                ),
+                &$span,
+                |b, &s| {
+                    let mut mem = PagedMemory::<$index, $shift>::new();
+                    b.iter(|| read_write_randon_mem(black_box(s), $top_addr, &mut mem))
+                },
+            );
+        )+
+    };
+}
+
+fn read_write_randon_mem(locations: u64, top_addr: u64, mem: &mut impl Memory) {
     const RW_CYCLES: usize = 1;
     const BUF_SIZE: usize = 32;
     const BUF: [u32; BUF_SIZE] = [0; BUF_SIZE];
@@ -20,7 +55,7 @@ fn read_write_randon_mem(locations: u64, mem: &mut impl Memory) {
     for _ in 0..RW_CYCLES {
         for (j, data) in BUF.iter().enumerate().take(BUF_SIZE) {
             for i in 0..locations {
-                let addr: u64 = (TOP_ADDR / locations) * i;
+                let addr: u64 = (top_addr / locations) * i;
                 mem.write_mem_u32(addr + (j * 4) as u64, *data).unwrap();
                 mem.read_mem_u32(addr + (j * 4) as u64).unwrap();
             }
@@ -28,6 +63,21 @@ fn read_write_randon_mem(locations: u64, mem: &mut impl Memory) {
     }
 }
 
+// Packed 13 byte records written and read back field by field, so most accesses are
+// misaligned and some cross the backends' page boundaries, like packed structs and
+// memcpy tails
+fn read_write_packed_records(records: u64, mem: &mut impl Memory) {
+    for i in 0..records {
+        let addr = PACKED_BASE + i * 13;
+        mem.write_mem_u64(addr, i).unwrap();
+        mem.write_mem_u32(addr + 8, i as u32).unwrap();
+        mem.write_mem_u8(addr + 12, i as u8).unwrap();
+        black_box(mem.read_mem_u64(addr).unwrap());
+        black_box(mem.read_mem_u32(addr + 8).unwrap());
+        black_box(mem.read_mem_u16(addr + 11).unwrap());
+    }
+}
+
 fn bench_mem_read_write(c: &mut Criterion) {
     let mut group = c.benchmark_group("Synthetic Memory");
 
@@ -37,56 +87,500 @@ fn bench_mem_read_write(c: &mut Criterion) {
     group.warm_up_time(Duration::from_millis(100));
     group.measurement_time(Duration::from_millis(500));
 
-    let spans = vec![1, 2, 3, 5, 8, 12, 20, 40, 70, 90, 100];
-
-    for &span in &spans {
-        group.bench_with_input(BenchmarkId::new("TableMemory", span), &span, |b, &s| {
-            let mut mem = TableMemory::new();
-            b.iter(|| read_write_randon_mem(black_box(s), &mut mem))
-        });
-
-        group.bench_with_input(BenchmarkId::new("RawTableMemory", span), &span, |b, &s| {
-            let mut mem = RawTableMemory::new();
-            b.iter(|| read_write_randon_mem(black_box(s), &mut mem))
-        });
+    for span in SPANS {
+        group.bench_with_input(
+            BenchmarkId::new("Baseline TableMemory", span),
+            &span,
+            |b, &s| {
+                let mut mem = TableMemory::new();
+                b.iter(|| read_write_randon_mem(black_box(s), TOP_ADDR, &mut mem))
+            },
+        );
 
-        group.bench_with_input(BenchmarkId::new("VecMemory", span), &span, |b, &s| {
-            let mut mem = VecMemory::new();
-            b.iter(|| read_write_randon_mem(black_box(s), &mut mem))
-        });
+        group.bench_with_input(
+            BenchmarkId::new("Baseline VecMemory", span),
+            &span,
+            |b, &s| {
+                let mut mem = VecMemory::new();
+                b.iter(|| read_write_randon_mem(black_box(s), TOP_ADDR, &mut mem))
+            },
+        );
 
         group.bench_with_input(
-            BenchmarkId::new("VecBsearchMemory", span),
+            BenchmarkId::new("Baseline VecBsearchMemory", span),
             &span,
             |b, &s| {
                 let mut mem = VecBsearchMemory::new();
-                b.iter(|| read_write_randon_mem(black_box(s), &mut mem))
+                b.iter(|| read_write_randon_mem(black_box(s), TOP_ADDR, &mut mem))
             },
         );
 
-        group.bench_with_input(BenchmarkId::new("VecU8Memory", span), &span, |b, &s| {
-            let mut mem = VecU8Memory::new();
-            b.iter(|| read_write_randon_mem(black_box(s), &mut mem))
-        });
+        group.bench_with_input(
+            BenchmarkId::new("Baseline VecU8Memory", span),
+            &span,
+            |b, &s| {
+                let mut mem = VecU8Memory::new();
+                b.iter(|| read_write_randon_mem(black_box(s), TOP_ADDR, &mut mem))
+            },
+        );
 
-        group.bench_with_input(BenchmarkId::new("FxHashMemory", span), &span, |b, &s| {
-            let mut mem = FxHashMemory::new();
-            b.iter(|| read_write_randon_mem(black_box(s), &mut mem))
-        });
+        group.bench_with_input(
+            BenchmarkId::new("Baseline FxHashMemory", span),
+            &span,
+            |b, &s| {
+                let mut mem = FxHashMemory::new();
+                b.iter(|| read_write_randon_mem(black_box(s), TOP_ADDR, &mut mem))
+            },
+        );
 
-        group.bench_with_input(BenchmarkId::new("BTreeMemory", span), &span, |b, &s| {
-            let mut mem = BTreeMemory::new();
-            b.iter(|| read_write_randon_mem(black_box(s), &mut mem))
-        });
+        group.bench_with_input(
+            BenchmarkId::new("Baseline BTreeMemory", span),
+            &span,
+            |b, &s| {
+                let mut mem = BTreeMemory::new();
+                b.iter(|| read_write_randon_mem(black_box(s), TOP_ADDR, &mut mem))
+            },
+        );
 
         group.bench_with_input(BenchmarkId::new("ContinousMemory", span), &span, |b, &s| {
             let mut mem = ContinuousMemory::new(0, TOP_ADDR + 0x8);
-            b.iter(|| read_write_randon_mem(black_box(s), &mut mem))
+            b.iter(|| read_write_randon_mem(black_box(s), TOP_ADDR, &mut mem))
         });
+
+        bench_paged_memory!(group, span, TOP_ADDR);
+    }
+
+    group.finish();
+}
+
+// The same pattern over 1 GiB, where page size and the index structure matter
+fn bench_sparse_mem_read_write(c: &mut Criterion) {
+    let mut group = c.benchmark_group("Sparse Memory");
+
+    let plot_config = PlotConfiguration::default().summary_scale(AxisScale::Logarithmic);
+    group.plot_config(plot_config);
+
+    group.warm_up_time(Duration::from_millis(100));
+    group.measurement_time(Duration::from_millis(500));
+
+    for span in SPANS {
+        group.bench_with_input(
+            BenchmarkId::new("Baseline FxHashMemory", span),
+            &span,
+            |b, &s| {
+                let mut mem = FxHashMemory::new();
+                b.iter(|| read_write_randon_mem(black_box(s), SPARSE_TOP_ADDR, &mut mem))
+            },
+        );
+
+        group.bench_with_input(
+            BenchmarkId::new("Baseline BTreeMemory", span),
+            &span,
+            |b, &s| {
+                let mut mem = BTreeMemory::new();
+                b.iter(|| read_write_randon_mem(black_box(s), SPARSE_TOP_ADDR, &mut mem))
+            },
+        );
+
+        bench_paged_memory!(group, span, SPARSE_TOP_ADDR);
     }
 
     group.finish();
 }
 
-criterion_group!(benches, bench_mem_read_write);
+fn bench_misaligned_mem_read_write(c: &mut Criterion) {
+    let mut group = c.benchmark_group("Misaligned Memory");
+
+    group.warm_up_time(Duration::from_millis(100));
+    group.measurement_time(Duration::from_millis(500));
+
+    const RECORDS: u64 = 1024;
+
+    group.bench_function("Baseline VecMemory", |b| {
+        let mut mem = VecMemory::new();
+        b.iter(|| read_write_packed_records(black_box(RECORDS), &mut mem))
+    });
+
+    group.bench_function("Baseline VecU8Memory", |b| {
+        let mut mem = VecU8Memory::new();
+        b.iter(|| read_write_packed_records(black_box(RECORDS), &mut mem))
+    });
+
+    group.bench_function("Baseline FxHashMemory", |b| {
+        let mut mem = FxHashMemory::new();
+        b.iter(|| read_write_packed_records(black_box(RECORDS), &mut mem))
+    });
+
+    group.bench_function("ContinousMemory", |b| {
+        let mut mem = ContinuousMemory::new(PACKED_BASE, RECORDS * 13);
+        b.iter(|| read_write_packed_records(black_box(RECORDS), &mut mem))
+    });
+
+    group.bench_function("PagedMemory<HashIndex, 12>", |b| {
+        let mut mem = PagedMemory::<HashIndex, 12>::new();
+        b.iter(|| read_write_packed_records(black_box(RECORDS), &mut mem))
+    });
+
+    group.bench_function("PagedMemory<SortedVecIndex, 24>", |b| {
+        let mut mem = PagedMemory::<SortedVecIndex, 24>::new();
+        b.iter(|| read_write_packed_records(black_box(RECORDS), &mut mem))
+    });
+
+    group.finish();
+}
+
+criterion_group!(
+    benches,
+    bench_mem_read_write,
+    bench_sparse_mem_read_write,
+    bench_misaligned_mem_read_write
+);
 criterion_main!(benches);
+
+// The backends the named aliases replaced, kept to compare PagedMemory against. Word
+// pages store byte-swapped u32 words in 16 MiB pages behind one of several page
+// storages, VecU8Memory stores bytes in 64 KiB pages behind an Fx hash map.
+mod baseline {
+    use std::{
+        collections::BTreeMap,
+        fmt::{Debug, Formatter},
+    };
+
+    use anyhow::Result;
+    use risc_sim::cpu::memory::{
+        memory_core::Memory,
+        unaligned::{fits_in_page, read_split, write_split},
+    };
+    use rustc_hash::{FxBuildHasher, FxHashMap};
+
+    const PAGE_SIZE_LOG2: u32 = 24;
+    const PAGE_SIZE: u64 = 1 << PAGE_SIZE_LOG2;
+    // Pages the table storage covers
+    const TABLE_PAGES: usize = 1;
+    const MEMORY_CAPACITY: usize = 48;
+
+    pub struct Page {
+        data: Box<[u32; (PAGE_SIZE / 4) as usize]>,
+        position: u64,
+    }
+
+    impl Page {
+        fn new(page_id: u64) -> Page {
+            Page {
+                position: page_id * PAGE_SIZE,
+                data: unsafe { Box::new_zeroed().assume_init() },
+            }
+        }
+    }
+
+    pub trait PageStorage {
+        fn new() -> Self;
+        fn get_page(&self, page_id: u64) -> Option<&Page>;
+        fn get_page_or_create(&mut self, page_id: u64) -> &mut Page;
+    }
+
+    pub struct FxHashStorage(FxHashMap<u64, Page>);
+
+    impl PageStorage for FxHashStorage {
+        fn new() -> Self {
+            FxHashStorage(FxHashMap::with_capacity_and_hasher(
+                MEMORY_CAPACITY,
+                FxBuildHasher,
+            ))
+        }
+
+        fn get_page(&self, page_id: u64) -> Option<&Page> {
+            self.0.get(&page_id)
+        }
+
+        fn get_page_or_create(&mut self, page_id: u64) -> &mut Page {
+            self.0.entry(page_id).or_insert_with(|| Page::new(page_id))
+        }
+    }
+
+    pub struct BTreeStorage(BTreeMap<u64, Box<Page>>);
+
+    impl PageStorage for BTreeStorage {
+        fn new() -> Self {
+            BTreeStorage(BTreeMap::new())
+        }
+
+        fn get_page(&self, page_id: u64) -> Option<&Page> {
+            self.0.get(&page_id).map(|page| page.as_ref())
+        }
+
+        fn get_page_or_create(&mut self, page_id: u64) -> &mut Page {
+            self.0
+                .entry(page_id)
+                .or_insert_with(|| Box::new(Page::new(page_id)))
+        }
+    }
+
+    // Indexed by page id, only covers the low TABLE_PAGES pages
+    pub struct TableStorage([Option<Box<Page>>; TABLE_PAGES]);
+
+    impl PageStorage for TableStorage {
+        fn new() -> Self {
+            TableStorage(array_init::array_init(|_| None))
+        }
+
+        fn get_page(&self, page_id: u64) -> Option<&Page> {
+            unsafe { self.0.get_unchecked(page_id as usize).as_deref() }
+        }
+
+        fn get_page_or_create(&mut self, page_id: u64) -> &mut Page {
+            unsafe { self.0.get_unchecked_mut(page_id as usize) }
+                .get_or_insert_with(|| Box::new(Page::new(page_id)))
+        }
+    }
+
+    pub struct VecStorage(Vec<(u64, Page)>);
+
+    impl PageStorage for VecStorage {
+        fn new() -> Self {
+            VecStorage(Vec::with_capacity(MEMORY_CAPACITY))
+        }
+
+        fn get_page(&self, page_id: u64) -> Option<&Page> {
+            self.0.iter().find(|p| p.0 == page_id).map(|p| &p.1)
+        }
+
+        fn get_page_or_create(&mut self, page_id: u64) -> &mut Page {
+            let i = match self.0.iter().position(|p| p.0 == page_id) {
+                Some(i) => i,
+                None => {
+                    self.0.push((page_id, Page::new(page_id)));
+                    self.0.len() - 1
+                }
+            };
+            &mut self.0[i].1
+        }
+    }
+
+    pub struct VecBsearchStorage(Vec<(u64, Page)>);
+
+    impl PageStorage for VecBsearchStorage {
+        fn new() -> Self {
+            VecBsearchStorage(Vec::with_capacity(MEMORY_CAPACITY))
+        }
+
+        fn get_page(&self, page_id: u64) -> Option<&Page> {
+            let i = self.0.binary_search_by(|p| p.0.cmp(&page_id)).ok()?;
+            Some(&self.0[i].1)
+        }
+
+        fn get_page_or_create(&mut self, page_id: u64) -> &mut Page {
+            let i = match self.0.binary_search_by(|p| p.0.cmp(&page_id)) {
+                Ok(i) => i,
+                Err(i) => {
+                    self.0.insert(i, (page_id, Page::new(page_id)));
+                    i
+                }
+            };
+            &mut self.0[i].1
+        }
+    }
+
+    pub struct PageMemory<T: PageStorage> {
+        storage: T,
+    }
+
+    impl<T: PageStorage> Debug for PageMemory<T> {
+        fn fmt(&self, f: &mut Formatter<'_>) -> std::fmt::Result {
+            write!(f, "PageMemory")
+        }
+    }
+
+    impl<T: PageStorage> PageMemory<T> {
+        pub fn new() -> Self {
+            PageMemory { storage: T::new() }
+        }
+    }
+
+    impl<T: PageStorage> Memory for PageMemory<T> {
+        fn read_mem_u8(&mut self, addr: u64) -> Result<u8> {
+            let word = self.read_mem_u32(addr & !0b11)?;
+            Ok((word >> ((addr & 0b11) * 8)) as u8)
+        }
+
+        fn read_mem_u16(&mut self, addr: u64) -> Result<u16> {
+            let word = self.read_mem_u32(addr & !0b1)?;
+            Ok((word >> ((addr & 0b1) * 8)) as u16)
+        }
+
+        fn read_mem_u32(&mut self, addr: u64) -> Result<u32> {
+            if !fits_in_page(addr, 4, PAGE_SIZE) {
+                let mut bytes = [0; 4];
+                read_split(self, addr, &mut bytes)?;
+                return Ok(u32::from_le_bytes(bytes));
+            }
+            let Some(page) = self.storage.get_page(addr >> PAGE_SIZE_LOG2) else {
+                return Ok(0);
+            };
+            let index = (addr - page.position) as usize / 4;
+            let offset = addr & 0b11;
+            if offset == 0 {
+                return Ok(page.data[index].swap_bytes());
+            }
+            let lower = page.data[index] << (8 * offset);
+            let upper = page.data[index + 1] >> (8 * (4 - offset));
+            Ok((lower | upper).swap_bytes())
+        }
+
+        fn read_mem_u64(&mut self, addr: u64) -> Result<u64> {
+            let lower = self.read_mem_u32(addr)?;
+            let upper = self.read_mem_u32(addr + 4)?;
+            Ok((upper as u64) << 32 | lower as u64)
+        }
+
+        fn write_mem_u8(&mut self, addr: u64, value: u8) -> Result<()> {
+            let shift = (addr & 0b11) * 8;
+            let word = self.read_mem_u32(addr & !0b11)?;
+            let word = word & !(0xff << shift) | (value as u32) << shift;
+            self.write_mem_u32(addr & !0b11, word)
+        }
+
+        fn write_mem_u16(&mut self, addr: u64, value: u16) -> Result<()> {
+            let shift = (addr & 0b1) * 8;
+            let word = self.read_mem_u32(addr & !0b1)?;
+            let word = word & !(0xffff << shift) | (value as u32) << shift;
+            self.write_mem_u32(addr & !0b1, word)
+        }
+
+        fn write_mem_u32(&mut self, addr: u64, value: u32) -> Result<()> {
+            if !fits_in_page(addr, 4, PAGE_SIZE) {
+                return write_split(self, addr, &value.to_le_bytes());
+            }
+            let value = value.swap_bytes();
+            let page = self.storage.get_page_or_create(addr >> PAGE_SIZE_LOG2);
+            let index = (addr - page.position) as usize / 4;
+            let offset = addr & 0b11;
+            if offset == 0 {
+                page.data[index] = value;
+                return Ok(());
+            }
+            page.data[index] &= !(u32::MAX >> (8 * offset));
+            page.data[index] |= value >> (8 * offset);
+            page.data[index + 1] &= !(u32::MAX << (8 * (4 - offset)));
+            page.data[index + 1] |= value << (8 * (4 - offset));
+            Ok(())
+        }
+
+        fn write_mem_u64(&mut self, addr: u64, value: u64) -> Result<()> {
+            self.write_mem_u32(addr, value as u32)?;
+            self.write_mem_u32(addr + 4, (value >> 32) as u32)
+        }
+
+        fn read_buf(&mut self, addr: u64, buf: &mut [u8]) -> Result<()> {
+            for (i, byte) in buf.iter_mut().enumerate() {
+                *byte = self.read_mem_u8(addr + i as u64)?;
+            }
+            Ok(())
+        }
+
+        fn write_buf(&mut self, addr: u64, buf: &[u8]) -> Result<()> {
+            for (i, byte) in buf.iter().enumerate() {
+                self.write_mem_u8(addr + i as u64, *byte)?;
+            }
+            Ok(())
+        }
+    }
+
+    pub type FxHashMemory = PageMemory<FxHashStorage>;
+    pub type BTreeMemory = PageMemory<BTreeStorage>;
+    pub type TableMemory = PageMemory<TableStorage>;
+    pub type VecMemory = PageMemory<VecStorage>;
+    pub type VecBsearchMemory = PageMemory<VecBsearchStorage>;
+
+    const U8_PAGE_SIZE: u64 = 4096 * 16;
+
+    pub struct VecU8Memory {
+        pages: FxHashMap<u64, Box<[u8; U8_PAGE_SIZE as usize]>>,
+    }
+
+    impl Debug for VecU8Memory {
+        fn fmt(&self, f: &mut Formatter<'_>) -> std::fmt::Result {
+            write!(f, "VecU8Memory")
+        }
+    }
+
+    impl VecU8Memory {
+        pub fn new() -> Self {
+            VecU8Memory {
+                pages: FxHashMap::with_capacity_and_hasher(1024, FxBuildHasher),
+            }
+        }
+
+        fn read<const N: usize>(&mut self, addr: u64) -> Result<[u8; N]> {
+            let mut bytes = [0; N];
+            if !fits_in_page(addr, N as u64, U8_PAGE_SIZE) {
+                read_split(self, addr, &mut bytes)?;
+            } else if let Some(page) = self.pages.get(&(addr / U8_PAGE_SIZE)) {
+                let offset = (addr % U8_PAGE_SIZE) as usize;
+                bytes.copy_from_slice(&page[offset..offset + N]);
+            }
+            Ok(bytes)
+        }
+
+        fn write<const N: usize>(&mut self, addr: u64, bytes: [u8; N]) -> Result<()> {
+            if !fits_in_page(addr, N as u64, U8_PAGE_SIZE) {
+                return write_split(self, addr, &bytes);
+            }
+            let page = self
+                .pages
+                .entry(addr / U8_PAGE_SIZE)
+                .or_insert_with(|| Box::new([0; U8_PAGE_SIZE as usize]));
+            let offset = (addr % U8_PAGE_SIZE) as usize;
+            page[offset..offset + N].copy_from_slice(&bytes);
+            Ok(())
+        }
+    }
+
+    impl Memory for VecU8Memory {
+        fn read_mem_u8(&mut self, addr: u64) -> Result<u8> {
+            Ok(self.read::<1>(addr)?[0])
+        }
+
+        fn read_mem_u16(&mut self, addr: u64) -> Result<u16> {
+            Ok(u16::from_le_bytes(self.read(addr)?))
+        }
+
+        fn read_mem_u32(&mut self, addr: u64) -> Result<u32> {
+            Ok(u32::from_le_bytes(self.read(addr)?))
+        }
+
+        fn read_mem_u64(&mut self, addr: u64) -> Result<u64> {
+            Ok(u64::from_le_bytes(self.read(addr)?))
+        }
+
+        fn write_mem_u8(&mut self, addr: u64, value: u8) -> Result<()> {
+            self.write(addr, [value])
+        }
+
+        fn write_mem_u16(&mut self, addr: u64, value: u16) -> Result<()> {
+            self.write(addr, value.to_le_bytes())
+        }
+
+        fn write_mem_u32(&mut self, addr: u64, value: u32) -> Result<()> {
+            self.write(addr, value.to_le_bytes())
+        }
+
+        fn write_mem_u64(&mut self, addr: u64, value: u64) -> Result<()> {
+            self.write(addr, value.to_le_bytes())
+        }
+
+        fn read_buf(&mut self, addr: u64, buf: &mut [u8]) -> Result<()> {
+            for (i, byte) in buf.iter_mut().enumerate() {
+                *byte = self.read_mem_u8(addr + i as u64)?;
+            }
+            Ok(())
+        }
+
+        fn write_buf(&mut self, addr: u64, buf: &[u8]) -> Result<()> {
+            for (i, byte) in buf.iter().enumerate() {
+                self.write_mem_u8(addr + i as u64, *byte)?;
+            }
+            Ok(())
+        }
+    }
+}
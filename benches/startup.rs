@@ -0,0 +1,51 @@
+use std::time::Duration;
+
+use criterion::{black_box, criterion_group, criterion_main, Criterion};
+
+use risc_sim::{
+    cpu::{
+        cpu_core::{Cpu, CpuMode, ExecutionMode},
+        memory::{memory_core::Memory, raw_vec_memory::RawVecMemory, user_memory::UserMemory},
+    },
+    elf::elf_loader::decode_file,
+    system::passthrough_kernel::PassthroughKernel,
+};
+
+fn load_program<M>(mem: M, path: &str, mode: CpuMode)
+where
+    M: Memory + 'static,
+{
+    let kernel = PassthroughKernel::default();
+    let mut cpu = Cpu::new(mem, kernel, mode, None, ExecutionMode::UserSpace);
+    let program = decode_file(path);
+    cpu.load_program_from_elf(program).unwrap();
+    black_box(&cpu);
+}
+
+fn bench_startup(c: &mut Criterion) {
+    let mut group = c.benchmark_group("Startup");
+
+    group.warm_up_time(Duration::from_millis(200));
+    group.measurement_time(Duration::from_millis(1000));
+
+    group.bench_function("decode_file coremark", |b| {
+        b.iter(|| black_box(decode_file("tests/coremark.elf")))
+    });
+
+    group.bench_function("load coremark RawVecMemory", |b| {
+        b.iter(|| load_program(RawVecMemory::new(), "tests/coremark.elf", CpuMode::RV32))
+    });
+
+    group.bench_function("load coremark UserMemory", |b| {
+        b.iter(|| load_program(UserMemory::new_32(), "tests/coremark.elf", CpuMode::RV32))
+    });
+
+    group.bench_function("load printf_64 UserMemory", |b| {
+        b.iter(|| load_program(UserMemory::new_64(), "tests/printf_64", CpuMode::RV64))
+    });
+
+    group.finish();
+}
+
+criterion_group!(benches, bench_startup);
+criterion_main!(benches);
@@ -0,0 +1,245 @@
+use std::{
+    fs,
+    time::{Duration, Instant},
+};
+
+use criterion::{black_box, criterion_group, Criterion, Throughput};
+
+use risc_sim::{
+    cpu::{
+        cpu_core::{Cpu, CpuMode, KERNEL_ADDR},
+        instrumentation::{Instrumentation, NoInstrumentation},
+    },
+    isa::csr::csr_types::CSRAddress,
+    profiling::trace::TraceWriter,
+    system::{
+        clock::{GuestClock, DEFAULT_VIRTUAL_CLOCK_HZ},
+        uart::init_uart,
+        virtio::{init_virtio, BlockDevice},
+    },
+    types::{decode_program_line, Word},
+};
+
+mod common;
+
+use common::{load_program, record, run_instructions, throughput, write_report};
+
+const USER_ENTRY: u64 = 0x10000;
+const CHUNK_INSTRUCTIONS: u64 = 100_000;
+const TRACED_PROGRAMS: [&str; 3] = ["alu", "branch", "load_store"];
+
+// Identity maps the first 2 MiB of RAM with 4 KiB pages, translation cache misses walk all three levels
+const PAGE_TABLE_ADDR: u64 = KERNEL_ADDR + 0x200000;
+const SATP_MODE_SV39: u64 = 8 << 60;
+const PTE_VRWXAD: u64 = 0xCF;
+const PTE_V: u64 = 0x1;
+
+// Offsets into virtio.S
+const VIRTIO_AVAIL_IDX_ADDR: u64 = KERNEL_ADDR + 0x101002;
+const VIRTIO_DATA_SIZE: u64 = 1024;
+
+fn userspace_cpu(program: &str) -> Cpu {
+    userspace_cpu_instrumented(program, NoInstrumentation)
+}
+
+fn userspace_cpu_instrumented<I: Instrumentation>(program: &str, instrumentation: I) -> Cpu {
+    let mut cpu = Cpu::new_userspace_instrumented(CpuMode::RV64, instrumentation);
+    cpu.load_program_from_opcodes(load_program(program), USER_ENTRY, CpuMode::RV64)
+        .unwrap();
+    cpu.clock = GuestClock::new_virtual(DEFAULT_VIRTUAL_CLOCK_HZ, 0);
+    cpu
+}
+
+fn bare_cpu(program: &str, block_device: Option<BlockDevice>) -> Cpu {
+    let mut cpu = Cpu::new_bare(block_device);
+    cpu.load_program_from_opcodes(load_program(program), KERNEL_ADDR, CpuMode::RV64)
+        .unwrap();
+    init_uart(&mut cpu);
+    init_virtio(&mut cpu);
+    cpu
+}
+
+fn enable_sv39(cpu: &mut Cpu) {
+    let l1 = PAGE_TABLE_ADDR + 0x1000;
+    let l0 = PAGE_TABLE_ADDR + 0x2000;
+    let vpn2 = (KERNEL_ADDR >> 30) & 0x1FF;
+    cpu.write_mem_u64(PAGE_TABLE_ADDR + vpn2 * 8, (l1 >> 12) << 10 | PTE_V)
+        .unwrap();
+    cpu.write_mem_u64(l1, (l0 >> 12) << 10 | PTE_V).unwrap();
+    for page in 0..512 {
+        let ppn = (KERNEL_ADDR >> 12) + page;
+        cpu.write_mem_u64(l0 + page * 8, ppn << 10 | PTE_VRWXAD)
+            .unwrap();
+    }
+    cpu.write_csr64(
+        CSRAddress::Satp.as_u12(),
+        SATP_MODE_SV39 | PAGE_TABLE_ADDR >> 12,
+    );
+}
+
+fn bench_instruction_classes(c: &mut Criterion) {
+    let mut group = c.benchmark_group("Instructions");
+    group.warm_up_time(Duration::from_millis(200));
+    group.measurement_time(Duration::from_millis(1000));
+    group.throughput(Throughput::Elements(CHUNK_INSTRUCTIONS));
+
+    for program in [
+        "alu",
+        "branch",
+        "load_store",
+        "muldiv",
+        "fp",
+        "amo",
+        "csr",
+        "syscall",
+    ] {
+        let mut cpu = userspace_cpu(program);
+        let name = format!("instructions/{}", program);
+        group.bench_function(program, |b| {
+            b.iter_custom(|iters| run_instructions(&mut cpu, &name, CHUNK_INSTRUCTIONS, iters))
+        });
+    }
+    group.finish();
+}
+
+fn bench_decoder(c: &mut Criterion) {
+    let mut group = c.benchmark_group("Decoder");
+    let words: Vec<u32> = ["alu", "branch", "load_store", "muldiv", "fp", "amo", "csr"]
+        .iter()
+        .flat_map(|program| load_program(program))
+        .collect();
+    group.throughput(Throughput::Elements(words.len() as u64));
+
+    group.bench_function("decode_program_line", |b| {
+        b.iter_custom(|iters| {
+            let start = Instant::now();
+            for _ in 0..iters {
+                for word in &words {
+                    black_box(decode_program_line(Word(black_box(*word)), CpuMode::RV64).unwrap());
+                }
+            }
+            let elapsed = start.elapsed();
+            record(
+                "decoder/decode_program_line",
+                "words",
+                words.len() as u64 * iters,
+                elapsed,
+            );
+            elapsed
+        })
+    });
+    group.finish();
+}
+
+fn bench_bare(c: &mut Criterion) {
+    let mut group = c.benchmark_group("Bare");
+    group.warm_up_time(Duration::from_millis(200));
+    group.measurement_time(Duration::from_millis(1000));
+    group.throughput(Throughput::Elements(CHUNK_INSTRUCTIONS));
+
+    let mut cpu = bare_cpu("bare_loop", None);
+    group.bench_function("mmu_off", |b| {
+        b.iter_custom(|iters| run_instructions(&mut cpu, "bare/mmu_off", CHUNK_INSTRUCTIONS, iters))
+    });
+
+    let mut cpu = bare_cpu("bare_loop", None);
+    enable_sv39(&mut cpu);
+    group.bench_function("mmu_sv39", |b| {
+        b.iter_custom(|iters| {
+            run_instructions(&mut cpu, "bare/mmu_sv39", CHUNK_INSTRUCTIONS, iters)
+        })
+    });
+
+    let image = std::env::temp_dir().join(format!("risc-sim-bench-{}.img", std::process::id()));
+    fs::write(&image, vec![0xA5u8; 64 * 1024]).unwrap();
+    let block_device = BlockDevice::new(image.to_str().unwrap()).unwrap();
+    fs::remove_file(&image).unwrap();
+    let mut cpu = bare_cpu("virtio", Some(block_device));
+    group.bench_function("virtio_blk_read", |b| {
+        b.iter_custom(|iters| {
+            let start = Instant::now();
+            let mut requests = 0;
+            for _ in 0..iters {
+                let before = cpu.read_mem_u16(VIRTIO_AVAIL_IDX_ADDR).unwrap();
+                cpu.run_cycles(CHUNK_INSTRUCTIONS).unwrap();
+                let after = cpu.read_mem_u16(VIRTIO_AVAIL_IDX_ADDR).unwrap();
+                requests += after.wrapping_sub(before) as u64;
+            }
+            let elapsed = start.elapsed();
+            record(
+                "bare/virtio_blk_read",
+                "bytes",
+                requests * VIRTIO_DATA_SIZE,
+                elapsed,
+            );
+            elapsed
+        })
+    });
+    group.finish();
+}
+
+// The same programs with and without --trace, the trace is written to a temporary file
+fn bench_trace(c: &mut Criterion) {
+    let mut group = c.benchmark_group("Trace");
+    group.warm_up_time(Duration::from_millis(200));
+    group.measurement_time(Duration::from_millis(1000));
+    group.throughput(Throughput::Elements(CHUNK_INSTRUCTIONS));
+
+    for program in TRACED_PROGRAMS {
+        let mut cpu = userspace_cpu(program);
+        let name = format!("trace/{}_untraced", program);
+        group.bench_function(format!("{}_untraced", program), |b| {
+            b.iter_custom(|iters| run_instructions(&mut cpu, &name, CHUNK_INSTRUCTIONS, iters))
+        });
+
+        let path = std::env::temp_dir().join(format!(
+            "risc-sim-bench-{}-{}.trace",
+            program,
+            std::process::id()
+        ));
+        let trace = TraceWriter::create(path.to_str().unwrap()).unwrap();
+        let mut cpu = userspace_cpu_instrumented(program, trace);
+        let name = format!("trace/{}_traced", program);
+        group.bench_function(format!("{}_traced", program), |b| {
+            b.iter_custom(|iters| run_instructions(&mut cpu, &name, CHUNK_INSTRUCTIONS, iters))
+        });
+        // Waiting for the writer thread is part of the traced run's cost
+        let start = Instant::now();
+        cpu.instrumentation_mut::<TraceWriter>()
+            .unwrap()
+            .finish()
+            .unwrap();
+        record(&name, "instructions", 0, start.elapsed());
+        fs::remove_file(&path).unwrap();
+    }
+    group.finish();
+}
+
+fn print_trace_overhead() {
+    for program in TRACED_PROGRAMS {
+        let traced = throughput(&format!("trace/{}_traced", program));
+        let untraced = throughput(&format!("trace/{}_untraced", program));
+        if let (Some(traced), Some(untraced)) = (traced, untraced) {
+            println!(
+                "trace/{:<26} {:>9.1}% of untraced throughput",
+                program,
+                traced * 100.0 / untraced
+            );
+        }
+    }
+}
+
+criterion_group!(
+    benches,
+    bench_instruction_classes,
+    bench_decoder,
+    bench_bare,
+    bench_trace
+);
+
+fn main() {
+    benches();
+    Criterion::default().configure_from_args().final_summary();
+    write_report("suite");
+    print_trace_overhead();
+}
@@ -0,0 +1,20 @@
+#!/bin/bash
+# Assembles benches/programs/*.S into flat binaries loaded by the bench suite.
+# Programs are position independent and linked at offset 0, the harness picks the load address.
+# The boot kernel is also linked at 0x80000000 as an ELF so the CLI can run it in bare mode.
+set -e
+cd "$(dirname "$0")/../benches/programs"
+LLD="$(rustc --print sysroot)/lib/rustlib/$(rustc -vV | sed -n 's/^host: //p')/bin/rust-lld"
+for source in *.S; do
+    name="${source%.S}"
+    llvm-mc -triple=riscv64 -mattr=+m,+a,+f,+d,-relax -filetype=obj "$source" -o "/tmp/$name.o"
+    if llvm-readelf -r "/tmp/$name.o" | grep -q "Relocation section"; then
+        echo "$source needs relocations, use pc-relative code only" >&2
+        exit 1
+    fi
+    llvm-objcopy -O binary -j .text "/tmp/$name.o" "$name.bin"
+    if [ "$name" = boot ]; then
+        "$LLD" -flavor gnu -m elf64lriscv -N -Ttext=0x80000000 -e _start "/tmp/$name.o" -o "$name.elf"
+    fi
+    rm "/tmp/$name.o"
+done
@@ -1 +1,118 @@
-RUSTFLAGS="-Cprofile-generate=/tmp/pgo-data -Clink-arg=-lgcov" cargo build --target=x86_64-unknown-linux-gnu --release --features maxperf
+#!/bin/bash
+# Builds a profile-guided optimized release binary from the workloads in the repo and
+# prints the MIPS of the plain, PGO and, when llvm-bolt and perf are installed, PGO+BOLT
+# binaries. llvm-profdata has to match the LLVM of rustc: rustup component add llvm-tools
+# Usage: scripts/pgo-build.sh [output], the binary is copied to target/release/risc-sim-optimized by default
+set -e
+cd "$(dirname "$0")/.."
+
+HOST=$(rustc -vV | sed -n 's/^host: //p')
+LLVM_TOOLS="$(rustc --print sysroot)/lib/rustlib/$HOST/bin"
+WORK="$PWD/target/pgo"
+OUTPUT=${1:-target/release/risc-sim-optimized}
+# The boot kernel runs until the timeout
+BARE_SECONDS=${BARE_SECONDS:-5}
+
+PROFDATA="$LLVM_TOOLS/llvm-profdata"
+if [ ! -x "$PROFDATA" ]; then
+    PROFDATA=$(command -v llvm-profdata) || {
+        echo "llvm-profdata not found, run rustup component add llvm-tools" >&2
+        exit 1
+    }
+fi
+
+# Userspace test programs with recorded results run to completion
+PROGRAMS=(tests/coremark.elf)
+for result in tests/*.res; do
+    PROGRAMS+=("${result%.res}")
+done
+BOOT=benches/programs/boot.elf
+MEASURED=(tests/coremark.elf "$BOOT")
+
+rm -rf "$WORK"
+mkdir -p "$WORK/profiles"
+head -c $((64 * 1024)) /dev/zero >"$WORK/disk.img"
+
+build() {
+    RUSTFLAGS="$1" cargo build --release --target="$HOST" --features maxperf --bin risc-sim
+    cp "target/$HOST/release/risc-sim" "$2"
+}
+
+# Runs a workload with the command given after it, the CLI arguments are appended
+run() {
+    local program=$1
+    shift
+    if [ "$program" = "$BOOT" ]; then
+        "$@" --execution-mode bare --fs-image "$WORK/disk.img" --timeout "$BARE_SECONDS" "$program" </dev/null
+    else
+        "$@" "$program" </dev/null
+    fi
+}
+
+# Guest instructions per second from the statistics printed at exit
+mips() {
+    run "$2" "$1" | awk '
+        /^Total cycle count/ { count = $4; if ($5 == "k") count *= 1000 }
+        /^Elapsed time/ {
+            time = $3
+            if (sub(/ms$/, "", time)) time /= 1e3
+            else if (sub(/µs$/, "", time)) time /= 1e6
+            else sub(/s$/, "", time)
+        }
+        END { printf "%.1f", count / time / 1e6 }'
+}
+
+echo "Building the baseline"
+build "" "$WORK/risc-sim-base"
+
+echo "Collecting profiles"
+build "-Cprofile-generate=$WORK/profiles" "$WORK/risc-sim-instrumented"
+for program in "${PROGRAMS[@]}" "$BOOT"; do
+    run "$program" "$WORK/risc-sim-instrumented" >/dev/null || true
+done
+"$PROFDATA" merge -o "$WORK/merged.profdata" "$WORK/profiles"
+
+echo "Building with the profile"
+build "-Cprofile-use=$WORK/merged.profdata" "$WORK/risc-sim-pgo"
+BINARIES=(base pgo)
+
+if command -v llvm-bolt >/dev/null && command -v perf >/dev/null; then
+    echo "Optimizing the layout with BOLT"
+    build "-Cprofile-use=$WORK/merged.profdata -Clink-arg=-Wl,--emit-relocs" "$WORK/risc-sim-pgo-relocs"
+    # Without LBR support perf samples only the instruction pointer
+    BRANCHES=(-j any,u)
+    PERF2BOLT=()
+    if ! perf record "${BRANCHES[@]}" -o /dev/null true 2>/dev/null; then
+        BRANCHES=()
+        PERF2BOLT=(-nl)
+    fi
+    for program in "${MEASURED[@]}"; do
+        name=$(basename "$program")
+        run "$program" perf record -e cycles:u "${BRANCHES[@]}" -o "$WORK/$name.perf" -- \
+            "$WORK/risc-sim-pgo-relocs" >/dev/null || true
+        perf2bolt "${PERF2BOLT[@]}" -p "$WORK/$name.perf" -o "$WORK/$name.fdata" "$WORK/risc-sim-pgo-relocs"
+    done
+    merge-fdata "$WORK"/*.fdata >"$WORK/merged.fdata"
+    llvm-bolt "$WORK/risc-sim-pgo-relocs" -o "$WORK/risc-sim-pgo-bolt" -data="$WORK/merged.fdata" \
+        -reorder-blocks=ext-tsp -reorder-functions=hfsort -split-functions -split-all-cold -dyno-stats
+    BINARIES+=(pgo-bolt)
+else
+    echo "llvm-bolt or perf not found, skipping BOLT"
+fi
+
+echo
+printf "%-24s" "MIPS"
+for binary in "${BINARIES[@]}"; do
+    printf "%12s" "$binary"
+done
+echo
+for program in "${MEASURED[@]}"; do
+    printf "%-24s" "$(basename "$program")"
+    for binary in "${BINARIES[@]}"; do
+        printf "%12s" "$(mips "$WORK/risc-sim-$binary" "$program")"
+    done
+    echo
+done
+
+cp "$WORK/risc-sim-${BINARIES[-1]}" "$OUTPUT"
+echo "Optimized binary written to $OUTPUT"
@@ -1 +0,0 @@
-target/x86_64-unknown-linux-gnu/release/risc-sim ../doomgeneric/doomgeneric/doomgeneric --simulate-display --timeout 10
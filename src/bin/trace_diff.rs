@@ -0,0 +1,39 @@
+use anyhow::Result;
+use clap::Parser;
+use risc_sim::profiling::trace::{diff_traces, TraceReader, TraceRecord};
+
+#[derive(Parser, Debug)]
+#[command(author, version, about = "Reports the first difference between two execution traces", long_about = None)]
+struct DiffArgs {
+    /// Trace recorded with --trace
+    #[arg(required = true)]
+    left: String,
+
+    /// Trace to compare against
+    #[arg(required = true)]
+    right: String,
+}
+
+fn print_record(label: &str, record: &Option<TraceRecord>) {
+    match record {
+        Some(record) => println!("  {}: {}", label, record),
+        None => println!("  {}: <end of trace>", label),
+    }
+}
+
+fn main() -> Result<()> {
+    let args = DiffArgs::parse();
+    let mut left = TraceReader::open(&args.left)?;
+    let mut right = TraceReader::open(&args.right)?;
+
+    match diff_traces(&mut left, &mut right)? {
+        None => println!("Traces are identical"),
+        Some(mismatch) => {
+            println!("First mismatch at instruction {}", mismatch.index);
+            print_record(&args.left, &mismatch.left);
+            print_record(&args.right, &mismatch.right);
+            std::process::exit(1);
+        }
+    }
+    Ok(())
+}
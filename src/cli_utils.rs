@@ -1,18 +1,33 @@
-use anyhow::Result;
+use anyhow::{bail, Result};
 use clap::Parser;
 use nix::libc::{BRKINT, ECHO, ICRNL, INPCK, ISTRIP};
-use risc_sim::cpu::cpu_core::{Cpu, CpuMode, ExecutionMode};
+use risc_sim::cpu::cpu_core::{Cpu, CpuMode, ExecutionMode, IdleState, KERNEL_ADDR, KERNEL_SIZE};
+use risc_sim::cpu::host_routines::install_host_routines;
+use risc_sim::cpu::instrumentation::{Instrumentation, NoInstrumentation};
+use risc_sim::cpu::memory::huge_page_memory::{HugePageMemory, HugePages};
 use risc_sim::elf::elf_loader::{decode_file, WordSize};
+use risc_sim::elf::symbol_table::SymbolTable;
 use risc_sim::isa::csr::csr_types::CSRAddress;
+use risc_sim::profiling::call_graph::CallGraphProfiler;
+use risc_sim::profiling::hot_regions::write_hot_regions;
+use risc_sim::profiling::instruction_profiler::InstructionProfiler;
+use risc_sim::profiling::microarch::{CacheConfig, MicroarchConfig, MicroarchModel};
+use risc_sim::profiling::trace::TraceWriter;
+use risc_sim::system::clock::{ClockSource, GuestClock};
+use risc_sim::system::passthrough_kernel::PassthroughKernel;
 use risc_sim::system::uart::init_uart;
 use risc_sim::system::virtio::{init_virtio, BlockDevice};
 use risc_sim::types::ABIRegister;
 use risc_sim::utils::data::print_pc_history;
-use std::io::Read;
+use std::fs::File;
+use std::io::{BufWriter, Read, Write};
 use std::sync::mpsc::{self, Receiver};
+use std::time::{Duration, Instant};
 use std::{io, thread};
 use termios::{Termios, ICANON, IXON, TCSANOW, VMIN, VTIME};
 
+const IDLE_POLL_INTERVAL: Duration = Duration::from_millis(50);
+
 #[derive(Parser, Debug)]
 #[command(author, version, about, long_about = None)]
 pub struct CliArgs {
@@ -35,6 +50,58 @@ pub struct CliArgs {
     /// Optional timeout
     #[arg(long)]
     pub timeout: Option<u32>,
+
+    /// Derive guest time from retired instructions at this frequency (Hz) instead of the host clock
+    #[arg(long)]
+    pub virtual_clock_hz: Option<u64>,
+
+    /// Frequency (Hz) of the time CSR, defaults to one tick per retired instruction
+    #[arg(long)]
+    pub timebase_hz: Option<u64>,
+
+    /// Count executed instructions and write a folded-stacks profile to this path
+    #[arg(long)]
+    pub profile: Option<String>,
+
+    /// Track guest calls and returns and write folded call stacks to this path
+    #[arg(long)]
+    pub call_graph: Option<String>,
+
+    /// Record every retired instruction to a compressed trace file, compare traces with trace_diff
+    #[arg(long)]
+    pub trace: Option<String>,
+
+    /// Simulate caches, TLB and branch prediction and write per-function CPI estimates to this path
+    #[arg(long)]
+    pub microarch: Option<String>,
+
+    /// L1 instruction cache for --microarch as size:ways:line_size, e.g. 32K:8:64
+    #[arg(long)]
+    pub l1i: Option<CacheConfig>,
+
+    /// L1 data cache for --microarch as size:ways:line_size
+    #[arg(long)]
+    pub l1d: Option<CacheConfig>,
+
+    /// Unified L2 cache for --microarch as size:ways:line_size
+    #[arg(long)]
+    pub l2: Option<CacheConfig>,
+
+    /// Print the most executed loops at exit
+    #[arg(long, default_value_t = false)]
+    pub hot_regions: bool,
+
+    /// Back bare mode RAM with 2 MiB host pages, falls back to smaller pages when unavailable
+    #[arg(long, value_enum)]
+    pub huge_pages: Option<HugePages>,
+
+    /// Run memcpy, memset and strlen from the ELF symbols on the host (userspace), each call retires as one instruction
+    #[arg(
+        long,
+        default_value_t = false,
+        conflicts_with_all = ["profile", "call_graph", "trace", "microarch"]
+    )]
+    pub host_routines: bool,
 }
 
 pub fn print_debug_info(mut cpu: Cpu, count: u64, elapsed_time: std::time::Duration) {
@@ -58,22 +125,75 @@ pub fn print_debug_info(mut cpu: Cpu, count: u64, elapsed_time: std::time::Durat
         "SATP: {:x}",
         cpu.csr_table.read64(CSRAddress::Satp.as_u12())
     );
-    println!(
-        "Translated 0x0: {:x}",
-        cpu.translate_address_if_needed(0x0).unwrap()
-    );
-    println!(
-        "Translated PC: {:x}",
-        cpu.translate_address_if_needed(cpu.read_pc_u64()).unwrap()
-    );
-    println!(
-        "WORD at PC: {:x}",
-        cpu.read_mem_u32(cpu.read_pc_u64()).unwrap()
-    );
+    // Kernels usually leave address 0 unmapped
+    if let Ok(addr) = cpu.translate_address_if_needed(0x0) {
+        println!("Translated 0x0: {:x}", addr);
+    }
+    if let Ok(addr) = cpu.translate_address_if_needed(cpu.read_pc_u64()) {
+        println!("Translated PC: {:x}", addr);
+    }
+    if let Ok(word) = cpu.read_mem_u32(cpu.read_pc_u64()) {
+        println!("WORD at PC: {:x}", word);
+    }
+}
+
+// Hooks are compiled into the run loop only when a profile or trace was requested
+type Profilers = (
+    Option<InstructionProfiler>,
+    Option<CallGraphProfiler>,
+    Option<TraceWriter>,
+    Option<MicroarchModel>,
+);
+
+fn new_cpu<I: Instrumentation>(
+    args: &CliArgs,
+    mode: CpuMode,
+    block_dev: Option<BlockDevice>,
+    instrumentation: I,
+) -> Cpu {
+    match args.execution_mode {
+        ExecutionMode::Bare => match args.huge_pages {
+            Some(huge_pages) => {
+                let memory = HugePageMemory::new(KERNEL_ADDR, KERNEL_SIZE, huge_pages);
+                if memory.huge_pages() != huge_pages {
+                    eprintln!(
+                        "Huge pages {:?} unavailable, using {:?}",
+                        huge_pages,
+                        memory.huge_pages()
+                    );
+                }
+                Cpu::new_instrumented(
+                    memory,
+                    PassthroughKernel::default(),
+                    instrumentation,
+                    CpuMode::RV64,
+                    block_dev,
+                    ExecutionMode::Bare,
+                )
+            }
+            None => Cpu::new_bare_instrumented(block_dev, instrumentation),
+        },
+        ExecutionMode::UserSpace => Cpu::new_userspace_instrumented(mode, instrumentation),
+    }
 }
 
-pub fn setup_cpu(args: &CliArgs) -> Result<Cpu> {
+fn microarch_config(args: &CliArgs) -> MicroarchConfig {
+    let default = MicroarchConfig::default();
+    MicroarchConfig {
+        l1i: args.l1i.unwrap_or(default.l1i),
+        l1d: args.l1d.unwrap_or(default.l1d),
+        l2: args.l2.unwrap_or(default.l2),
+        ..default
+    }
+}
+
+// Also returns the program's symbols for the reports written at exit
+pub fn setup_cpu(args: &CliArgs) -> Result<(Cpu, SymbolTable)> {
+    if args.huge_pages.is_some() && args.execution_mode != ExecutionMode::Bare {
+        bail!("--huge-pages only applies to bare mode");
+    }
     let program = decode_file(&args.program_path);
+    let symbols = SymbolTable::from_elf(&program);
     let mode = if program.header.word_size == WordSize::W32 {
         CpuMode::RV32
     } else {
@@ -84,14 +204,105 @@ pub fn setup_cpu(args: &CliArgs) -> Result<Cpu> {
     } else {
         None
     };
-    let mut cpu = match args.execution_mode {
-        ExecutionMode::Bare => Cpu::new_bare(block_dev),
-        ExecutionMode::UserSpace => Cpu::new_userspace(mode),
+    let mut cpu = if args.profile.is_some()
+        || args.call_graph.is_some()
+        || args.trace.is_some()
+        || args.microarch.is_some()
+    {
+        let profilers: Profilers = (
+            args.profile
+                .as_ref()
+                .map(|_| InstructionProfiler::new(symbols.clone())),
+            args.call_graph
+                .as_ref()
+                .map(|_| CallGraphProfiler::new(symbols.clone())),
+            args.trace.as_deref().map(TraceWriter::create).transpose()?,
+            args.microarch
+                .as_ref()
+                .map(|_| MicroarchModel::new(microarch_config(args), symbols.clone())),
+        );
+        new_cpu(args, mode, block_dev, profilers)
+    } else {
+        new_cpu(args, mode, block_dev, NoInstrumentation)
     };
+    if let Some(frequency_hz) = args.virtual_clock_hz {
+        cpu.clock = GuestClock::new_virtual(frequency_hz, 0);
+    }
+    if let Some(timebase_hz) = args.timebase_hz {
+        cpu.clock.set_timebase_hz(timebase_hz);
+    }
     cpu.load_program_from_elf(program)?;
+    if args.host_routines {
+        let routines = install_host_routines(&mut cpu, &symbols)?;
+        if routines.is_empty() {
+            eprintln!("No host routines found in the program symbols");
+        }
+    }
     init_uart(&mut cpu);
     init_virtio(&mut cpu);
-    Ok(cpu)
+    Ok((cpu, symbols))
+}
+
+const PROFILE_SUMMARY_ENTRIES: usize = 20;
+
+pub fn write_profile(cpu: &Cpu, path: &str) -> Result<()> {
+    let Some((Some(profiler), _, _, _)) = cpu.instrumentation::<Profilers>() else {
+        return Ok(());
+    };
+    let mut out = BufWriter::new(File::create(path)?);
+    profiler.write_folded(&mut out)?;
+    out.flush()?;
+
+    profiler.write_summary(&mut io::stdout().lock(), PROFILE_SUMMARY_ENTRIES)?;
+    println!("Profile written to {}", path);
+    Ok(())
+}
+
+pub fn write_call_graph(cpu: &Cpu, path: &str) -> Result<()> {
+    let Some((_, Some(call_graph), _, _)) = cpu.instrumentation::<Profilers>() else {
+        return Ok(());
+    };
+    let mut out = BufWriter::new(File::create(path)?);
+    call_graph.write_folded(&mut out)?;
+    out.flush()?;
+
+    call_graph.write_summary(&mut io::stdout().lock(), PROFILE_SUMMARY_ENTRIES)?;
+    println!("Call graph written to {}", path);
+    Ok(())
+}
+
+pub fn finish_trace(cpu: &mut Cpu, path: &str) -> Result<()> {
+    if let Some((_, _, Some(trace), _)) = cpu.instrumentation_mut::<Profilers>() {
+        trace.finish()?;
+        println!("Trace written to {}", path);
+    }
+    Ok(())
+}
+
+pub fn write_microarch_report(cpu: &Cpu, path: &str) -> Result<()> {
+    let Some((_, _, _, Some(model))) = cpu.instrumentation::<Profilers>() else {
+        return Ok(());
+    };
+    let mut out = BufWriter::new(File::create(path)?);
+    model.write_report(&mut out)?;
+    out.flush()?;
+
+    let mut stdout = io::stdout().lock();
+    model.write_summary(&mut stdout)?;
+    model.write_top_functions(&mut stdout, PROFILE_SUMMARY_ENTRIES)?;
+    println!("Microarchitecture report written to {}", path);
+    Ok(())
+}
+
+pub fn print_hot_regions(cpu: &Cpu, symbols: &SymbolTable) -> Result<()> {
+    write_hot_regions(
+        &mut io::stdout().lock(),
+        cpu.program_cache.loop_counters(),
+        symbols,
+        cpu.instret,
+        PROFILE_SUMMARY_ENTRIES,
+    )?;
+    Ok(())
 }
 
 pub fn setup_terminal() -> Result<Receiver<u8>> {
@@ -117,3 +328,26 @@ pub fn create_stdio_channel() -> Receiver<u8> {
     });
     rx
 }
+
+// Sleeps while the guest is stopped on WFI, returns input that arrived in the meantime
+pub fn wait_for_event(cpu: &mut Cpu, idle: IdleState, stdio_channel: &Receiver<u8>) -> Option<u8> {
+    let timeout = match idle {
+        IdleState::Timer(ticks) if cpu.clock.source() == ClockSource::Virtual => {
+            cpu.fast_forward(ticks);
+            return None;
+        }
+        IdleState::Timer(ticks) => {
+            Duration::from_nanos(cpu.clock.ticks_to_ns(ticks)).min(IDLE_POLL_INTERVAL)
+        }
+        IdleState::External => IDLE_POLL_INTERVAL,
+    };
+
+    let start = Instant::now();
+    let received = stdio_channel.recv_timeout(timeout).ok();
+
+    if let IdleState::Timer(ticks) = idle {
+        let elapsed = cpu.clock.ns_to_ticks(start.elapsed().as_nanos() as u64);
+        cpu.fast_forward(elapsed.min(ticks));
+    }
+    received
+}
@@ -1,32 +1,47 @@
-use std::{fmt::Display, fs::File};
+use std::{
+    any::{Any, TypeId},
+    fmt::Display,
+    fs::File,
+};
 
 use crate::{
     elf::elf_loader::{load_kernel_to_memory, load_program_to_memory, ElfFile},
     isa::{
-        csr::csr_types::{CSRAddress, CSRTable},
-        traps::{check_pending_interrupts, update_timers},
+        csr::{
+            counters::{read_counter, write_counter},
+            csr_types::{CSRAddress, CSRTable},
+        },
+        traps::{
+            check_pending_interrupts, has_enabled_pending_interrupt, ticks_until_timer_interrupt,
+            update_timer_interrupt,
+        },
     },
     system::{
+        clock::GuestClock,
         kernel::Kernel,
         passthrough_kernel::PassthroughKernel,
         plic::{plic_check_pending, PLIC_ADDR},
         uart::UART_ADDR,
         virtio::{BlockDevice, VIRTIO_0_ADDR},
     },
-    types::{decode_program_line_unchecked, ABIRegister, Instruction},
+    types::{decode_program_line_unchecked, ABIRegister, BitValue, Instruction, U12},
     utils::binary_utils::*,
 };
 
 use super::{
+    engine::Engine,
+    instrumentation::{
+        after_retire, before_syscall, Instrumentation, MemAccessKind, NoInstrumentation,
+    },
     memory::{
         memory_core::Memory,
         mmu::walk_page_table_sv39,
         program_cache::ProgramCache,
         raw_memory::ContinuousMemory,
         raw_vec_memory::RawVecMemory,
+        translation_cache::TranslationCache,
         user_memory::{UserMemory, HEAP_SIZE, STACK_SIZE},
     },
-    memory_access::*,
 };
 use crate::{
     types::{decode_program_line, ProgramLine, Word},
@@ -53,6 +68,14 @@ pub enum PrivilegeMode {
     Machine = 3,
 }
 
+#[derive(PartialEq, Clone, Copy, Debug)]
+pub enum IdleState {
+    // Waiting for the timer, the value is the number of ticks until it fires
+    Timer(u64),
+    // Waiting for an external interrupt (UART input)
+    External,
+}
+
 pub struct Peripherals {
     pub uart: ContinuousMemory,
     pub virtio: ContinuousMemory,
@@ -60,13 +83,17 @@ pub struct Peripherals {
 }
 
 pub struct Cpu {
-    reg_x32: [u32; 32],
-    reg_x64: [u64; 32],
+    // Single XLEN=64 register file, RV32 reads the low half and writes are sign-extended
+    reg_x: [u64; 32],
     reg_f: [f64; 32],
     reg_pc_64: u64,
     pub current_instruction_pc_64: u64,
-    pub memory: Box<dyn Memory>,
-    program_cache: ProgramCache,
+    // Replacing the backend would invalidate `engine`, which is specialized for its type
+    pub(crate) memory: Box<dyn Memory>,
+    engine: Engine,
+    // Checked by the accessors below before calling into `engine`
+    pub(crate) translation_cache: TranslationCache,
+    pub program_cache: ProgramCache,
     program_memory_offset: u64,
     halted: bool,
     pub program_brk: u64,
@@ -76,29 +103,30 @@ pub struct Cpu {
     pub privilege_mode: PrivilegeMode,
     pub pc_history: CircularBuffer<(u64, Option<Instruction>, u64)>,
     pub block_device: Option<BlockDevice>,
-    pub execution_mode: ExecutionMode,
+    pub(crate) execution_mode: ExecutionMode,
     pub peripherals: Option<Peripherals>,
+    pub clock: GuestClock,
+    pub instret: u64,
+    pub waiting_for_interrupt: bool,
+    // Hooks of the type `engine` was built for, see `instrumentation_as`
+    instrumentation: Box<dyn Any>,
 }
 
 impl Display for Cpu {
     fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
         writeln!(f, "Registers:")?;
         if self.arch_mode == CpuMode::RV64 {
-            for (i, reg) in self
-                .reg_x64
-                .iter()
-                .enumerate()
-                .filter(|(_, reg)| *reg != &0)
-            {
+            for (i, reg) in self.reg_x.iter().enumerate().filter(|(_, reg)| *reg != &0) {
                 writeln!(f, "x{}: {:#010x}", i, reg)?;
             }
             writeln!(f, "PC: {:#010x}", self.reg_pc_64)?;
         } else {
             for (i, reg) in self
-                .reg_x32
+                .reg_x
                 .iter()
+                .map(|reg| *reg as u32)
                 .enumerate()
-                .filter(|(_, reg)| *reg != &0)
+                .filter(|(_, reg)| *reg != 0)
             {
                 writeln!(f, "x{}: {:#010x}", i, reg)?;
             }
@@ -122,12 +150,16 @@ pub const KERNEL_SIZE: u64 = 128 * 1024 * 1024;
 impl Default for Cpu {
     fn default() -> Self {
         Cpu {
-            reg_x32: [0x0; 32],
-            reg_x64: [0x0; 32],
+            reg_x: [0x0; 32],
             reg_f: [0.0; 32],
             reg_pc_64: 0x0,
             current_instruction_pc_64: 0x0,
             memory: Box::new(RawVecMemory::new()),
+            engine: Engine::new::<RawVecMemory, NoInstrumentation>(
+                &ExecutionMode::UserSpace,
+                CpuMode::RV32,
+            ),
+            translation_cache: TranslationCache::new(),
             program_cache: ProgramCache::empty(),
             program_memory_offset: 0x0,
             halted: false,
@@ -140,6 +172,10 @@ impl Default for Cpu {
             block_device: None,
             execution_mode: ExecutionMode::UserSpace,
             peripherals: None,
+            clock: GuestClock::default(),
+            instret: 0,
+            waiting_for_interrupt: false,
+            instrumentation: Box::new(NoInstrumentation),
         }
     }
 }
@@ -155,14 +191,38 @@ impl Cpu {
     where
         M: Memory + 'static,
         K: Kernel + 'static,
+    {
+        Self::new_instrumented(
+            memory,
+            kernel,
+            NoInstrumentation,
+            mode,
+            block_device,
+            execution_mode,
+        )
+    }
+
+    pub fn new_instrumented<M, K, I>(
+        memory: M,
+        kernel: K,
+        instrumentation: I,
+        mode: CpuMode,
+        block_device: Option<BlockDevice>,
+        execution_mode: ExecutionMode,
+    ) -> Cpu
+    where
+        M: Memory + 'static,
+        K: Kernel + 'static,
+        I: Instrumentation,
     {
         Cpu {
-            reg_x32: [0x0; 32],
-            reg_x64: [0x0; 32],
+            reg_x: [0x0; 32],
             reg_f: [0.0; 32],
             reg_pc_64: 0x0,
             current_instruction_pc_64: 0x0,
             memory: Box::new(memory),
+            engine: Engine::new::<M, I>(&execution_mode, mode),
+            translation_cache: TranslationCache::new(),
             program_cache: ProgramCache::empty(),
             program_memory_offset: 0x0,
             halted: false,
@@ -179,66 +239,75 @@ impl Cpu {
                 virtio: ContinuousMemory::new(VIRTIO_0_ADDR, 0x100),
                 plic: ContinuousMemory::new(PLIC_ADDR, 0x201004 + 0x8),
             }),
+            clock: GuestClock::default(),
+            instret: 0,
+            waiting_for_interrupt: false,
+            instrumentation: Box::new(instrumentation),
         }
     }
 
     pub fn new_userspace(mode: CpuMode) -> Cpu {
-        match mode {
-            CpuMode::RV64 => Cpu::new(
-                UserMemory::new(
-                    INITIAL_STACK_POINTER_64 as u64 - STACK_SIZE,
-                    0,
-                    STACK_SIZE,
-                    HEAP_SIZE,
-                ),
-                PassthroughKernel::default(),
-                mode,
-                None,
-                ExecutionMode::UserSpace,
-            ),
-            CpuMode::RV32 => Cpu::new(
-                UserMemory::new(
-                    INITIAL_STACK_POINTER_32 as u64 - STACK_SIZE,
-                    0,
-                    STACK_SIZE,
-                    HEAP_SIZE,
-                ),
-                PassthroughKernel::default(),
-                mode,
-                None,
-                ExecutionMode::UserSpace,
-            ),
-        }
+        Self::new_userspace_instrumented(mode, NoInstrumentation)
+    }
+
+    pub fn new_userspace_instrumented<I: Instrumentation>(
+        mode: CpuMode,
+        instrumentation: I,
+    ) -> Cpu {
+        let stack_pointer = match mode {
+            CpuMode::RV64 => INITIAL_STACK_POINTER_64,
+            CpuMode::RV32 => INITIAL_STACK_POINTER_32 as u64,
+        };
+        Cpu::new_instrumented(
+            UserMemory::new(stack_pointer - STACK_SIZE, 0, STACK_SIZE, HEAP_SIZE),
+            PassthroughKernel::default(),
+            instrumentation,
+            mode,
+            None,
+            ExecutionMode::UserSpace,
+        )
     }
 
     pub fn new_bare(block_device: Option<BlockDevice>) -> Cpu {
-        Cpu::new(
+        Self::new_bare_instrumented(block_device, NoInstrumentation)
+    }
+
+    pub fn new_bare_instrumented<I: Instrumentation>(
+        block_device: Option<BlockDevice>,
+        instrumentation: I,
+    ) -> Cpu {
+        Cpu::new_instrumented(
             ContinuousMemory::default(),
             PassthroughKernel::default(),
+            instrumentation,
             CpuMode::RV64,
             block_device,
             ExecutionMode::Bare,
         )
     }
 
-    fn run_cycle_bare(&mut self) -> Result<()> {
+    #[inline(always)]
+    fn run_cycle_bare<M: Memory + 'static, const XLEN: u32, I: Instrumentation>(
+        &mut self,
+    ) -> Result<()> {
         // Check if CPU is halted
         if self.halted {
             bail!("CPU is halted");
         }
 
         // Fetch
-        #[cfg(feature = "maxperf")]
-        let pc_translated = unsafe {
-            self.translate_address_if_needed(self.reg_pc_64)
-                .unwrap_unchecked()
+        let word = match self.translation_cache.fetch_ptr(self.reg_pc_64) {
+            Some(ptr) => unsafe { (ptr as *const u32).read_unaligned() },
+            None => self.fetch_bare::<M>()?,
         };
-        #[cfg(not(feature = "maxperf"))]
-        let pc_translated = self.translate_address_if_needed(self.reg_pc_64)?;
 
         let instruction = decode_program_line_unchecked(
-            &Word(self.memory.read_mem_u32(pc_translated)?),
-            self.arch_mode,
+            &Word(word),
+            if XLEN == 64 {
+                CpuMode::RV64
+            } else {
+                CpuMode::RV32
+            },
         );
 
         // Increase PC
@@ -249,27 +318,51 @@ impl Cpu {
         self.pc_history.push((
             self.current_instruction_pc_64,
             Some(instruction.instruction),
-            self.csr_table.read64(CSRAddress::Satp.as_u12()),
+            self.csr_table.satp,
         ));
 
+        let pc = self.current_instruction_pc_64;
+        if I::ENABLED {
+            self.instrumentation_as::<I>().on_fetch(pc, &instruction);
+        }
+
         // Execute
         self.execute_program_line(&instruction)?;
+        self.instret += 1;
+
+        after_retire::<I>(self, pc, &instruction);
 
-        update_timers(self);
         plic_check_pending(self);
         check_pending_interrupts(self);
 
         Ok(())
     }
 
-    fn run_cycle_userspace(&mut self) -> Result<()> {
+    // Translation cache miss, hooks only see fetches by pc so this is cached with them enabled too
+    fn fetch_bare<M: Memory + 'static>(&mut self) -> Result<u32> {
+        #[cfg(feature = "maxperf")]
+        let pc_translated = unsafe {
+            self.translate_address_if_needed(self.reg_pc_64)
+                .unwrap_unchecked()
+        };
+        #[cfg(not(feature = "maxperf"))]
+        let pc_translated = self.translate_address_if_needed(self.reg_pc_64)?;
+
+        if let Some(page) = self.memory_as::<M>().host_page(pc_translated) {
+            self.translation_cache.insert_fetch(self.reg_pc_64, page);
+        }
+        self.memory_as::<M>().read_mem_u32(pc_translated)
+    }
+
+    #[inline(always)]
+    fn run_cycle_userspace<I: Instrumentation>(&mut self) -> Result<()> {
         // Check if CPU is halted
         if self.halted {
             bail!("CPU is halted");
         }
 
         // Fetch
-        let instruction = self.program_cache.get_line_unchecked(self.reg_pc_64);
+        let mut instruction = self.program_cache.get_line(self.reg_pc_64);
 
         // Increase PC
         self.current_instruction_pc_64 = self.reg_pc_64;
@@ -279,29 +372,43 @@ impl Cpu {
         self.pc_history.push((
             self.current_instruction_pc_64,
             Some(instruction.instruction),
-            self.csr_table.read64(CSRAddress::Satp.as_u12()),
+            self.csr_table.satp,
         ));
 
+        let pc = self.current_instruction_pc_64;
+        if I::ENABLED {
+            // Hooks see the real instruction, not the lazy-decoding placeholder
+            if ProgramCache::is_placeholder(&instruction) {
+                instruction = self.decode_placeholder(pc);
+            }
+            self.instrumentation_as::<I>().on_fetch(pc, &instruction);
+            before_syscall::<I>(self, pc, &instruction);
+        }
+
         // Execute
         self.execute_program_line(&instruction)?;
+        self.instret += 1;
+
+        after_retire::<I>(self, pc, &instruction);
 
         Ok(())
     }
 
+    // Kept out of line, the run loop only pays for the placeholder check
+    #[cold]
+    #[inline(never)]
+    fn decode_placeholder(&mut self, pc: u64) -> ProgramLine {
+        self.program_cache
+            .decode_placeholder(pc, self.memory.as_mut())
+    }
+
     pub fn load_program_from_elf(&mut self, elf: ElfFile) -> Result<()> {
         let program_file = load_program_to_memory(elf, self.memory.as_mut())?;
 
         self.reg_pc_64 = program_file.entry_point;
 
-        let cache = ProgramCache::new(
-            program_file.program_memory_offset,
-            program_file.program_memory_offset + program_file.program_size,
-            self.memory.as_mut(),
-            self.arch_mode,
-        );
-
         if self.execution_mode == ExecutionMode::UserSpace {
-            self.program_cache = cache.unwrap();
+            self.program_cache = ProgramCache::new(self.arch_mode);
         }
         if self.arch_mode == CpuMode::RV64 {
             self.write_x_u64(
@@ -324,13 +431,7 @@ impl Cpu {
 
         load_kernel_to_memory(image, self.memory.as_mut(), addr);
 
-        self.program_cache = ProgramCache::new(
-            addr,
-            addr + image.metadata().unwrap().len(),
-            self.memory.as_mut(),
-            self.arch_mode,
-        )
-        .unwrap();
+        self.program_cache = ProgramCache::new(self.arch_mode);
 
         Ok(())
     }
@@ -351,41 +452,73 @@ impl Cpu {
 
         self.reg_pc_64 = entry_point;
 
-        self.program_cache = ProgramCache::new(
-            entry_point,
-            entry_point + program_size,
-            self.memory.as_mut(),
-            mode,
-        )
-        .unwrap();
+        self.program_cache = ProgramCache::new(mode);
 
         self.program_brk = entry_point + program_size;
         Ok(())
     }
 
     pub fn run_cycles(&mut self, count: u64) -> Result<()> {
-        match self.execution_mode {
-            ExecutionMode::Bare => {
-                for _ in 0..count {
-                    let res = self.run_cycle_bare();
-                    if res.is_err() {
-                        return res;
-                    }
-                }
+        (self.engine.run_cycles)(self, count)
+    }
+
+    pub(crate) fn run_cycles_bare<M: Memory + 'static, const XLEN: u32, I: Instrumentation>(
+        &mut self,
+        count: u64,
+    ) -> Result<()> {
+        if self.waiting_for_interrupt && !self.wake_from_wfi() {
+            return Ok(());
+        }
+        for _ in 0..count {
+            let res = self.run_cycle_bare::<M, XLEN, I>();
+            if res.is_err() {
+                return res;
             }
-            ExecutionMode::UserSpace => {
-                for _ in 0..count {
-                    let res = self.run_cycle_userspace();
-                    if res.is_err() {
-                        return res;
-                    }
-                }
+            if self.waiting_for_interrupt {
+                break;
             }
         }
+        Ok(())
+    }
 
+    pub(crate) fn run_cycles_userspace<I: Instrumentation>(&mut self, count: u64) -> Result<()> {
+        for _ in 0..count {
+            let res = self.run_cycle_userspace::<I>();
+            if res.is_err() {
+                return res;
+            }
+        }
         Ok(())
     }
 
+    fn wake_from_wfi(&mut self) -> bool {
+        plic_check_pending(self);
+        update_timer_interrupt(self);
+        if !has_enabled_pending_interrupt(self) {
+            return false;
+        }
+        self.waiting_for_interrupt = false;
+        check_pending_interrupts(self);
+        true
+    }
+
+    // What a hart stopped on WFI is waiting for, None while it is executing
+    pub fn idle_state(&self) -> Option<IdleState> {
+        if !self.waiting_for_interrupt {
+            return None;
+        }
+        match ticks_until_timer_interrupt(self) {
+            Some(ticks) => Some(IdleState::Timer(ticks)),
+            None => Some(IdleState::External),
+        }
+    }
+
+    // Advances the timebase without executing instructions
+    pub fn fast_forward(&mut self, ticks: u64) {
+        self.csr_table.time += ticks;
+        self.clock.skip_ns(self.clock.ticks_to_ns(ticks));
+    }
+
     #[inline(always)]
     pub fn execute_program_line(&mut self, program_line: &ProgramLine) -> Result<()> {
         let word = program_line.word;
@@ -401,8 +534,35 @@ impl Cpu {
         self.halted = true;
     }
 
+    // SAFETY: `engine` is built for the concrete type stored in `memory`
+    #[inline(always)]
+    pub(crate) fn memory_as<M: Memory + 'static>(&mut self) -> &mut M {
+        debug_assert!(self.engine.memory_type == TypeId::of::<M>());
+        unsafe { &mut *(self.memory.as_mut() as *mut dyn Memory as *mut M) }
+    }
+
+    // SAFETY: `engine` is built for the concrete type stored in `instrumentation`
+    #[inline(always)]
+    pub(crate) fn instrumentation_as<I: Instrumentation>(&mut self) -> &mut I {
+        debug_assert!(self.engine.instrumentation_type == TypeId::of::<I>());
+        unsafe { &mut *(self.instrumentation.as_mut() as *mut dyn Any as *mut I) }
+    }
+
+    // None if the Cpu was built with a different instrumentation type
+    pub fn instrumentation<I: Instrumentation>(&self) -> Option<&I> {
+        self.instrumentation.downcast_ref::<I>()
+    }
+
+    pub fn instrumentation_mut<I: Instrumentation>(&mut self) -> Option<&mut I> {
+        self.instrumentation.downcast_mut::<I>()
+    }
+
+    pub(crate) fn notify_trap(&mut self, cause: u64, interrupt: bool) {
+        (self.engine.on_trap)(self, self.current_instruction_pc_64, cause, interrupt)
+    }
+
     pub fn translate_address_if_needed(&mut self, addr: u64) -> Result<u64> {
-        let satp = self.csr_table.read64(CSRAddress::Satp.as_u12());
+        let satp = self.csr_table.satp;
         if satp != 0 {
             walk_page_table_sv39(addr, satp, self)
         } else {
@@ -410,60 +570,92 @@ impl Cpu {
         }
     }
 
+    // The engine's accessors record the accesses that miss the translation cache
+    #[inline(always)]
+    fn record_cached_access(&mut self, addr: u64, size: u8, kind: MemAccessKind) {
+        if let Some(record) = self.engine.on_mem_access {
+            record(self, addr, size, kind);
+        }
+    }
+
+    #[inline(always)]
     pub fn read_mem_u64(&mut self, addr: u64) -> Result<u64> {
-        match self.execution_mode {
-            ExecutionMode::Bare => bare_read_mem_u64(self, addr),
-            ExecutionMode::UserSpace => user_space_read_mem_u64(self, addr),
+        if let Some(ptr) = self.translation_cache.read_ptr(addr, 8) {
+            self.record_cached_access(addr, 8, MemAccessKind::Read);
+            return Ok(unsafe { (ptr as *const u64).read_unaligned() });
         }
+        (self.engine.read_mem_u64)(self, addr)
     }
 
+    #[inline(always)]
     pub fn read_mem_u32(&mut self, addr: u64) -> Result<u32> {
-        match self.execution_mode {
-            ExecutionMode::Bare => bare_read_mem_u32(self, addr),
-            ExecutionMode::UserSpace => user_space_read_mem_u32(self, addr),
+        if let Some(ptr) = self.translation_cache.read_ptr(addr, 4) {
+            self.record_cached_access(addr, 4, MemAccessKind::Read);
+            return Ok(unsafe { (ptr as *const u32).read_unaligned() });
         }
+        (self.engine.read_mem_u32)(self, addr)
     }
 
+    #[inline(always)]
     pub fn read_mem_u16(&mut self, addr: u64) -> Result<u16> {
-        match self.execution_mode {
-            ExecutionMode::Bare => bare_read_mem_u16(self, addr),
-            ExecutionMode::UserSpace => user_space_read_mem_u16(self, addr),
+        if let Some(ptr) = self.translation_cache.read_ptr(addr, 2) {
+            self.record_cached_access(addr, 2, MemAccessKind::Read);
+            return Ok(unsafe { (ptr as *const u16).read_unaligned() });
         }
+        (self.engine.read_mem_u16)(self, addr)
     }
 
+    #[inline(always)]
     pub fn read_mem_u8(&mut self, addr: u64) -> Result<u8> {
-        match self.execution_mode {
-            ExecutionMode::Bare => bare_read_mem_u8(self, addr),
-            ExecutionMode::UserSpace => user_space_read_mem_u8(self, addr),
+        if let Some(ptr) = self.translation_cache.read_ptr(addr, 1) {
+            self.record_cached_access(addr, 1, MemAccessKind::Read);
+            return Ok(unsafe { (ptr as *const u8).read_unaligned() });
         }
+        (self.engine.read_mem_u8)(self, addr)
     }
 
+    #[inline(always)]
     pub fn write_mem_u8(&mut self, addr: u64, value: u8) -> Result<()> {
-        match self.execution_mode {
-            ExecutionMode::Bare => bare_write_mem_u8(self, addr, value),
-            ExecutionMode::UserSpace => user_space_write_mem_u8(self, addr, value),
+        if let Some(ptr) = self.translation_cache.write_ptr(addr, 1) {
+            self.record_cached_access(addr, 1, MemAccessKind::Write);
+            self.program_cache.invalidate(addr, 1);
+            unsafe { (ptr as *mut u8).write_unaligned(value) };
+            return Ok(());
         }
+        (self.engine.write_mem_u8)(self, addr, value)
     }
 
+    #[inline(always)]
     pub fn write_mem_u16(&mut self, addr: u64, value: u16) -> Result<()> {
-        match self.execution_mode {
-            ExecutionMode::Bare => bare_write_mem_u16(self, addr, value),
-            ExecutionMode::UserSpace => user_space_write_mem_u16(self, addr, value),
+        if let Some(ptr) = self.translation_cache.write_ptr(addr, 2) {
+            self.record_cached_access(addr, 2, MemAccessKind::Write);
+            self.program_cache.invalidate(addr, 2);
+            unsafe { (ptr as *mut u16).write_unaligned(value) };
+            return Ok(());
         }
+        (self.engine.write_mem_u16)(self, addr, value)
     }
 
+    #[inline(always)]
     pub fn write_mem_u32(&mut self, addr: u64, value: u32) -> Result<()> {
-        match self.execution_mode {
-            ExecutionMode::Bare => bare_write_mem_u32(self, addr, value),
-            ExecutionMode::UserSpace => user_space_write_mem_u32(self, addr, value),
+        if let Some(ptr) = self.translation_cache.write_ptr(addr, 4) {
+            self.record_cached_access(addr, 4, MemAccessKind::Write);
+            self.program_cache.invalidate(addr, 4);
+            unsafe { (ptr as *mut u32).write_unaligned(value) };
+            return Ok(());
         }
+        (self.engine.write_mem_u32)(self, addr, value)
     }
 
+    #[inline(always)]
     pub fn write_mem_u64(&mut self, addr: u64, value: u64) -> Result<()> {
-        match self.execution_mode {
-            ExecutionMode::Bare => bare_write_mem_u64(self, addr, value),
-            ExecutionMode::UserSpace => user_space_write_mem_u64(self, addr, value),
+        if let Some(ptr) = self.translation_cache.write_ptr(addr, 8) {
+            self.record_cached_access(addr, 8, MemAccessKind::Write);
+            self.program_cache.invalidate(addr, 8);
+            unsafe { (ptr as *mut u64).write_unaligned(value) };
+            return Ok(());
         }
+        (self.engine.write_mem_u64)(self, addr, value)
     }
 
     pub fn read_buf(&mut self, addr: u64, buf: &mut [u8]) -> Result<()> {
@@ -471,19 +663,75 @@ impl Cpu {
         self.memory.read_buf(addr, buf)
     }
 
+    // Pages written since the previous call, see `Memory::take_dirty_pages`.
+    // Cached store translations are dropped so later stores mark their page again.
+    pub fn take_dirty_pages(&mut self) -> Option<Vec<u64>> {
+        self.translation_cache.flush_writes();
+        self.memory.take_dirty_pages()
+    }
+
     pub fn write_buf(&mut self, addr: u64, buf: &[u8]) -> Result<()> {
         let addr = self.translate_address_if_needed(addr)?;
+        if self.execution_mode == ExecutionMode::UserSpace {
+            self.program_cache.invalidate(addr, buf.len() as u64);
+        }
         self.memory.write_buf(addr, buf)
     }
 
+    pub fn fill(&mut self, addr: u64, len: u64, value: u8) -> Result<()> {
+        let addr = self.translate_address_if_needed(addr)?;
+        if self.execution_mode == ExecutionMode::UserSpace {
+            self.program_cache.invalidate(addr, len);
+        }
+        self.memory.fill(addr, len, value)
+    }
+
+    // The time CSR, derived from the retired-instruction counter
+    #[inline(always)]
+    pub fn read_time(&self) -> u64 {
+        self.csr_table.time + self.clock.instructions_to_ticks(self.instret)
+    }
+
+    pub fn read_csr32(&self, addr: U12) -> u32 {
+        match read_counter(self, addr) {
+            Some(value) => value as u32,
+            None => self.csr_table.read32(addr),
+        }
+    }
+
+    pub fn read_csr64(&self, addr: U12) -> u64 {
+        match read_counter(self, addr) {
+            Some(value) => value,
+            None => self.csr_table.read64(addr),
+        }
+    }
+
+    pub fn write_csr32(&mut self, addr: U12, value: u32) {
+        if !write_counter(self, addr, value as u64, CpuMode::RV32) {
+            self.csr_table.write32(addr, value);
+        }
+        if addr.value() == CSRAddress::Satp as u16 {
+            self.translation_cache.flush();
+        }
+    }
+
+    pub fn write_csr64(&mut self, addr: U12, value: u64) {
+        if !write_counter(self, addr, value, CpuMode::RV64) {
+            self.csr_table.write64(addr, value);
+        }
+        if addr.value() == CSRAddress::Satp as u16 {
+            self.translation_cache.flush();
+        }
+    }
+
     #[inline(always)]
     pub fn read_x_u32(&self, id: u8) -> u32 {
-        unsafe { *self.reg_x32.get_unchecked(id as usize) }
+        unsafe { *self.reg_x.get_unchecked(id as usize) as u32 }
     }
 
     #[inline(always)]
     pub fn read_x_u64(&self, id: u8) -> u64 {
-        unsafe { *self.reg_x64.get_unchecked(id as usize) }
+        unsafe { *self.reg_x.get_unchecked(id as usize) }
     }
 
     #[inline(always)]
@@ -502,8 +750,8 @@ impl Cpu {
             return; // x0 is hardwired to 0
         }
 
-        let reg_value = unsafe { self.reg_x32.get_unchecked_mut(id as usize) }; // SAFETY: For properly compiled code 0 <= id < 32
-        *reg_value = i32_to_u32(value);
+        let reg_value = unsafe { self.reg_x.get_unchecked_mut(id as usize) }; // SAFETY: For properly compiled code 0 <= id < 32
+        *reg_value = i64_to_u64(value as i64);
     }
 
     #[inline(always)]
@@ -512,7 +760,7 @@ impl Cpu {
             return; // x0 is hardwired to 0
         }
 
-        let reg_value = unsafe { self.reg_x64.get_unchecked_mut(id as usize) }; // SAFETY: For properly compiled code 0 <= id < 32
+        let reg_value = unsafe { self.reg_x.get_unchecked_mut(id as usize) }; // SAFETY: For properly compiled code 0 <= id < 32
         *reg_value = i64_to_u64(value);
     }
 
@@ -522,8 +770,8 @@ impl Cpu {
             return; // x0 is hardwired to 0
         }
 
-        let reg_value = unsafe { self.reg_x32.get_unchecked_mut(id as usize) }; // SAFETY: For properly compiled code 0 <= id < 32
-        *reg_value = value;
+        let reg_value = unsafe { self.reg_x.get_unchecked_mut(id as usize) }; // SAFETY: For properly compiled code 0 <= id < 32
+        *reg_value = value as i32 as i64 as u64;
     }
 
     #[inline(always)]
@@ -532,7 +780,7 @@ impl Cpu {
             return; // x0 is hardwired to 0
         }
 
-        let reg_value = unsafe { self.reg_x64.get_unchecked_mut(id as usize) }; // SAFETY: For properly compiled code 0 <= id < 32
+        let reg_value = unsafe { self.reg_x.get_unchecked_mut(id as usize) }; // SAFETY: For properly compiled code 0 <= id < 32
         *reg_value = value;
     }
 
@@ -572,6 +820,16 @@ impl Cpu {
         self.reg_pc_64 = val;
     }
 
+    // Taken branches and plain jumps, backward ones close loops and feed the hot loop counters
+    #[inline(always)]
+    pub fn jump(&mut self, target: u64) {
+        let pc = self.current_instruction_pc_64;
+        if target < pc {
+            self.program_cache.record_back_edge(pc, target);
+        }
+        self.reg_pc_64 = target;
+    }
+
     #[allow(unused)]
     fn print_breakpoint(&mut self, pc: u64, val: u64, name: &str) -> bool {
         if val == pc {
@@ -0,0 +1,82 @@
+use std::any::TypeId;
+
+use anyhow::Result;
+
+use super::{
+    cpu_core::{Cpu, CpuMode, ExecutionMode},
+    instrumentation::{record_mem_access, record_trap, Instrumentation, MemAccessKind},
+    memory::memory_core::Memory,
+    memory_access::*,
+};
+
+// Entry points monomorphized for the concrete memory backend, instrumentation,
+// execution mode and XLEN when the Cpu is built. Both types are only erased behind
+// these pointers, so loads, stores and the fetch loop call them directly.
+#[derive(Clone, Copy)]
+pub struct Engine {
+    pub(crate) memory_type: TypeId,
+    pub(crate) instrumentation_type: TypeId,
+    pub(crate) run_cycles: fn(&mut Cpu, u64) -> Result<()>,
+    pub(crate) on_trap: fn(&mut Cpu, u64, u64, bool),
+    // Called for accesses served by the translation cache, None without memory access hooks
+    pub(crate) on_mem_access: Option<fn(&mut Cpu, u64, u8, MemAccessKind)>,
+    pub(crate) read_mem_u8: fn(&mut Cpu, u64) -> Result<u8>,
+    pub(crate) read_mem_u16: fn(&mut Cpu, u64) -> Result<u16>,
+    pub(crate) read_mem_u32: fn(&mut Cpu, u64) -> Result<u32>,
+    pub(crate) read_mem_u64: fn(&mut Cpu, u64) -> Result<u64>,
+    pub(crate) write_mem_u8: fn(&mut Cpu, u64, u8) -> Result<()>,
+    pub(crate) write_mem_u16: fn(&mut Cpu, u64, u16) -> Result<()>,
+    pub(crate) write_mem_u32: fn(&mut Cpu, u64, u32) -> Result<()>,
+    pub(crate) write_mem_u64: fn(&mut Cpu, u64, u64) -> Result<()>,
+}
+
+fn mem_access_hook<I: Instrumentation>() -> Option<fn(&mut Cpu, u64, u8, MemAccessKind)> {
+    if I::ENABLED && I::MEM_ACCESSES {
+        Some(record_mem_access::<I>)
+    } else {
+        None
+    }
+}
+
+impl Engine {
+    pub fn new<M: Memory + 'static, I: Instrumentation>(
+        execution_mode: &ExecutionMode,
+        arch_mode: CpuMode,
+    ) -> Engine {
+        match execution_mode {
+            ExecutionMode::Bare => Engine {
+                memory_type: TypeId::of::<M>(),
+                instrumentation_type: TypeId::of::<I>(),
+                run_cycles: match arch_mode {
+                    CpuMode::RV32 => Cpu::run_cycles_bare::<M, 32, I>,
+                    CpuMode::RV64 => Cpu::run_cycles_bare::<M, 64, I>,
+                },
+                on_trap: record_trap::<I>,
+                on_mem_access: mem_access_hook::<I>(),
+                read_mem_u8: bare_read_mem_u8::<M, I>,
+                read_mem_u16: bare_read_mem_u16::<M, I>,
+                read_mem_u32: bare_read_mem_u32::<M, I>,
+                read_mem_u64: bare_read_mem_u64::<M, I>,
+                write_mem_u8: bare_write_mem_u8::<M, I>,
+                write_mem_u16: bare_write_mem_u16::<M, I>,
+                write_mem_u32: bare_write_mem_u32::<M, I>,
+                write_mem_u64: bare_write_mem_u64::<M, I>,
+            },
+            ExecutionMode::UserSpace => Engine {
+                memory_type: TypeId::of::<M>(),
+                instrumentation_type: TypeId::of::<I>(),
+                run_cycles: Cpu::run_cycles_userspace::<I>,
+                on_trap: record_trap::<I>,
+                on_mem_access: mem_access_hook::<I>(),
+                read_mem_u8: user_space_read_mem_u8::<M, I>,
+                read_mem_u16: user_space_read_mem_u16::<M, I>,
+                read_mem_u32: user_space_read_mem_u32::<M, I>,
+                read_mem_u64: user_space_read_mem_u64::<M, I>,
+                write_mem_u8: user_space_write_mem_u8::<M, I>,
+                write_mem_u16: user_space_write_mem_u16::<M, I>,
+                write_mem_u32: user_space_write_mem_u32::<M, I>,
+                write_mem_u64: user_space_write_mem_u64::<M, I>,
+            },
+        }
+    }
+}
@@ -0,0 +1,121 @@
+use anyhow::Result;
+
+use crate::{
+    elf::symbol_table::SymbolTable,
+    types::{decode_program_line, ABIRegister, Instruction, InstructionType, ProgramLine, Word},
+};
+
+use super::cpu_core::{Cpu, CpuMode, ExecutionMode};
+
+const COPY_CHUNK_SIZE: usize = 4096;
+// strlen reads whole aligned chunks like newlib reads whole words, guest memory regions
+// are aligned to at least this so the terminator's chunk is always mapped
+const SCAN_CHUNK_SIZE: usize = 256;
+
+type Operation = fn(&mut Cpu, &Word) -> Result<()>;
+
+const ROUTINES: [(&str, Operation); 3] = [
+    ("memcpy", host_memcpy),
+    ("memset", host_memset),
+    ("strlen", host_strlen),
+];
+
+// Runs libc string routines found in the ELF symbols as host bulk operations. The
+// first line of each routine is replaced in the userspace program cache, a call then
+// does the whole job and returns to ra. The memory written, a0 and the return match
+// the guest code. Caller-saved temporaries keep their values and the call retires as
+// a single instruction. The line keeps the original word, so cases the host does not
+// handle run the routine in the guest. Returns the names of the routines replaced.
+pub fn install_host_routines(cpu: &mut Cpu, symbols: &SymbolTable) -> Result<Vec<&'static str>> {
+    let mut installed = Vec::new();
+    if cpu.execution_mode != ExecutionMode::UserSpace {
+        return Ok(installed);
+    }
+    for (name, operation) in ROUTINES {
+        let Some(symbol) = symbols.find(name) else {
+            continue;
+        };
+        let word = Word(cpu.memory.read_mem_u32(symbol.addr)?);
+        let line = ProgramLine::new(
+            Instruction {
+                mask: u32::MAX,
+                bits: word.0,
+                name,
+                instruction_type: InstructionType::I,
+                operation,
+            },
+            word,
+        );
+        cpu.program_cache.replace_line(symbol.addr, line);
+        installed.push(name);
+    }
+    Ok(installed)
+}
+
+fn read_arg(cpu: &Cpu, register: ABIRegister) -> u64 {
+    let id = register.to_x_reg_id() as u8;
+    match cpu.arch_mode {
+        CpuMode::RV64 => cpu.read_x_u64(id),
+        CpuMode::RV32 => cpu.read_x_u32(id) as u64,
+    }
+}
+
+fn return_to_caller(cpu: &mut Cpu) {
+    let ra = read_arg(cpu, ABIRegister::RA);
+    cpu.write_pc_u64(ra);
+}
+
+// Executes the routine's first instruction, the guest code continues from there
+fn run_in_guest(cpu: &mut Cpu, word: &Word) -> Result<()> {
+    let line = decode_program_line(*word, cpu.arch_mode)?;
+    cpu.execute_program_line(&line)
+}
+
+fn host_memcpy(cpu: &mut Cpu, word: &Word) -> Result<()> {
+    let dst = read_arg(cpu, ABIRegister::A(0));
+    let src = read_arg(cpu, ABIRegister::A(1));
+    let len = read_arg(cpu, ABIRegister::A(2));
+    // Overlapping copies are undefined, whatever the guest code makes of them stays
+    if dst < src.wrapping_add(len) && src < dst.wrapping_add(len) {
+        return run_in_guest(cpu, word);
+    }
+    let mut chunk = [0; COPY_CHUNK_SIZE];
+    let mut done = 0;
+    while done < len {
+        let size = (len - done).min(COPY_CHUNK_SIZE as u64) as usize;
+        cpu.read_buf(src + done, &mut chunk[..size])?;
+        cpu.write_buf(dst + done, &chunk[..size])?;
+        done += size as u64;
+    }
+    return_to_caller(cpu);
+    Ok(())
+}
+
+fn host_memset(cpu: &mut Cpu, _word: &Word) -> Result<()> {
+    let dst = read_arg(cpu, ABIRegister::A(0));
+    let value = read_arg(cpu, ABIRegister::A(1)) as u8;
+    let len = read_arg(cpu, ABIRegister::A(2));
+    cpu.fill(dst, len, value)?;
+    return_to_caller(cpu);
+    Ok(())
+}
+
+fn host_strlen(cpu: &mut Cpu, _word: &Word) -> Result<()> {
+    let start = read_arg(cpu, ABIRegister::A(0));
+    let mut chunk = [0; SCAN_CHUNK_SIZE];
+    let mut addr = start;
+    let len = loop {
+        let size = SCAN_CHUNK_SIZE - (addr as usize & (SCAN_CHUNK_SIZE - 1));
+        cpu.read_buf(addr, &mut chunk[..size])?;
+        if let Some(end) = chunk[..size].iter().position(|&byte| byte == 0) {
+            break addr + end as u64 - start;
+        }
+        addr += size as u64;
+    };
+    match cpu.arch_mode {
+        CpuMode::RV64 => cpu.write_x_u64(ABIRegister::A(0).to_x_reg_id() as u8, len),
+        CpuMode::RV32 => cpu.write_x_u32(ABIRegister::A(0).to_x_reg_id() as u8, len as u32),
+    }
+    return_to_caller(cpu);
+    Ok(())
+}
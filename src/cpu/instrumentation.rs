@@ -0,0 +1,284 @@
+use std::any::Any;
+
+use crate::types::{ABIRegister, ProgramLine, Word};
+
+use super::cpu_core::Cpu;
+
+#[derive(Clone, Copy, PartialEq, Eq, Debug)]
+pub enum MemAccessKind {
+    Read,
+    Write,
+}
+
+#[derive(Clone, Copy, PartialEq, Eq, Debug)]
+pub enum BranchKind {
+    Conditional,
+    // JAL
+    Jump,
+    // JALR
+    Indirect,
+}
+
+// Hooks called from the run loop and the memory accessors. The engine is
+// monomorphized for the implementation, so empty hooks compile away and
+// `ENABLED = false` also removes the work done to compute their arguments.
+// Addresses are guest virtual addresses.
+pub trait Instrumentation: Any {
+    const ENABLED: bool = true;
+    // Implementations leaving a hook empty can turn it off, which skips computing its
+    // arguments
+    const REGISTER_WRITES: bool = true;
+    const MEM_ACCESSES: bool = true;
+    const BRANCHES: bool = true;
+    const SYSCALLS: bool = true;
+
+    // Before the instruction executes
+    #[inline(always)]
+    fn on_fetch(&mut self, _pc: u64, _line: &ProgramLine) {}
+
+    // After the instruction retired, `next_pc` is where execution continues.
+    // Called after the other hooks of the instruction.
+    #[inline(always)]
+    fn on_retire(&mut self, _pc: u64, _line: &ProgramLine, _next_pc: u64) {}
+
+    // Integer register written by the instruction
+    #[inline(always)]
+    fn on_register_write(&mut self, _pc: u64, _reg: u8, _value: u64) {}
+
+    #[inline(always)]
+    fn on_mem_access(&mut self, _addr: u64, _size: u8, _kind: MemAccessKind) {}
+
+    // Jumps are always taken, `target` of a not-taken branch is the branch target
+    #[inline(always)]
+    fn on_branch(&mut self, _pc: u64, _kind: BranchKind, _target: u64, _taken: bool) {}
+
+    #[inline(always)]
+    fn on_trap(&mut self, _pc: u64, _cause: u64, _interrupt: bool) {}
+
+    // User space ECALLs handled by the emulated kernel, `number` is a7
+    #[inline(always)]
+    fn on_syscall(&mut self, _pc: u64, _number: u64) {}
+}
+
+pub struct NoInstrumentation;
+
+impl Instrumentation for NoInstrumentation {
+    const ENABLED: bool = false;
+}
+
+// Disabled hooks cost one check per event
+impl<T: Instrumentation> Instrumentation for Option<T> {
+    const ENABLED: bool = T::ENABLED;
+    const REGISTER_WRITES: bool = T::REGISTER_WRITES;
+    const MEM_ACCESSES: bool = T::MEM_ACCESSES;
+    const BRANCHES: bool = T::BRANCHES;
+    const SYSCALLS: bool = T::SYSCALLS;
+
+    #[inline(always)]
+    fn on_fetch(&mut self, pc: u64, line: &ProgramLine) {
+        if let Some(inner) = self {
+            inner.on_fetch(pc, line);
+        }
+    }
+
+    #[inline(always)]
+    fn on_retire(&mut self, pc: u64, line: &ProgramLine, next_pc: u64) {
+        if let Some(inner) = self {
+            inner.on_retire(pc, line, next_pc);
+        }
+    }
+
+    #[inline(always)]
+    fn on_register_write(&mut self, pc: u64, reg: u8, value: u64) {
+        if let Some(inner) = self {
+            inner.on_register_write(pc, reg, value);
+        }
+    }
+
+    #[inline(always)]
+    fn on_mem_access(&mut self, addr: u64, size: u8, kind: MemAccessKind) {
+        if let Some(inner) = self {
+            inner.on_mem_access(addr, size, kind);
+        }
+    }
+
+    #[inline(always)]
+    fn on_branch(&mut self, pc: u64, kind: BranchKind, target: u64, taken: bool) {
+        if let Some(inner) = self {
+            inner.on_branch(pc, kind, target, taken);
+        }
+    }
+
+    #[inline(always)]
+    fn on_trap(&mut self, pc: u64, cause: u64, interrupt: bool) {
+        if let Some(inner) = self {
+            inner.on_trap(pc, cause, interrupt);
+        }
+    }
+
+    #[inline(always)]
+    fn on_syscall(&mut self, pc: u64, number: u64) {
+        if let Some(inner) = self {
+            inner.on_syscall(pc, number);
+        }
+    }
+}
+
+macro_rules! impl_instrumentation_tuple {
+    ($($name:ident $index:tt),+) => {
+        impl<$($name: Instrumentation),+> Instrumentation for ($($name,)+) {
+            const ENABLED: bool = $($name::ENABLED)||+;
+            const REGISTER_WRITES: bool = $($name::ENABLED && $name::REGISTER_WRITES)||+;
+            const MEM_ACCESSES: bool = $($name::ENABLED && $name::MEM_ACCESSES)||+;
+            const BRANCHES: bool = $($name::ENABLED && $name::BRANCHES)||+;
+            const SYSCALLS: bool = $($name::ENABLED && $name::SYSCALLS)||+;
+
+            #[inline(always)]
+            fn on_fetch(&mut self, pc: u64, line: &ProgramLine) {
+                $(self.$index.on_fetch(pc, line);)+
+            }
+
+            #[inline(always)]
+            fn on_retire(&mut self, pc: u64, line: &ProgramLine, next_pc: u64) {
+                $(self.$index.on_retire(pc, line, next_pc);)+
+            }
+
+            #[inline(always)]
+            fn on_register_write(&mut self, pc: u64, reg: u8, value: u64) {
+                $(self.$index.on_register_write(pc, reg, value);)+
+            }
+
+            #[inline(always)]
+            fn on_mem_access(&mut self, addr: u64, size: u8, kind: MemAccessKind) {
+                $(self.$index.on_mem_access(addr, size, kind);)+
+            }
+
+            #[inline(always)]
+            fn on_branch(&mut self, pc: u64, kind: BranchKind, target: u64, taken: bool) {
+                $(self.$index.on_branch(pc, kind, target, taken);)+
+            }
+
+            #[inline(always)]
+            fn on_trap(&mut self, pc: u64, cause: u64, interrupt: bool) {
+                $(self.$index.on_trap(pc, cause, interrupt);)+
+            }
+
+            #[inline(always)]
+            fn on_syscall(&mut self, pc: u64, number: u64) {
+                $(self.$index.on_syscall(pc, number);)+
+            }
+        }
+    };
+}
+
+impl_instrumentation_tuple!(A 0, B 1);
+impl_instrumentation_tuple!(A 0, B 1, C 2);
+impl_instrumentation_tuple!(A 0, B 1, C 2, D 3);
+
+const OPCODE_MASK: u32 = 0x7F;
+const OPCODE_LOAD: u32 = 0x03;
+const OPCODE_OP_IMM: u32 = 0x13;
+const OPCODE_AUIPC: u32 = 0x17;
+const OPCODE_OP_IMM_32: u32 = 0x1B;
+const OPCODE_AMO: u32 = 0x2F;
+const OPCODE_OP: u32 = 0x33;
+const OPCODE_LUI: u32 = 0x37;
+const OPCODE_OP_32: u32 = 0x3B;
+const OPCODE_OP_FP: u32 = 0x53;
+const OPCODE_BRANCH: u32 = 0x63;
+const OPCODE_JALR: u32 = 0x67;
+const OPCODE_JAL: u32 = 0x6F;
+const OPCODE_SYSTEM: u32 = 0x73;
+const ECALL: u32 = 0x00000073;
+
+#[inline(always)]
+pub fn branch_kind(word: Word) -> Option<BranchKind> {
+    match word.0 & OPCODE_MASK {
+        OPCODE_BRANCH => Some(BranchKind::Conditional),
+        OPCODE_JAL => Some(BranchKind::Jump),
+        OPCODE_JALR => Some(BranchKind::Indirect),
+        _ => None,
+    }
+}
+
+// Integer register written by the instruction, if any
+#[inline(always)]
+pub fn integer_destination(word: Word) -> Option<u8> {
+    let rd = ((word.0 >> 7) & 0x1F) as u8;
+    let writes_rd = match word.0 & OPCODE_MASK {
+        OPCODE_LOAD | OPCODE_OP_IMM | OPCODE_AUIPC | OPCODE_OP_IMM_32 | OPCODE_AMO | OPCODE_OP
+        | OPCODE_LUI | OPCODE_OP_32 | OPCODE_JALR | OPCODE_JAL | OPCODE_SYSTEM => true,
+        // Comparisons, FCVT to integer, FMV.X and FCLASS
+        OPCODE_OP_FP => matches!(word.0 >> 27, 0x14 | 0x18 | 0x1C),
+        _ => false,
+    };
+    (writes_rd && rd != 0).then_some(rd)
+}
+
+fn branch_target(pc: u64, word: Word) -> u64 {
+    let word = word.0;
+    let imm = ((word >> 31) & 0x1) << 12
+        | ((word >> 7) & 0x1) << 11
+        | ((word >> 25) & 0x3F) << 5
+        | ((word >> 8) & 0xF) << 1;
+    // Sign-extend the 13-bit immediate
+    pc.wrapping_add(((imm << 19) as i32 >> 19) as i64 as u64)
+}
+
+// Called by the run loop after an instruction retired
+#[inline(always)]
+pub(crate) fn after_retire<I: Instrumentation>(cpu: &mut Cpu, pc: u64, line: &ProgramLine) {
+    if !I::ENABLED {
+        return;
+    }
+    let next_pc = cpu.read_pc_u64();
+    let writeback = match line.rd {
+        Some(rd) if I::REGISTER_WRITES => Some((rd, cpu.read_x_u64(rd))),
+        _ => None,
+    };
+    let hooks = cpu.instrumentation_as::<I>();
+    if let Some((rd, value)) = writeback {
+        hooks.on_register_write(pc, rd, value);
+    }
+    if I::BRANCHES {
+        match line.branch {
+            Some(BranchKind::Conditional) => hooks.on_branch(
+                pc,
+                BranchKind::Conditional,
+                branch_target(pc, line.word),
+                next_pc != pc + 4,
+            ),
+            Some(kind) => hooks.on_branch(pc, kind, next_pc, true),
+            None => {}
+        }
+    }
+    hooks.on_retire(pc, line, next_pc);
+}
+
+#[inline(always)]
+pub(crate) fn before_syscall<I: Instrumentation>(cpu: &mut Cpu, pc: u64, line: &ProgramLine) {
+    if I::ENABLED && I::SYSCALLS && line.word.0 == ECALL {
+        let number = cpu.read_x_u64(ABIRegister::A(7).to_x_reg_id() as u8);
+        cpu.instrumentation_as::<I>().on_syscall(pc, number);
+    }
+}
+
+#[inline(always)]
+pub(crate) fn record_mem_access<I: Instrumentation>(
+    cpu: &mut Cpu,
+    addr: u64,
+    size: u8,
+    kind: MemAccessKind,
+) {
+    if I::ENABLED && I::MEM_ACCESSES {
+        cpu.instrumentation_as::<I>()
+            .on_mem_access(addr, size, kind);
+    }
+}
+
+// Stored in the engine, traps are raised from code that is not generic over the hooks
+pub(crate) fn record_trap<I: Instrumentation>(cpu: &mut Cpu, pc: u64, cause: u64, interrupt: bool) {
+    if I::ENABLED {
+        cpu.instrumentation_as::<I>().on_trap(pc, cause, interrupt);
+    }
+}
@@ -0,0 +1,53 @@
+pub const DIRTY_PAGE_SHIFT: u64 = 12;
+pub const DIRTY_PAGE_SIZE: u64 = 1 << DIRTY_PAGE_SHIFT;
+
+// One bit per 4 KiB of guest memory starting at `base`, set by the backend's
+// writes. Offsets passed in are relative to `base`.
+#[derive(Clone, Debug)]
+pub struct DirtyBitmap {
+    base: u64,
+    words: Vec<u64>,
+}
+
+impl DirtyBitmap {
+    pub fn new(base: u64, size: u64) -> Self {
+        let pages = size.div_ceil(DIRTY_PAGE_SIZE);
+        Self {
+            base,
+            words: vec![0; pages.div_ceil(64) as usize],
+        }
+    }
+
+    #[inline(always)]
+    fn set(&mut self, page: u64) {
+        self.words[(page / 64) as usize] |= 1 << (page % 64);
+    }
+
+    // Accesses of up to 8 bytes touch at most two pages
+    #[inline(always)]
+    pub fn mark(&mut self, offset: u64, size: u64) {
+        self.set(offset >> DIRTY_PAGE_SHIFT);
+        self.set((offset + size - 1) >> DIRTY_PAGE_SHIFT);
+    }
+
+    pub fn mark_range(&mut self, offset: u64, len: u64) {
+        if len == 0 {
+            return;
+        }
+        for page in (offset >> DIRTY_PAGE_SHIFT)..=((offset + len - 1) >> DIRTY_PAGE_SHIFT) {
+            self.set(page);
+        }
+    }
+
+    // Guest addresses of the dirty pages in ascending order, clearing them in the same pass
+    pub fn take(&mut self, pages: &mut Vec<u64>) {
+        for (i, word) in self.words.iter_mut().enumerate() {
+            let mut bits = std::mem::take(word);
+            while bits != 0 {
+                let page = i as u64 * 64 + bits.trailing_zeros() as u64;
+                pages.push(self.base + (page << DIRTY_PAGE_SHIFT));
+                bits &= bits - 1;
+            }
+        }
+    }
+}
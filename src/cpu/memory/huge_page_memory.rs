@@ -0,0 +1,239 @@
+use std::{ffi::c_void, num::NonZeroUsize, ptr::NonNull};
+
+#[cfg(not(feature = "maxperf"))]
+use anyhow::bail;
+use anyhow::Result;
+#[cfg(target_os = "linux")]
+use nix::sys::mman::{madvise, MmapAdvise};
+use nix::sys::mman::{mmap_anonymous, munmap, MapFlags, ProtFlags};
+
+use crate::cpu::cpu_core::{KERNEL_ADDR, KERNEL_SIZE};
+
+use super::{dirty_bitmap::DirtyBitmap, memory_core::Memory, mmu::MMU_PAGE_SIZE};
+
+pub const HUGE_PAGE_SIZE: usize = 2 * 1024 * 1024;
+
+#[cfg(target_os = "linux")]
+const MAP_NORESERVE: MapFlags = MapFlags::MAP_NORESERVE;
+#[cfg(not(target_os = "linux"))]
+const MAP_NORESERVE: MapFlags = MapFlags::empty();
+
+#[derive(clap::ValueEnum, Clone, Copy, Debug, PartialEq, Eq)]
+pub enum HugePages {
+    // Regular 4 KiB pages
+    None,
+    // madvise(MADV_HUGEPAGE), khugepaged may also collapse the range later
+    Transparent,
+    // MAP_HUGETLB from the hugetlbfs pool, see /proc/sys/vm/nr_hugepages
+    Explicit,
+}
+
+// Guest RAM in an anonymous mapping backed by 2 MiB pages where the host allows,
+// so random guest accesses don't thrash the host dTLB. Falls back from explicit
+// to transparent to regular pages, `huge_pages` is what was actually set up.
+// Both kinds of huge pages are Linux only, other hosts get regular pages.
+#[derive(Debug)]
+pub struct HugePageMemory {
+    data: NonNull<u8>,
+    len: usize,
+    addr: u64,
+    mapping: NonNull<c_void>,
+    mapping_len: usize,
+    huge_pages: HugePages,
+    dirty: DirtyBitmap,
+}
+
+impl HugePageMemory {
+    pub fn new(addr: u64, size: u64, huge_pages: HugePages) -> Self {
+        let len = (size as usize).next_multiple_of(HUGE_PAGE_SIZE);
+        let length = NonZeroUsize::new(len).expect("Memory size must be non-zero");
+        let prot = ProtFlags::PROT_READ | ProtFlags::PROT_WRITE;
+
+        if huge_pages == HugePages::Explicit {
+            if let Some(mapping) = map_hugetlb(length, prot) {
+                return Self::from_mapping(mapping, len, mapping, len, addr, HugePages::Explicit);
+            }
+        }
+
+        // Over-allocate so the range can start on a huge page boundary
+        let mapping_len = len + HUGE_PAGE_SIZE;
+        let mapping = unsafe {
+            mmap_anonymous(
+                None,
+                NonZeroUsize::new(mapping_len).unwrap(),
+                prot,
+                MapFlags::MAP_PRIVATE | MapFlags::MAP_ANONYMOUS | MAP_NORESERVE,
+            )
+        }
+        .expect("Failed to map guest memory");
+        let offset = (mapping.as_ptr() as usize).next_multiple_of(HUGE_PAGE_SIZE)
+            - mapping.as_ptr() as usize;
+        let data = unsafe { mapping.byte_add(offset) };
+
+        let huge_pages = match huge_pages {
+            HugePages::None => HugePages::None,
+            _ => advise_huge_pages(data, len),
+        };
+        Self::from_mapping(data, len, mapping, mapping_len, addr, huge_pages)
+    }
+
+    fn from_mapping(
+        data: NonNull<c_void>,
+        len: usize,
+        mapping: NonNull<c_void>,
+        mapping_len: usize,
+        addr: u64,
+        huge_pages: HugePages,
+    ) -> Self {
+        Self {
+            data: data.cast(),
+            len,
+            addr,
+            mapping,
+            mapping_len,
+            huge_pages,
+            dirty: DirtyBitmap::new(addr, len as u64),
+        }
+    }
+
+    pub fn huge_pages(&self) -> HugePages {
+        self.huge_pages
+    }
+
+    #[cfg(not(feature = "maxperf"))]
+    fn check_bounds(&self, addr: u64, size: u64) -> Result<()> {
+        if addr + size > self.len as u64 {
+            bail!("Out of bounds memory access at {}", addr);
+        } else {
+            Ok(())
+        }
+    }
+
+    #[inline(always)]
+    fn host_ptr(&self, addr: u64, _size: u64) -> Result<*mut u8> {
+        let offset = addr - self.addr;
+        #[cfg(not(feature = "maxperf"))]
+        self.check_bounds(offset, _size)?;
+        Ok(unsafe { self.data.as_ptr().add(offset as usize) })
+    }
+
+    #[inline(always)]
+    fn host_ptr_mut(&mut self, addr: u64, size: u64) -> Result<*mut u8> {
+        let ptr = self.host_ptr(addr, size)?;
+        self.dirty.mark(addr - self.addr, size);
+        Ok(ptr)
+    }
+}
+
+#[cfg(target_os = "linux")]
+fn map_hugetlb(length: NonZeroUsize, prot: ProtFlags) -> Option<NonNull<c_void>> {
+    let flags = MapFlags::MAP_PRIVATE
+        | MapFlags::MAP_ANONYMOUS
+        | MapFlags::MAP_HUGETLB
+        | MapFlags::MAP_HUGE_2MB;
+    unsafe { mmap_anonymous(None, length, prot, flags) }.ok()
+}
+
+#[cfg(not(target_os = "linux"))]
+fn map_hugetlb(_length: NonZeroUsize, _prot: ProtFlags) -> Option<NonNull<c_void>> {
+    None
+}
+
+#[cfg(target_os = "linux")]
+fn advise_huge_pages(data: NonNull<c_void>, len: usize) -> HugePages {
+    match unsafe { madvise(data, len, MmapAdvise::MADV_HUGEPAGE) } {
+        Ok(()) => HugePages::Transparent,
+        Err(_) => HugePages::None,
+    }
+}
+
+#[cfg(not(target_os = "linux"))]
+fn advise_huge_pages(_data: NonNull<c_void>, _len: usize) -> HugePages {
+    HugePages::None
+}
+
+impl Default for HugePageMemory {
+    fn default() -> Self {
+        Self::new(KERNEL_ADDR, KERNEL_SIZE, HugePages::Transparent)
+    }
+}
+
+impl Drop for HugePageMemory {
+    fn drop(&mut self) {
+        unsafe {
+            let _ = munmap(self.mapping, self.mapping_len);
+        }
+    }
+}
+
+impl Memory for HugePageMemory {
+    fn read_mem_u8(&mut self, addr: u64) -> Result<u8> {
+        unsafe { Ok(*self.host_ptr(addr, 1)?) }
+    }
+
+    fn read_mem_u16(&mut self, addr: u64) -> Result<u16> {
+        unsafe { Ok((self.host_ptr(addr, 2)? as *const u16).read_unaligned()) }
+    }
+
+    fn read_mem_u32(&mut self, addr: u64) -> Result<u32> {
+        unsafe { Ok((self.host_ptr(addr, 4)? as *const u32).read_unaligned()) }
+    }
+
+    fn read_mem_u64(&mut self, addr: u64) -> Result<u64> {
+        unsafe { Ok((self.host_ptr(addr, 8)? as *const u64).read_unaligned()) }
+    }
+
+    fn write_mem_u8(&mut self, addr: u64, value: u8) -> Result<()> {
+        unsafe { self.host_ptr_mut(addr, 1)?.write(value) };
+        Ok(())
+    }
+
+    fn write_mem_u16(&mut self, addr: u64, value: u16) -> Result<()> {
+        unsafe { (self.host_ptr_mut(addr, 2)? as *mut u16).write_unaligned(value) };
+        Ok(())
+    }
+
+    fn write_mem_u32(&mut self, addr: u64, value: u32) -> Result<()> {
+        unsafe { (self.host_ptr_mut(addr, 4)? as *mut u32).write_unaligned(value) };
+        Ok(())
+    }
+
+    fn write_mem_u64(&mut self, addr: u64, value: u64) -> Result<()> {
+        unsafe { (self.host_ptr_mut(addr, 8)? as *mut u64).write_unaligned(value) };
+        Ok(())
+    }
+
+    fn read_buf(&mut self, addr: u64, buf: &mut [u8]) -> Result<()> {
+        let src = self.host_ptr(addr, buf.len() as u64)?;
+        unsafe { std::ptr::copy_nonoverlapping(src, buf.as_mut_ptr(), buf.len()) };
+        Ok(())
+    }
+
+    fn write_buf(&mut self, addr: u64, buf: &[u8]) -> Result<()> {
+        let dst = self.host_ptr(addr, buf.len() as u64)?;
+        self.dirty.mark_range(addr - self.addr, buf.len() as u64);
+        unsafe { std::ptr::copy_nonoverlapping(buf.as_ptr(), dst, buf.len()) };
+        Ok(())
+    }
+
+    fn fill(&mut self, addr: u64, len: u64, value: u8) -> Result<()> {
+        let dst = self.host_ptr(addr, len)?;
+        self.dirty.mark_range(addr - self.addr, len);
+        unsafe { std::ptr::write_bytes(dst, value, len as usize) };
+        Ok(())
+    }
+
+    fn host_page(&mut self, addr: u64) -> Option<*mut u8> {
+        let page = (addr & !(MMU_PAGE_SIZE as u64 - 1)).checked_sub(self.addr)?;
+        if page + MMU_PAGE_SIZE as u64 > self.len as u64 {
+            return None;
+        }
+        Some(unsafe { self.data.as_ptr().add(page as usize) })
+    }
+
+    fn take_dirty_pages(&mut self) -> Option<Vec<u64>> {
+        let mut pages = Vec::new();
+        self.dirty.take(&mut pages);
+        Some(pages)
+    }
+}
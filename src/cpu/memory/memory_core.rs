@@ -1,5 +1,3 @@
-pub const MEMORY_SIZE: u64 = 0x100000;
-pub const MEMORY_CAPACITY: usize = 48;
 use std::fmt::Debug;
 
 use anyhow::Result;
@@ -15,4 +13,28 @@ pub trait Memory: Debug {
     fn write_mem_u64(&mut self, addr: u64, value: u64) -> Result<()>;
     fn read_buf(&mut self, addr: u64, buf: &mut [u8]) -> Result<()>;
     fn write_buf(&mut self, addr: u64, buf: &[u8]) -> Result<()>;
+
+    fn fill(&mut self, addr: u64, len: u64, value: u8) -> Result<()> {
+        const CHUNK_SIZE: u64 = 4096;
+        let chunk = [value; CHUNK_SIZE as usize];
+        let mut offset = 0;
+        while offset < len {
+            let size = (len - offset).min(CHUNK_SIZE);
+            self.write_buf(addr + offset, &chunk[..size as usize])?;
+            offset += size;
+        }
+        Ok(())
+    }
+
+    // Host address of the 4 KiB page holding `addr` when the whole page is plain host
+    // memory that never moves, see `TranslationCache`
+    fn host_page(&mut self, _addr: u64) -> Option<*mut u8> {
+        None
+    }
+
+    // Guest addresses of the 4 KiB pages written since the previous call, which
+    // clears them. None when the backend doesn't track dirty pages.
+    fn take_dirty_pages(&mut self) -> Option<Vec<u64>> {
+        None
+    }
 }
@@ -1,14 +1,17 @@
 pub mod btree_memory;
+pub mod dirty_bitmap;
 pub mod hashmap_memory;
+pub mod huge_page_memory;
 pub mod memory_core;
 pub mod mmu;
-pub mod page_storage;
+pub mod paged_memory;
 pub mod program_cache;
 pub mod raw_memory;
-pub mod raw_page_storage;
 pub mod raw_table_memory;
 pub mod raw_vec_memory;
 pub mod table_memory;
+pub mod translation_cache;
+pub mod unaligned;
 pub mod user_memory;
 pub mod vec_binsearch_memory;
 pub mod vec_memory;
@@ -0,0 +1,367 @@
+use std::{
+    collections::BTreeMap,
+    fmt::{Debug, Formatter},
+};
+
+use anyhow::Result;
+use rustc_hash::FxHashMap;
+
+use super::{
+    dirty_bitmap::DirtyBitmap,
+    memory_core::Memory,
+    mmu::MMU_PAGE_SIZE,
+    unaligned::{fits_in_page, read_split, write_split},
+};
+
+// Page size of the named backends, 16 MiB
+pub(crate) const PAGE_SIZE_LOG2: u32 = 24;
+pub const PAGE_SIZE: u64 = 1 << PAGE_SIZE_LOG2;
+
+// Maps guest page numbers to slots in `PagedMemory::pages`
+pub trait PageIndex {
+    // `page_number_bits` is how wide the page numbers passed in can be
+    fn new(page_number_bits: u32) -> Self;
+    fn get(&self, page_number: u64) -> Option<usize>;
+    fn insert(&mut self, page_number: u64, slot: usize);
+}
+
+const RADIX_BITS: u32 = 10;
+const RADIX_FANOUT: usize = 1 << RADIX_BITS;
+
+// Multi-level table with RADIX_BITS of the page number per level, lookups cost one
+// dependent load per level regardless of how many pages exist
+#[derive(Clone)]
+pub struct RadixIndex {
+    levels: u32,
+    // Node 0 is the root. Entries hold the child node, on the last level the slot + 1
+    nodes: Vec<Box<[u32; RADIX_FANOUT]>>,
+}
+
+impl RadixIndex {
+    #[inline(always)]
+    fn entry(page_number: u64, level: u32) -> usize {
+        (page_number >> (level * RADIX_BITS)) as usize & (RADIX_FANOUT - 1)
+    }
+}
+
+impl PageIndex for RadixIndex {
+    fn new(page_number_bits: u32) -> Self {
+        RadixIndex {
+            levels: page_number_bits.div_ceil(RADIX_BITS),
+            nodes: vec![Box::new([0; RADIX_FANOUT])],
+        }
+    }
+
+    #[inline(always)]
+    fn get(&self, page_number: u64) -> Option<usize> {
+        let mut node = 0;
+        for level in (1..self.levels).rev() {
+            match unsafe { self.nodes.get_unchecked(node) }[Self::entry(page_number, level)] {
+                0 => return None,
+                child => node = child as usize,
+            }
+        }
+        match unsafe { self.nodes.get_unchecked(node) }[Self::entry(page_number, 0)] {
+            0 => None,
+            slot => Some(slot as usize - 1),
+        }
+    }
+
+    fn insert(&mut self, page_number: u64, slot: usize) {
+        let mut node = 0;
+        for level in (1..self.levels).rev() {
+            let entry = Self::entry(page_number, level);
+            if self.nodes[node][entry] == 0 {
+                self.nodes[node][entry] = self.nodes.len() as u32;
+                self.nodes.push(Box::new([0; RADIX_FANOUT]));
+            }
+            node = self.nodes[node][entry] as usize;
+        }
+        self.nodes[node][Self::entry(page_number, 0)] = slot as u32 + 1;
+    }
+}
+
+#[derive(Clone)]
+pub struct HashIndex {
+    slots: FxHashMap<u64, usize>,
+}
+
+impl PageIndex for HashIndex {
+    fn new(_page_number_bits: u32) -> Self {
+        HashIndex {
+            slots: FxHashMap::default(),
+        }
+    }
+
+    #[inline(always)]
+    fn get(&self, page_number: u64) -> Option<usize> {
+        self.slots.get(&page_number).copied()
+    }
+
+    fn insert(&mut self, page_number: u64, slot: usize) {
+        self.slots.insert(page_number, slot);
+    }
+}
+
+// Compact and cache friendly for the handful of pages a program touches with large pages
+#[derive(Clone)]
+pub struct SortedVecIndex {
+    slots: Vec<(u64, usize)>,
+}
+
+impl PageIndex for SortedVecIndex {
+    fn new(_page_number_bits: u32) -> Self {
+        SortedVecIndex { slots: Vec::new() }
+    }
+
+    #[inline(always)]
+    fn get(&self, page_number: u64) -> Option<usize> {
+        self.slots
+            .binary_search_by_key(&page_number, |&(page, _)| page)
+            .ok()
+            .map(|i| unsafe { self.slots.get_unchecked(i) }.1)
+    }
+
+    fn insert(&mut self, page_number: u64, slot: usize) {
+        let i = self.slots.partition_point(|&(page, _)| page < page_number);
+        self.slots.insert(i, (page_number, slot));
+    }
+}
+
+#[derive(Clone)]
+pub struct BTreeIndex {
+    slots: BTreeMap<u64, usize>,
+}
+
+impl PageIndex for BTreeIndex {
+    fn new(_page_number_bits: u32) -> Self {
+        BTreeIndex {
+            slots: BTreeMap::new(),
+        }
+    }
+
+    #[inline(always)]
+    fn get(&self, page_number: u64) -> Option<usize> {
+        self.slots.get(&page_number).copied()
+    }
+
+    fn insert(&mut self, page_number: u64, slot: usize) {
+        self.slots.insert(page_number, slot);
+    }
+}
+
+// Scanned in allocation order, slots are the positions in the vec
+#[derive(Clone)]
+pub struct LinearIndex {
+    pages: Vec<u64>,
+}
+
+impl PageIndex for LinearIndex {
+    fn new(_page_number_bits: u32) -> Self {
+        LinearIndex { pages: Vec::new() }
+    }
+
+    #[inline(always)]
+    fn get(&self, page_number: u64) -> Option<usize> {
+        self.pages.iter().position(|&page| page == page_number)
+    }
+
+    fn insert(&mut self, page_number: u64, slot: usize) {
+        debug_assert_eq!(slot, self.pages.len());
+        self.pages.push(page_number);
+    }
+}
+
+#[derive(Clone)]
+struct Page {
+    data: Box<[u8]>,
+    dirty: DirtyBitmap,
+}
+
+// Sparse little-endian guest memory allocated in pages of 2^PAGE_SHIFT bytes on first
+// write, missing pages read as zero. The index structure `X` only maps page numbers to
+// slots, the last page used is remembered so runs of accesses to one page skip it.
+#[derive(Clone)]
+pub struct PagedMemory<X: PageIndex, const PAGE_SHIFT: u32> {
+    index: X,
+    pages: Vec<Page>,
+    last_page_number: u64,
+    last_slot: usize,
+}
+
+impl<X: PageIndex, const PAGE_SHIFT: u32> Debug for PagedMemory<X, PAGE_SHIFT> {
+    fn fmt(&self, f: &mut Formatter<'_>) -> std::fmt::Result {
+        write!(f, "Memory {{ pages: {} }}", self.pages.len())
+    }
+}
+
+impl<X: PageIndex, const PAGE_SHIFT: u32> Default for PagedMemory<X, PAGE_SHIFT> {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl<X: PageIndex, const PAGE_SHIFT: u32> PagedMemory<X, PAGE_SHIFT> {
+    pub const PAGE_SIZE: usize = 1 << PAGE_SHIFT;
+    const PAGE_MASK: u64 = (1 << PAGE_SHIFT) - 1;
+
+    pub fn new() -> Self {
+        // Pages must hold whole dirty tracking and MMU pages
+        const { assert!(PAGE_SHIFT >= 12 && PAGE_SHIFT < 32) };
+        PagedMemory {
+            index: X::new(64 - PAGE_SHIFT),
+            pages: Vec::new(),
+            // Page numbers are at most 52 bits wide
+            last_page_number: u64::MAX,
+            last_slot: 0,
+        }
+    }
+
+    #[inline(always)]
+    fn slot(&mut self, page_number: u64) -> Option<usize> {
+        if page_number == self.last_page_number {
+            return Some(self.last_slot);
+        }
+        let slot = self.index.get(page_number)?;
+        self.last_page_number = page_number;
+        self.last_slot = slot;
+        Some(slot)
+    }
+
+    #[inline(always)]
+    fn slot_or_create(&mut self, page_number: u64) -> usize {
+        match self.slot(page_number) {
+            Some(slot) => slot,
+            None => self.create_page(page_number),
+        }
+    }
+
+    #[cold]
+    fn create_page(&mut self, page_number: u64) -> usize {
+        let slot = self.pages.len();
+        self.pages.push(Page {
+            data: unsafe { Box::new_zeroed_slice(Self::PAGE_SIZE).assume_init() },
+            dirty: DirtyBitmap::new(page_number << PAGE_SHIFT, Self::PAGE_SIZE as u64),
+        });
+        self.index.insert(page_number, slot);
+        self.last_page_number = page_number;
+        self.last_slot = slot;
+        slot
+    }
+
+    #[inline(always)]
+    fn read<const N: usize>(&mut self, addr: u64) -> Result<[u8; N]> {
+        let mut bytes = [0; N];
+        if !fits_in_page(addr, N as u64, Self::PAGE_SIZE as u64) {
+            read_split(self, addr, &mut bytes)?;
+        } else if let Some(slot) = self.slot(addr >> PAGE_SHIFT) {
+            let offset = (addr & Self::PAGE_MASK) as usize;
+            bytes = unsafe {
+                let page = self.pages.get_unchecked(slot);
+                (page.data.as_ptr().add(offset) as *const [u8; N]).read_unaligned()
+            };
+        }
+        Ok(bytes)
+    }
+
+    #[inline(always)]
+    fn write<const N: usize>(&mut self, addr: u64, bytes: [u8; N]) -> Result<()> {
+        if !fits_in_page(addr, N as u64, Self::PAGE_SIZE as u64) {
+            return write_split(self, addr, &bytes);
+        }
+        let offset = (addr & Self::PAGE_MASK) as usize;
+        let slot = self.slot_or_create(addr >> PAGE_SHIFT);
+        unsafe {
+            let page = self.pages.get_unchecked_mut(slot);
+            page.dirty.mark(offset as u64, N as u64);
+            (page.data.as_mut_ptr().add(offset) as *mut [u8; N]).write_unaligned(bytes);
+        }
+        Ok(())
+    }
+}
+
+impl<X: PageIndex, const PAGE_SHIFT: u32> Memory for PagedMemory<X, PAGE_SHIFT> {
+    fn read_mem_u8(&mut self, addr: u64) -> Result<u8> {
+        Ok(self.read::<1>(addr)?[0])
+    }
+
+    fn read_mem_u16(&mut self, addr: u64) -> Result<u16> {
+        Ok(u16::from_le_bytes(self.read(addr)?))
+    }
+
+    fn read_mem_u32(&mut self, addr: u64) -> Result<u32> {
+        Ok(u32::from_le_bytes(self.read(addr)?))
+    }
+
+    fn read_mem_u64(&mut self, addr: u64) -> Result<u64> {
+        Ok(u64::from_le_bytes(self.read(addr)?))
+    }
+
+    fn write_mem_u8(&mut self, addr: u64, value: u8) -> Result<()> {
+        self.write(addr, [value])
+    }
+
+    fn write_mem_u16(&mut self, addr: u64, value: u16) -> Result<()> {
+        self.write(addr, value.to_le_bytes())
+    }
+
+    fn write_mem_u32(&mut self, addr: u64, value: u32) -> Result<()> {
+        self.write(addr, value.to_le_bytes())
+    }
+
+    fn write_mem_u64(&mut self, addr: u64, value: u64) -> Result<()> {
+        self.write(addr, value.to_le_bytes())
+    }
+
+    fn read_buf(&mut self, addr: u64, buf: &mut [u8]) -> Result<()> {
+        // Copy page by page, missing pages read as zero
+        let mut done = 0;
+        while done < buf.len() {
+            let current = addr + done as u64;
+            let offset = (current & Self::PAGE_MASK) as usize;
+            let size = (buf.len() - done).min(Self::PAGE_SIZE - offset);
+            let dst = &mut buf[done..done + size];
+            match self.slot(current >> PAGE_SHIFT) {
+                Some(slot) => dst.copy_from_slice(&self.pages[slot].data[offset..offset + size]),
+                None => dst.fill(0),
+            }
+            done += size;
+        }
+        Ok(())
+    }
+
+    fn write_buf(&mut self, addr: u64, buf: &[u8]) -> Result<()> {
+        let mut done = 0;
+        while done < buf.len() {
+            let current = addr + done as u64;
+            let offset = (current & Self::PAGE_MASK) as usize;
+            let size = (buf.len() - done).min(Self::PAGE_SIZE - offset);
+            let slot = self.slot_or_create(current >> PAGE_SHIFT);
+            let page = &mut self.pages[slot];
+            page.dirty.mark_range(offset as u64, size as u64);
+            page.data[offset..offset + size].copy_from_slice(&buf[done..done + size]);
+            done += size;
+        }
+        Ok(())
+    }
+
+    // Pages are boxed so their data never moves once allocated
+    fn host_page(&mut self, addr: u64) -> Option<*mut u8> {
+        let slot = self.slot(addr >> PAGE_SHIFT)?;
+        let offset = (addr & Self::PAGE_MASK & !(MMU_PAGE_SIZE as u64 - 1)) as usize;
+        Some(unsafe { self.pages[slot].data.as_mut_ptr().add(offset) })
+    }
+
+    fn take_dirty_pages(&mut self) -> Option<Vec<u64>> {
+        let mut pages = Vec::new();
+        for page in &mut self.pages {
+            page.dirty.take(&mut pages);
+        }
+        pages.sort_unstable();
+        Some(pages)
+    }
+}
+
+pub type RadixMemory<const PAGE_SHIFT: u32> = PagedMemory<RadixIndex, PAGE_SHIFT>;
+pub type HashMemory<const PAGE_SHIFT: u32> = PagedMemory<HashIndex, PAGE_SHIFT>;
+pub type SortedVecMemory<const PAGE_SHIFT: u32> = PagedMemory<SortedVecIndex, PAGE_SHIFT>;
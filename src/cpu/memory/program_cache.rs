@@ -1,61 +1,216 @@
 use crate::{
-    cpu::cpu_core::CpuMode,
-    types::{decode_program_line, ProgramLine, Word},
+    cpu::cpu_core::{Cpu, CpuMode},
+    types::{decode_program_line, Instruction, InstructionType, ProgramLine, Word},
 };
 
+use anyhow::{Context, Result};
+
 use super::memory_core::Memory;
+use rustc_hash::FxHashMap;
 
-use anyhow::{Context, Result};
+// Decoded code is cached per 4 KiB guest page, created the first time the page is executed
+const CODE_PAGE_SHIFT: u64 = 12;
+const CODE_PAGE_SIZE: u64 = 1 << CODE_PAGE_SHIFT;
+const CODE_PAGE_MASK: u64 = CODE_PAGE_SIZE - 1;
+const LINES_PER_PAGE: usize = (CODE_PAGE_SIZE / 4) as usize;
+
+// Placeholder for slots that have not been executed yet, decodes the word on
+// first execution and patches the slot with the real instruction
+const UNDECODED_INSTRUCTION: Instruction = Instruction {
+    mask: 0,
+    bits: 0,
+    name: "UNDECODED",
+    instruction_type: InstructionType::I,
+    operation: decode_on_first_execution,
+};
+
+const UNDECODED_LINE: ProgramLine = ProgramLine {
+    instruction: UNDECODED_INSTRUCTION,
+    word: Word(0),
+    rd: None,
+    branch: None,
+};
+
+type CodePage = Box<[ProgramLine; LINES_PER_PAGE]>;
+
+// Taken back edges to a loop header. The body spans from `target` to the
+// furthest branch that jumped back to it.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub struct LoopCounter {
+    pub target: u64,
+    pub end: u64,
+    pub iterations: u64,
+}
+
+impl LoopCounter {
+    pub fn body_instructions(&self) -> u64 {
+        (self.end - self.target) / 4 + 1
+    }
+
+    // Assumes every iteration runs the whole body once, nested loops are
+    // counted by their own header
+    pub fn estimated_instructions(&self) -> u64 {
+        self.iterations * self.body_instructions()
+    }
+}
 
 pub struct ProgramCache {
-    start_addr: u64,
-    end_addr: u64,
-    data: Vec<ProgramLine>,
+    mode: CpuMode,
+    pages: Vec<CodePage>,
+    page_index: FxHashMap<u64, usize>,
+    current_page_id: u64,
+    current_page: usize,
+    // Bounds of all cached pages, lets stores outside code skip the page lookup
+    code_start: u64,
+    code_end: u64,
+    loops: Vec<LoopCounter>,
+    loop_index: FxHashMap<u64, usize>,
+    // Consecutive back edges usually close the same loop
+    last_loop: usize,
 }
 
 impl ProgramCache {
     pub fn empty() -> ProgramCache {
-        ProgramCache {
-            start_addr: 0,
-            end_addr: 0,
-            data: Vec::new(),
-        }
+        Self::new(CpuMode::RV32)
     }
 
-    pub fn new(
-        start_addr: u64,
-        end_addr: u64,
-        memory: &mut dyn Memory,
-        mode: CpuMode,
-    ) -> Result<ProgramCache> {
-        let mut data = Vec::new();
-        for i in (start_addr..end_addr).step_by(4) {
-            let word = memory.read_mem_u32(i)?;
-            data.push(
-                decode_program_line(Word(word), mode)
-                    .context(format!("Instruction not found at {:x} word: {:x}", i, word))?,
-            );
+    pub fn new(mode: CpuMode) -> ProgramCache {
+        ProgramCache {
+            mode,
+            pages: Vec::new(),
+            page_index: FxHashMap::default(),
+            current_page_id: u64::MAX,
+            current_page: 0,
+            code_start: u64::MAX,
+            code_end: 0,
+            loops: Vec::new(),
+            loop_index: FxHashMap::default(),
+            last_loop: usize::MAX,
         }
-        Ok(ProgramCache {
-            start_addr,
-            end_addr,
-            data,
-        })
     }
 
     pub fn try_get_line(&self, addr: u64) -> Option<ProgramLine> {
-        if addr < self.start_addr || addr >= self.end_addr {
-            return None;
-        }
-        Some(self.data[((addr - self.start_addr) / 4) as usize])
+        let page = self.page_index.get(&(addr >> CODE_PAGE_SHIFT))?;
+        Some(self.pages[*page][((addr & CODE_PAGE_MASK) / 4) as usize])
     }
 
     #[inline(always)]
-    pub fn get_line_unchecked(&self, addr: u64) -> ProgramLine {
+    pub fn get_line(&mut self, addr: u64) -> ProgramLine {
+        let page_id = addr >> CODE_PAGE_SHIFT;
+        if page_id != self.current_page_id {
+            self.select_page(page_id);
+        }
         unsafe {
             *self
-                .data
-                .get_unchecked(((addr - self.start_addr) / 4) as usize)
+                .pages
+                .get_unchecked(self.current_page)
+                .get_unchecked(((addr & CODE_PAGE_MASK) / 4) as usize)
         }
     }
+
+    #[cold]
+    fn select_page(&mut self, page_id: u64) {
+        self.current_page = match self.page_index.get(&page_id) {
+            Some(page) => *page,
+            None => {
+                let page = self.pages.len();
+                self.pages.push(Box::new([UNDECODED_LINE; LINES_PER_PAGE]));
+                self.page_index.insert(page_id, page);
+                self.code_start = self.code_start.min(page_id << CODE_PAGE_SHIFT);
+                self.code_end = self.code_end.max((page_id + 1) << CODE_PAGE_SHIFT);
+                page
+            }
+        };
+        self.current_page_id = page_id;
+    }
+
+    // Installs a line ahead of execution, a store to it drops it like any decoded line
+    pub fn replace_line(&mut self, addr: u64, line: ProgramLine) {
+        self.select_page(addr >> CODE_PAGE_SHIFT);
+        self.pages[self.current_page][((addr & CODE_PAGE_MASK) / 4) as usize] = line;
+    }
+
+    // Called for every guest store, drops decoded slots overlapping the written bytes
+    #[inline(always)]
+    pub fn invalidate(&mut self, addr: u64, len: u64) {
+        if addr < self.code_end && addr.saturating_add(len) > self.code_start {
+            self.invalidate_range(addr, len);
+        }
+    }
+
+    #[cold]
+    fn invalidate_range(&mut self, addr: u64, len: u64) {
+        let end = addr.saturating_add(len);
+        let mut current = addr & !3;
+        while current < end {
+            let page_id = current >> CODE_PAGE_SHIFT;
+            let page_end = ((page_id + 1) << CODE_PAGE_SHIFT).min(end);
+            if let Some(page) = self.page_index.get(&page_id) {
+                let first = ((current & CODE_PAGE_MASK) / 4) as usize;
+                let last = (((page_end - 1) & CODE_PAGE_MASK) / 4) as usize;
+                self.pages[*page][first..=last].fill(UNDECODED_LINE);
+            }
+            current = page_end;
+        }
+    }
+
+    // Called by taken branches and jumps to a lower address
+    #[inline(always)]
+    pub fn record_back_edge(&mut self, branch: u64, target: u64) {
+        let counter = match self.loops.get_mut(self.last_loop) {
+            Some(counter) if counter.target == target => counter,
+            _ => self.select_loop(target),
+        };
+        counter.iterations += 1;
+        counter.end = counter.end.max(branch);
+    }
+
+    #[cold]
+    fn select_loop(&mut self, target: u64) -> &mut LoopCounter {
+        self.last_loop = *self.loop_index.entry(target).or_insert_with(|| {
+            self.loops.push(LoopCounter {
+                target,
+                end: target,
+                iterations: 0,
+            });
+            self.loops.len() - 1
+        });
+        &mut self.loops[self.last_loop]
+    }
+
+    pub fn loop_counters(&self) -> &[LoopCounter] {
+        &self.loops
+    }
+
+    // Real instructions always have a non-zero mask
+    #[inline(always)]
+    pub fn is_placeholder(line: &ProgramLine) -> bool {
+        line.instruction.mask == 0
+    }
+
+    // Decodes a placeholder returned by `get_line` ahead of its first execution.
+    // Undecodable words keep the placeholder, which reports the error when executed.
+    pub fn decode_placeholder(&mut self, addr: u64, memory: &mut dyn Memory) -> ProgramLine {
+        memory
+            .read_mem_u32(addr)
+            .and_then(|word| self.decode_line(addr, Word(word)))
+            .unwrap_or(UNDECODED_LINE)
+    }
+
+    fn decode_line(&mut self, addr: u64, word: Word) -> Result<ProgramLine> {
+        let line = decode_program_line(word, self.mode).context(format!(
+            "Instruction not found at {:x} word: {:x}",
+            addr, word.0
+        ))?;
+        let page = self.page_index[&(addr >> CODE_PAGE_SHIFT)];
+        self.pages[page][((addr & CODE_PAGE_MASK) / 4) as usize] = line;
+        Ok(line)
+    }
+}
+
+fn decode_on_first_execution(cpu: &mut Cpu, _word: &Word) -> Result<()> {
+    let addr = cpu.current_instruction_pc_64;
+    let word = Word(cpu.memory.read_mem_u32(addr)?);
+    let line = cpu.program_cache.decode_line(addr, word)?;
+    cpu.execute_program_line(&line)
 }
@@ -3,12 +3,13 @@ use anyhow::{bail, Result};
 
 use crate::cpu::cpu_core::{KERNEL_ADDR, KERNEL_SIZE};
 
-use super::memory_core::Memory;
+use super::{dirty_bitmap::DirtyBitmap, memory_core::Memory, mmu::MMU_PAGE_SIZE};
 
 #[derive(Clone, Debug)]
 pub struct ContinuousMemory {
     data: Vec<u8>,
     addr: u64,
+    dirty: DirtyBitmap,
 }
 
 impl ContinuousMemory {
@@ -16,6 +17,7 @@ impl ContinuousMemory {
         Self {
             data: vec![0; size as usize],
             addr,
+            dirty: DirtyBitmap::new(addr, size),
         }
     }
 
@@ -77,6 +79,7 @@ impl Memory for ContinuousMemory {
         let addr = addr - self.addr;
         #[cfg(not(feature = "maxperf"))]
         self.check_bounds(addr, 1)?;
+        self.dirty.mark(addr, 1);
         unsafe {
             let ptr = self.data.as_mut_ptr().add(addr as usize);
             ptr.write(value);
@@ -88,6 +91,7 @@ impl Memory for ContinuousMemory {
         let addr = addr - self.addr;
         #[cfg(not(feature = "maxperf"))]
         self.check_bounds(addr, 2)?;
+        self.dirty.mark(addr, 2);
         unsafe {
             let ptr = self.data.as_mut_ptr().add(addr as usize) as *mut u16;
             ptr.write_unaligned(value);
@@ -99,6 +103,7 @@ impl Memory for ContinuousMemory {
         let addr = addr - self.addr;
         #[cfg(not(feature = "maxperf"))]
         self.check_bounds(addr, 4)?;
+        self.dirty.mark(addr, 4);
         unsafe {
             let ptr = self.data.as_mut_ptr().add(addr as usize) as *mut u32;
             ptr.write_unaligned(value);
@@ -110,6 +115,7 @@ impl Memory for ContinuousMemory {
         let addr = addr - self.addr;
         #[cfg(not(feature = "maxperf"))]
         self.check_bounds(addr, 8)?;
+        self.dirty.mark(addr, 8);
         unsafe {
             let ptr = self.data.as_mut_ptr().add(addr as usize) as *mut u64;
             ptr.write_unaligned(value);
@@ -132,10 +138,37 @@ impl Memory for ContinuousMemory {
         let addr = addr - self.addr;
         #[cfg(not(feature = "maxperf"))]
         self.check_bounds(addr, buf.len() as u64)?;
+        self.dirty.mark_range(addr, buf.len() as u64);
         unsafe {
             let dst = self.data.as_mut_ptr().add(addr as usize);
             std::ptr::copy_nonoverlapping(buf.as_ptr(), dst, buf.len());
         }
         Ok(())
     }
+
+    fn fill(&mut self, addr: u64, len: u64, value: u8) -> Result<()> {
+        let addr = addr - self.addr;
+        #[cfg(not(feature = "maxperf"))]
+        self.check_bounds(addr, len)?;
+        self.dirty.mark_range(addr, len);
+        unsafe {
+            let dst = self.data.as_mut_ptr().add(addr as usize);
+            std::ptr::write_bytes(dst, value, len as usize);
+        }
+        Ok(())
+    }
+
+    fn host_page(&mut self, addr: u64) -> Option<*mut u8> {
+        let page = (addr & !(MMU_PAGE_SIZE as u64 - 1)).checked_sub(self.addr)?;
+        if page + MMU_PAGE_SIZE as u64 > self.data.len() as u64 {
+            return None;
+        }
+        Some(unsafe { self.data.as_mut_ptr().add(page as usize) })
+    }
+
+    fn take_dirty_pages(&mut self) -> Option<Vec<u64>> {
+        let mut pages = Vec::new();
+        self.dirty.take(&mut pages);
+        Some(pages)
+    }
 }
@@ -0,0 +1,110 @@
+use super::mmu::MMU_PAGE_SIZE;
+
+const PAGE_SHIFT: u64 = 12;
+const PAGE_MASK: u64 = MMU_PAGE_SIZE as u64 - 1;
+const ENTRIES: usize = 256;
+// Virtual page numbers are at most 52 bits wide
+const INVALID_TAG: u64 = u64::MAX;
+
+#[derive(Clone, Copy)]
+struct Entry {
+    tag: u64,
+    page: *mut u8,
+}
+
+const INVALID_ENTRY: Entry = Entry {
+    tag: INVALID_TAG,
+    page: std::ptr::null_mut(),
+};
+
+// Folds in higher bits so pages a power of two apart don't share a slot
+#[inline(always)]
+fn index(vpn: u64) -> usize {
+    (vpn ^ (vpn >> 8)) as usize % ENTRIES
+}
+
+type Entries = [Entry; ENTRIES];
+
+#[inline(always)]
+fn lookup(entries: &Entries, addr: u64, size: u64) -> Option<*mut u8> {
+    let vpn = addr >> PAGE_SHIFT;
+    let offset = addr & PAGE_MASK;
+    let entry = unsafe { entries.get_unchecked(index(vpn)) };
+    if entry.tag == vpn && offset + size <= MMU_PAGE_SIZE as u64 {
+        Some(unsafe { entry.page.add(offset as usize) })
+    } else {
+        None
+    }
+}
+
+// Direct-mapped caches from guest virtual pages to the host memory backing them,
+// which let loads, stores and bare mode fetches skip the page walk, the MMIO checks
+// and the backend. Fetches and data have separate entries so code and the data it
+// works on don't evict each other. Stores have their own entries, filled after the
+// backend saw a store to the page, which keeps its dirty tracking exact while
+// cached stores bypass it. Only RAM pages the backend exposes through
+// `Memory::host_page` are cached, accesses crossing a page boundary always miss.
+pub struct TranslationCache {
+    fetch: Entries,
+    read: Entries,
+    write: Entries,
+}
+
+impl TranslationCache {
+    pub fn new() -> TranslationCache {
+        TranslationCache {
+            fetch: [INVALID_ENTRY; ENTRIES],
+            read: [INVALID_ENTRY; ENTRIES],
+            write: [INVALID_ENTRY; ENTRIES],
+        }
+    }
+
+    #[inline(always)]
+    pub fn fetch_ptr(&self, addr: u64) -> Option<*mut u8> {
+        lookup(&self.fetch, addr, 4)
+    }
+
+    #[inline(always)]
+    pub fn read_ptr(&self, addr: u64, size: u64) -> Option<*mut u8> {
+        lookup(&self.read, addr, size)
+    }
+
+    #[inline(always)]
+    pub fn write_ptr(&self, addr: u64, size: u64) -> Option<*mut u8> {
+        lookup(&self.write, addr, size)
+    }
+
+    // `page` is the host address of the physical page `addr` translates to
+    pub fn insert_fetch(&mut self, addr: u64, page: *mut u8) {
+        let vpn = addr >> PAGE_SHIFT;
+        self.fetch[index(vpn)] = Entry { tag: vpn, page };
+    }
+
+    pub fn insert_read(&mut self, addr: u64, page: *mut u8) {
+        let vpn = addr >> PAGE_SHIFT;
+        self.read[index(vpn)] = Entry { tag: vpn, page };
+    }
+
+    pub fn insert_write(&mut self, addr: u64, page: *mut u8) {
+        let vpn = addr >> PAGE_SHIFT;
+        self.write[index(vpn)] = Entry { tag: vpn, page };
+    }
+
+    // Called when satp changes and on SFENCE.VMA
+    pub fn flush(&mut self) {
+        self.fetch.fill(INVALID_ENTRY);
+        self.read.fill(INVALID_ENTRY);
+        self.write.fill(INVALID_ENTRY);
+    }
+
+    // The next store to each page goes through the backend again
+    pub fn flush_writes(&mut self) {
+        self.write.fill(INVALID_ENTRY);
+    }
+}
+
+impl Default for TranslationCache {
+    fn default() -> Self {
+        Self::new()
+    }
+}
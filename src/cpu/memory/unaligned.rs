@@ -0,0 +1,30 @@
+use anyhow::Result;
+
+use super::memory_core::Memory;
+
+// The strategy every paged backend shares for accesses wider than a byte: when the
+// access fits in one page the backend takes its single page fast path, otherwise it
+// is split into byte accesses here, out of line. Byte accesses never cross a page,
+// so the backend's own read_mem_u8/write_mem_u8 terminate the recursion.
+#[inline(always)]
+pub fn fits_in_page(addr: u64, size: u64, page_size: u64) -> bool {
+    (addr & (page_size - 1)) + size <= page_size
+}
+
+#[cold]
+#[inline(never)]
+pub fn read_split<M: Memory + ?Sized>(memory: &mut M, addr: u64, bytes: &mut [u8]) -> Result<()> {
+    for (i, byte) in bytes.iter_mut().enumerate() {
+        *byte = memory.read_mem_u8(addr.wrapping_add(i as u64))?;
+    }
+    Ok(())
+}
+
+#[cold]
+#[inline(never)]
+pub fn write_split<M: Memory + ?Sized>(memory: &mut M, addr: u64, bytes: &[u8]) -> Result<()> {
+    for (i, &byte) in bytes.iter().enumerate() {
+        memory.write_mem_u8(addr.wrapping_add(i as u64), byte)?;
+    }
+    Ok(())
+}
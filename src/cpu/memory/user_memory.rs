@@ -133,4 +133,18 @@ impl Memory for UserMemory {
             self.heap.write_buf(addr, buf)
         }
     }
+
+    fn host_page(&mut self, addr: u64) -> Option<*mut u8> {
+        if addr >= CUTOFF_ADDR {
+            self.stack.host_page(addr)
+        } else {
+            self.heap.host_page(addr)
+        }
+    }
+
+    fn take_dirty_pages(&mut self) -> Option<Vec<u64>> {
+        let mut pages = self.heap.take_dirty_pages()?;
+        pages.append(&mut self.stack.take_dirty_pages()?);
+        Some(pages)
+    }
 }
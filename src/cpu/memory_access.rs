@@ -6,21 +6,109 @@ use crate::system::{
     uart::{uart_handle_read, uart_handle_write, UART_ADDR},
     virtio::{process_queue, VIRTIO_0_ADDR, VIRTIO_MMIO_QUEUE_NOTIFY},
 };
-use anyhow::Result;
+use anyhow::{bail, Result};
 
 use super::{
     cpu_core::{Cpu, KERNEL_ADDR},
-    memory::memory_core::Memory,
+    instrumentation::{record_mem_access, Instrumentation, MemAccessKind},
+    memory::{memory_core::Memory, mmu::MMU_PAGE_SIZE, unaligned::fits_in_page},
 };
 
-pub(crate) fn bare_read_mem_u64(cpu: &mut Cpu, addr: u64) -> Result<u64> {
+// Called on translation cache misses that reached RAM
+#[inline(always)]
+fn cache_translation<M: Memory + 'static>(
+    cpu: &mut Cpu,
+    virtual_addr: u64,
+    addr: u64,
+    kind: MemAccessKind,
+) {
+    if let Some(page) = cpu.memory_as::<M>().host_page(addr) {
+        match kind {
+            MemAccessKind::Read => cpu.translation_cache.insert_read(virtual_addr, page),
+            MemAccessKind::Write => cpu.translation_cache.insert_write(virtual_addr, page),
+        }
+    }
+}
+
+// With Sv39 on, the halves of an access crossing a virtual page can map to unrelated
+// physical pages, so each half is translated on its own
+#[inline(always)]
+fn crosses_virtual_page(cpu: &Cpu, addr: u64, size: u64) -> bool {
+    cpu.csr_table.satp != 0 && !fits_in_page(addr, size, MMU_PAGE_SIZE as u64)
+}
+
+fn split_at_virtual_page(addr: u64) -> usize {
+    (MMU_PAGE_SIZE as u64 - (addr & (MMU_PAGE_SIZE as u64 - 1))) as usize
+}
+
+// Devices only handle aligned accesses, so a split access reaching one faults
+fn check_split_ram(addr: u64) -> Result<()> {
+    if addr < KERNEL_ADDR {
+        bail!("Misaligned device access at {:#x}", addr);
+    }
+    Ok(())
+}
+
+#[cold]
+#[inline(never)]
+fn read_across_pages<M: Memory + 'static>(
+    cpu: &mut Cpu,
+    addr: u64,
+    bytes: &mut [u8],
+) -> Result<()> {
+    let (low, high) = bytes.split_at_mut(split_at_virtual_page(addr));
+    let low_addr = cpu.translate_address_if_needed(addr)?;
+    let high_addr = cpu.translate_address_if_needed(addr + low.len() as u64)?;
+    check_split_ram(low_addr)?;
+    check_split_ram(high_addr)?;
+    let memory = cpu.memory_as::<M>();
+    memory.read_buf(low_addr, low)?;
+    memory.read_buf(high_addr, high)
+}
+
+// Both pages are translated before either is written, a fault leaves memory untouched
+#[cold]
+#[inline(never)]
+fn write_across_pages<M: Memory + 'static>(cpu: &mut Cpu, addr: u64, bytes: &[u8]) -> Result<()> {
+    let (low, high) = bytes.split_at(split_at_virtual_page(addr));
+    let low_addr = cpu.translate_address_if_needed(addr)?;
+    let high_addr = cpu.translate_address_if_needed(addr + low.len() as u64)?;
+    check_split_ram(low_addr)?;
+    check_split_ram(high_addr)?;
+    let memory = cpu.memory_as::<M>();
+    memory.write_buf(low_addr, low)?;
+    memory.write_buf(high_addr, high)
+}
+
+pub(crate) fn bare_read_mem_u64<M: Memory + 'static, I: Instrumentation>(
+    cpu: &mut Cpu,
+    addr: u64,
+) -> Result<u64> {
+    record_mem_access::<I>(cpu, addr, 8, MemAccessKind::Read);
+    if crosses_virtual_page(cpu, addr, 8) {
+        let mut bytes = [0; 8];
+        read_across_pages::<M>(cpu, addr, &mut bytes)?;
+        return Ok(u64::from_le_bytes(bytes));
+    }
+    let virtual_addr = addr;
     let addr = cpu.translate_address_if_needed(addr)?;
-    cpu.memory.read_mem_u64(addr)
+    cache_translation::<M>(cpu, virtual_addr, addr, MemAccessKind::Read);
+    cpu.memory_as::<M>().read_mem_u64(addr)
 }
 
-pub(crate) fn bare_read_mem_u32(cpu: &mut Cpu, addr: u64) -> Result<u32> {
+pub(crate) fn bare_read_mem_u32<M: Memory + 'static, I: Instrumentation>(
+    cpu: &mut Cpu,
+    addr: u64,
+) -> Result<u32> {
+    record_mem_access::<I>(cpu, addr, 4, MemAccessKind::Read);
+    if crosses_virtual_page(cpu, addr, 4) {
+        let mut bytes = [0; 4];
+        read_across_pages::<M>(cpu, addr, &mut bytes)?;
+        return Ok(u32::from_le_bytes(bytes));
+    }
+    let virtual_addr = addr;
     let addr = cpu.translate_address_if_needed(addr)?;
-    if addr <= KERNEL_ADDR {
+    if addr < KERNEL_ADDR {
         if addr < UART_ADDR {
             // PLIC
             if addr == PLIC_CLAIM {
@@ -35,17 +123,34 @@ pub(crate) fn bare_read_mem_u32(cpu: &mut Cpu, addr: u64) -> Result<u32> {
             return cpu.peripherals.as_mut().unwrap().virtio.read_mem_u32(addr);
         }
     }
-    cpu.memory.read_mem_u32(addr)
+    cache_translation::<M>(cpu, virtual_addr, addr, MemAccessKind::Read);
+    cpu.memory_as::<M>().read_mem_u32(addr)
 }
 
-pub(crate) fn bare_read_mem_u16(cpu: &mut Cpu, addr: u64) -> Result<u16> {
+pub(crate) fn bare_read_mem_u16<M: Memory + 'static, I: Instrumentation>(
+    cpu: &mut Cpu,
+    addr: u64,
+) -> Result<u16> {
+    record_mem_access::<I>(cpu, addr, 2, MemAccessKind::Read);
+    if crosses_virtual_page(cpu, addr, 2) {
+        let mut bytes = [0; 2];
+        read_across_pages::<M>(cpu, addr, &mut bytes)?;
+        return Ok(u16::from_le_bytes(bytes));
+    }
+    let virtual_addr = addr;
     let addr = cpu.translate_address_if_needed(addr)?;
-    cpu.memory.read_mem_u16(addr)
+    cache_translation::<M>(cpu, virtual_addr, addr, MemAccessKind::Read);
+    cpu.memory_as::<M>().read_mem_u16(addr)
 }
 
-pub(crate) fn bare_read_mem_u8(cpu: &mut Cpu, addr: u64) -> Result<u8> {
+pub(crate) fn bare_read_mem_u8<M: Memory + 'static, I: Instrumentation>(
+    cpu: &mut Cpu,
+    addr: u64,
+) -> Result<u8> {
+    record_mem_access::<I>(cpu, addr, 1, MemAccessKind::Read);
+    let virtual_addr = addr;
     let addr = cpu.translate_address_if_needed(addr)?;
-    if addr <= KERNEL_ADDR {
+    if addr < KERNEL_ADDR {
         if addr < UART_ADDR {
             // PLIC
             return cpu.peripherals.as_mut().unwrap().plic.read_mem_u8(addr);
@@ -60,12 +165,19 @@ pub(crate) fn bare_read_mem_u8(cpu: &mut Cpu, addr: u64) -> Result<u8> {
             return cpu.peripherals.as_mut().unwrap().virtio.read_mem_u8(addr);
         }
     }
-    cpu.memory.read_mem_u8(addr)
+    cache_translation::<M>(cpu, virtual_addr, addr, MemAccessKind::Read);
+    cpu.memory_as::<M>().read_mem_u8(addr)
 }
 
-pub(crate) fn bare_write_mem_u8(cpu: &mut Cpu, addr: u64, value: u8) -> Result<()> {
+pub(crate) fn bare_write_mem_u8<M: Memory + 'static, I: Instrumentation>(
+    cpu: &mut Cpu,
+    addr: u64,
+    value: u8,
+) -> Result<()> {
+    record_mem_access::<I>(cpu, addr, 1, MemAccessKind::Write);
+    let virtual_addr = addr;
     let addr = cpu.translate_address_if_needed(addr)?;
-    if addr <= KERNEL_ADDR {
+    if addr < KERNEL_ADDR {
         if addr < UART_ADDR {
             // PLIC
             return cpu
@@ -96,17 +208,37 @@ pub(crate) fn bare_write_mem_u8(cpu: &mut Cpu, addr: u64, value: u8) -> Result<(
                 .write_mem_u8(addr, value);
         }
     }
-    cpu.memory.write_mem_u8(addr, value)
+    cache_translation::<M>(cpu, virtual_addr, addr, MemAccessKind::Write);
+    cpu.memory_as::<M>().write_mem_u8(addr, value)
 }
 
-pub(crate) fn bare_write_mem_u16(cpu: &mut Cpu, addr: u64, value: u16) -> Result<()> {
+pub(crate) fn bare_write_mem_u16<M: Memory + 'static, I: Instrumentation>(
+    cpu: &mut Cpu,
+    addr: u64,
+    value: u16,
+) -> Result<()> {
+    record_mem_access::<I>(cpu, addr, 2, MemAccessKind::Write);
+    if crosses_virtual_page(cpu, addr, 2) {
+        return write_across_pages::<M>(cpu, addr, &value.to_le_bytes());
+    }
+    let virtual_addr = addr;
     let addr = cpu.translate_address_if_needed(addr)?;
-    cpu.memory.write_mem_u16(addr, value)
+    cache_translation::<M>(cpu, virtual_addr, addr, MemAccessKind::Write);
+    cpu.memory_as::<M>().write_mem_u16(addr, value)
 }
 
-pub(crate) fn bare_write_mem_u32(cpu: &mut Cpu, addr: u64, value: u32) -> Result<()> {
+pub(crate) fn bare_write_mem_u32<M: Memory + 'static, I: Instrumentation>(
+    cpu: &mut Cpu,
+    addr: u64,
+    value: u32,
+) -> Result<()> {
+    record_mem_access::<I>(cpu, addr, 4, MemAccessKind::Write);
+    if crosses_virtual_page(cpu, addr, 4) {
+        return write_across_pages::<M>(cpu, addr, &value.to_le_bytes());
+    }
+    let virtual_addr = addr;
     let addr = cpu.translate_address_if_needed(addr)?;
-    if addr <= KERNEL_ADDR {
+    if addr < KERNEL_ADDR {
         if addr < UART_ADDR {
             // PLIC
             if addr == PLIC_PENDING {
@@ -144,42 +276,101 @@ pub(crate) fn bare_write_mem_u32(cpu: &mut Cpu, addr: u64, value: u32) -> Result
                 .write_mem_u32(addr, value);
         }
     }
-    cpu.memory.write_mem_u32(addr, value)
+    cache_translation::<M>(cpu, virtual_addr, addr, MemAccessKind::Write);
+    cpu.memory_as::<M>().write_mem_u32(addr, value)
 }
 
-pub(crate) fn bare_write_mem_u64(cpu: &mut Cpu, addr: u64, value: u64) -> Result<()> {
+pub(crate) fn bare_write_mem_u64<M: Memory + 'static, I: Instrumentation>(
+    cpu: &mut Cpu,
+    addr: u64,
+    value: u64,
+) -> Result<()> {
+    record_mem_access::<I>(cpu, addr, 8, MemAccessKind::Write);
+    if crosses_virtual_page(cpu, addr, 8) {
+        return write_across_pages::<M>(cpu, addr, &value.to_le_bytes());
+    }
+    let virtual_addr = addr;
     let addr = cpu.translate_address_if_needed(addr)?;
-    cpu.memory.write_mem_u64(addr, value)
+    cache_translation::<M>(cpu, virtual_addr, addr, MemAccessKind::Write);
+    cpu.memory_as::<M>().write_mem_u64(addr, value)
 }
 
-pub(crate) fn user_space_read_mem_u64(cpu: &mut Cpu, addr: u64) -> Result<u64> {
-    cpu.memory.read_mem_u64(addr)
+pub(crate) fn user_space_read_mem_u64<M: Memory + 'static, I: Instrumentation>(
+    cpu: &mut Cpu,
+    addr: u64,
+) -> Result<u64> {
+    record_mem_access::<I>(cpu, addr, 8, MemAccessKind::Read);
+    cache_translation::<M>(cpu, addr, addr, MemAccessKind::Read);
+    cpu.memory_as::<M>().read_mem_u64(addr)
 }
 
-pub(crate) fn user_space_read_mem_u32(cpu: &mut Cpu, addr: u64) -> Result<u32> {
-    cpu.memory.read_mem_u32(addr)
+pub(crate) fn user_space_read_mem_u32<M: Memory + 'static, I: Instrumentation>(
+    cpu: &mut Cpu,
+    addr: u64,
+) -> Result<u32> {
+    record_mem_access::<I>(cpu, addr, 4, MemAccessKind::Read);
+    cache_translation::<M>(cpu, addr, addr, MemAccessKind::Read);
+    cpu.memory_as::<M>().read_mem_u32(addr)
 }
 
-pub(crate) fn user_space_read_mem_u16(cpu: &mut Cpu, addr: u64) -> Result<u16> {
-    cpu.memory.read_mem_u16(addr)
+pub(crate) fn user_space_read_mem_u16<M: Memory + 'static, I: Instrumentation>(
+    cpu: &mut Cpu,
+    addr: u64,
+) -> Result<u16> {
+    record_mem_access::<I>(cpu, addr, 2, MemAccessKind::Read);
+    cache_translation::<M>(cpu, addr, addr, MemAccessKind::Read);
+    cpu.memory_as::<M>().read_mem_u16(addr)
 }
 
-pub(crate) fn user_space_read_mem_u8(cpu: &mut Cpu, addr: u64) -> Result<u8> {
-    cpu.memory.read_mem_u8(addr)
+pub(crate) fn user_space_read_mem_u8<M: Memory + 'static, I: Instrumentation>(
+    cpu: &mut Cpu,
+    addr: u64,
+) -> Result<u8> {
+    record_mem_access::<I>(cpu, addr, 1, MemAccessKind::Read);
+    cache_translation::<M>(cpu, addr, addr, MemAccessKind::Read);
+    cpu.memory_as::<M>().read_mem_u8(addr)
 }
 
-pub(crate) fn user_space_write_mem_u8(cpu: &mut Cpu, addr: u64, value: u8) -> Result<()> {
-    cpu.memory.write_mem_u8(addr, value)
+pub(crate) fn user_space_write_mem_u8<M: Memory + 'static, I: Instrumentation>(
+    cpu: &mut Cpu,
+    addr: u64,
+    value: u8,
+) -> Result<()> {
+    record_mem_access::<I>(cpu, addr, 1, MemAccessKind::Write);
+    cpu.program_cache.invalidate(addr, 1);
+    cache_translation::<M>(cpu, addr, addr, MemAccessKind::Write);
+    cpu.memory_as::<M>().write_mem_u8(addr, value)
 }
 
-pub(crate) fn user_space_write_mem_u16(cpu: &mut Cpu, addr: u64, value: u16) -> Result<()> {
-    cpu.memory.write_mem_u16(addr, value)
+pub(crate) fn user_space_write_mem_u16<M: Memory + 'static, I: Instrumentation>(
+    cpu: &mut Cpu,
+    addr: u64,
+    value: u16,
+) -> Result<()> {
+    record_mem_access::<I>(cpu, addr, 2, MemAccessKind::Write);
+    cpu.program_cache.invalidate(addr, 2);
+    cache_translation::<M>(cpu, addr, addr, MemAccessKind::Write);
+    cpu.memory_as::<M>().write_mem_u16(addr, value)
 }
 
-pub(crate) fn user_space_write_mem_u32(cpu: &mut Cpu, addr: u64, value: u32) -> Result<()> {
-    cpu.memory.write_mem_u32(addr, value)
+pub(crate) fn user_space_write_mem_u32<M: Memory + 'static, I: Instrumentation>(
+    cpu: &mut Cpu,
+    addr: u64,
+    value: u32,
+) -> Result<()> {
+    record_mem_access::<I>(cpu, addr, 4, MemAccessKind::Write);
+    cpu.program_cache.invalidate(addr, 4);
+    cache_translation::<M>(cpu, addr, addr, MemAccessKind::Write);
+    cpu.memory_as::<M>().write_mem_u32(addr, value)
 }
 
-pub(crate) fn user_space_write_mem_u64(cpu: &mut Cpu, addr: u64, value: u64) -> Result<()> {
-    cpu.memory.write_mem_u64(addr, value)
+pub(crate) fn user_space_write_mem_u64<M: Memory + 'static, I: Instrumentation>(
+    cpu: &mut Cpu,
+    addr: u64,
+    value: u64,
+) -> Result<()> {
+    record_mem_access::<I>(cpu, addr, 8, MemAccessKind::Write);
+    cpu.program_cache.invalidate(addr, 8);
+    cache_translation::<M>(cpu, addr, addr, MemAccessKind::Write);
+    cpu.memory_as::<M>().write_mem_u64(addr, value)
 }
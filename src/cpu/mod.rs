@@ -1,3 +1,6 @@
 pub mod cpu_core;
+pub mod engine;
+pub mod host_routines;
+pub mod instrumentation;
 pub mod memory;
 pub mod memory_access;
@@ -1,13 +1,17 @@
 use crate::cpu::cpu_core::CpuMode;
 use crate::cpu::memory::memory_core::Memory;
 use crate::types::{decode_program_line, ProgramLine, Word};
-use anyhow::Result;
+use anyhow::{Context, Result};
 use bitflags::bitflags;
+use nix::sys::mman::{mmap, munmap, MapFlags, ProtFlags};
 use std::cmp::max;
+use std::ffi::c_void;
 use std::fmt::{Debug, Display, Formatter};
 use std::fs::File;
 use std::io::Read;
-use std::{fmt, fs};
+use std::num::NonZeroUsize;
+use std::ptr::NonNull;
+use std::{fmt, slice};
 
 #[derive(Debug, Clone, PartialEq, Copy)]
 pub enum WordSize {
@@ -207,7 +211,7 @@ pub struct Section {
     addr: usize,
     offset: usize,
     size: usize,
-    data: Vec<u8>,
+    link: u32,
 }
 
 impl fmt::Display for Section {
@@ -248,13 +252,67 @@ pub struct ProgramHeader {
     file_size: u64,
     memory_size: u64,
     alignment: u64,
-    data: Vec<u8>,
 }
 
+#[derive(Debug, Clone, PartialEq)]
+pub enum SymbolType {
+    NoType,
+    Object,
+    Func,
+    Other(u8),
+}
+
+#[derive(Debug, Clone)]
+pub struct Symbol {
+    pub name: String,
+    pub addr: u64,
+    pub size: u64,
+    pub symbol_type: SymbolType,
+}
+
+// Read-only private mapping of the whole file, segments are copied straight out of it
+pub struct MappedFile {
+    ptr: NonNull<c_void>,
+    len: usize,
+}
+
+impl MappedFile {
+    pub fn open(path: &str) -> Result<MappedFile> {
+        let file = File::open(path).with_context(|| format!("Failed to open {}", path))?;
+        let len = file.metadata()?.len() as usize;
+        let length = NonZeroUsize::new(len).with_context(|| format!("{} is empty", path))?;
+        let ptr = unsafe {
+            mmap(
+                None,
+                length,
+                ProtFlags::PROT_READ,
+                MapFlags::MAP_PRIVATE,
+                &file,
+                0,
+            )
+        }
+        .with_context(|| format!("Failed to mmap {}", path))?;
+        Ok(MappedFile { ptr, len })
+    }
+
+    pub fn as_slice(&self) -> &[u8] {
+        unsafe { slice::from_raw_parts(self.ptr.as_ptr() as *const u8, self.len) }
+    }
+}
+
+impl Drop for MappedFile {
+    fn drop(&mut self) {
+        unsafe {
+            let _ = munmap(self.ptr, self.len);
+        }
+    }
+}
+
+// Only the ELF header is decoded up front, program and section headers are
+// parsed on demand from the mapping
 pub struct ElfFile {
     pub header: ELFHeader,
-    pub program_headers: Vec<ProgramHeader>,
-    pub section_headers: Vec<Section>,
+    file: MappedFile,
 }
 
 impl Display for ProgramHeader {
@@ -295,7 +353,8 @@ impl Debug for ProgramFile {
 }
 
 pub fn decode_file(path: &str) -> ElfFile {
-    let file = fs::read(path).unwrap();
+    let mapped = MappedFile::open(path).unwrap();
+    let file = mapped.as_slice();
 
     let magic_value = u32::from_be_bytes(
         file.iter()
@@ -356,25 +415,25 @@ pub fn decode_file(path: &str) -> ElfFile {
         _ => ISA::OTHER,
     };
 
-    let entry_point = read_file_word_size(&file, 0, word_size, 0x18, 0x18);
+    let entry_point = read_file_word_size(file, 0, word_size, 0x18, 0x18);
 
-    let program_header_table_offset = read_file_word_size(&file, 0, word_size, 0x1C, 0x20);
+    let program_header_table_offset = read_file_word_size(file, 0, word_size, 0x1C, 0x20);
 
-    let section_header_table_offset = read_file_word_size(&file, 0, word_size, 0x20, 0x28);
+    let section_header_table_offset = read_file_word_size(file, 0, word_size, 0x20, 0x28);
 
     // Ignore flags
 
-    let header_size = read_file_u16(&file, word_size, 0x28, 0x34);
+    let header_size = read_file_u16(file, word_size, 0x28, 0x34);
 
-    let program_header_size = read_file_u16(&file, word_size, 0x2A, 0x36);
+    let program_header_size = read_file_u16(file, word_size, 0x2A, 0x36);
 
-    let program_header_count = read_file_u16(&file, word_size, 0x2C, 0x38);
+    let program_header_count = read_file_u16(file, word_size, 0x2C, 0x38);
 
-    let section_header_size = read_file_u16(&file, word_size, 0x2E, 0x3A);
+    let section_header_size = read_file_u16(file, word_size, 0x2E, 0x3A);
 
-    let section_header_count = read_file_u16(&file, word_size, 0x30, 0x3C);
+    let section_header_count = read_file_u16(file, word_size, 0x30, 0x3C);
 
-    let section_header_string_table_index = read_file_u16(&file, word_size, 0x32, 0x3E);
+    let section_header_string_table_index = read_file_u16(file, word_size, 0x32, 0x3E);
 
     let elf_header = ELFHeader {
         word_size,
@@ -394,12 +453,104 @@ pub fn decode_file(path: &str) -> ElfFile {
         section_header_string_table_index,
     };
 
-    let mut program_headers = vec![];
-    let mut section_headers = vec![];
+    ElfFile {
+        header: elf_header,
+        file: mapped,
+    }
+}
+
+impl ElfFile {
+    pub fn data(&self) -> &[u8] {
+        self.file.as_slice()
+    }
+
+    pub fn program_headers(&self) -> impl Iterator<Item = ProgramHeader> + '_ {
+        (0..self.header.program_header_count).map(|i| self.program_header(i))
+    }
+
+    pub fn section_headers(&self) -> impl Iterator<Item = Section> + '_ {
+        let file = self.data();
+        let word_size = self.header.word_size;
+
+        // Name string table
+        let offset = (self.header.section_header_table_offset
+            + self.header.section_header_string_table_index as u64
+                * self.header.section_header_size as u64) as usize;
+
+        let shstrtab_offset = read_file_word_size(file, offset, word_size, 0x10, 0x18) as usize;
+
+        (0..self.header.section_header_count).map(move |i| self.section_header(i, shstrtab_offset))
+    }
+
+    pub fn segment_data(&self, program_header: &ProgramHeader) -> &[u8] {
+        let start = program_header.segment_offset as usize;
+        &self.data()[start..start + program_header.file_size as usize]
+    }
+
+    pub fn section_data(&self, section: &Section) -> &[u8] {
+        if section.section_type == SectionType::SHT_NOBITS {
+            return &[];
+        }
+        &self.data()[section.offset..section.offset + section.size]
+    }
+
+    // Defined symbols from .symtab, empty for stripped files
+    pub fn symbols(&self) -> Vec<Symbol> {
+        let Some(symtab) = self
+            .section_headers()
+            .find(|section| section.section_type == SectionType::SHT_SYMTAB)
+        else {
+            return Vec::new();
+        };
+        let Some(strtab) = self.section_headers().nth(symtab.link as usize) else {
+            return Vec::new();
+        };
+
+        let file = self.data();
+        let word_size = self.header.word_size;
+        let entry_size = match word_size {
+            WordSize::W32 => 0x10,
+            WordSize::W64 => 0x18,
+        };
+
+        (symtab.offset..symtab.offset + symtab.size)
+            .step_by(entry_size)
+            .filter_map(|offset| {
+                let name_offset =
+                    u32::from_le_bytes(file[offset..offset + 0x4].try_into().unwrap()) as usize;
+                let info = file[offset + if word_size == WordSize::W32 { 0xC } else { 0x4 }];
+                let section_index = read_file_u16(file, word_size, offset + 0xE, offset + 0x6);
+                if name_offset == 0 || section_index == 0 {
+                    return None;
+                }
+
+                let string_start = strtab.offset + name_offset;
+                let string_end = file[string_start..]
+                    .iter()
+                    .position(|&x| x == 0)
+                    .map(|pos| string_start + pos)
+                    .unwrap_or(file.len());
+
+                Some(Symbol {
+                    name: String::from_utf8_lossy(&file[string_start..string_end]).into_owned(),
+                    addr: read_file_word_size(file, offset, word_size, 0x4, 0x8),
+                    size: read_file_word_size(file, offset, word_size, 0x8, 0x10),
+                    symbol_type: match info & 0xF {
+                        0 => SymbolType::NoType,
+                        1 => SymbolType::Object,
+                        2 => SymbolType::Func,
+                        other => SymbolType::Other(other),
+                    },
+                })
+            })
+            .collect()
+    }
 
-    for i in 0..elf_header.program_header_count {
-        let offset = (elf_header.program_header_table_offset
-            + i as u64 * elf_header.program_header_size as u64) as usize;
+    fn program_header(&self, i: u16) -> ProgramHeader {
+        let file = self.data();
+        let word_size = self.header.word_size;
+        let offset = (self.header.program_header_table_offset
+            + i as u64 * self.header.program_header_size as u64) as usize;
 
         let program_header_type =
             match u32::from_le_bytes(file[offset..(offset + 4)].try_into().unwrap()) {
@@ -417,27 +568,21 @@ pub fn decode_file(path: &str) -> ElfFile {
                 other => ProgramHeaderType::Unknown(other),
             };
 
-        let flags = read_file_u32(&file, word_size, offset + 0x18, offset + 0x4) as u64;
+        let flags = read_file_u32(file, word_size, offset + 0x18, offset + 0x4) as u64;
 
-        let segment_offset = read_file_word_size(&file, offset, word_size, 0x4, 0x8);
+        let segment_offset = read_file_word_size(file, offset, word_size, 0x4, 0x8);
 
-        let virtual_address = read_file_word_size(&file, offset, word_size, 0x8, 0x10);
+        let virtual_address = read_file_word_size(file, offset, word_size, 0x8, 0x10);
 
-        let physical_address = read_file_word_size(&file, offset, word_size, 0xC, 0x18);
+        let physical_address = read_file_word_size(file, offset, word_size, 0xC, 0x18);
 
-        let file_size = read_file_word_size(&file, offset, word_size, 0x10, 0x20);
+        let file_size = read_file_word_size(file, offset, word_size, 0x10, 0x20);
 
-        let memory_size = read_file_word_size(&file, offset, word_size, 0x14, 0x28);
+        let memory_size = read_file_word_size(file, offset, word_size, 0x14, 0x28);
 
-        let alignment = read_file_word_size(&file, offset, word_size, 0x1C, 0x30);
-
-        let segment_data = if program_header_type == ProgramHeaderType::Load {
-            &file[segment_offset as usize..(segment_offset + file_size) as usize]
-        } else {
-            &[]
-        };
+        let alignment = read_file_word_size(file, offset, word_size, 0x1C, 0x30);
 
-        let program_header = ProgramHeader {
+        ProgramHeader {
             header_type: program_header_type,
             flags,
             segment_offset,
@@ -446,24 +591,14 @@ pub fn decode_file(path: &str) -> ElfFile {
             file_size,
             memory_size,
             alignment,
-            data: segment_data.to_vec(),
-        };
-
-        program_headers.push(program_header);
+        }
     }
 
-    // Name string table
-
-    let offset = (elf_header.section_header_table_offset
-        + elf_header.section_header_string_table_index as u64
-            * elf_header.section_header_size as u64) as usize;
-
-    let shstrtab_offset = read_file_word_size(&file, offset, word_size, 0x10, 0x18) as usize;
-
-    for i in 0..elf_header.section_header_count {
-        let offset = (elf_header.section_header_table_offset
-            + i as u64 * elf_header.section_header_size as u64) as usize;
-
+    fn section_header(&self, i: u16, shstrtab_offset: usize) -> Section {
+        let file = self.data();
+        let word_size = self.header.word_size;
+        let offset = (self.header.section_header_table_offset
+            + i as u64 * self.header.section_header_size as u64) as usize;
         let section_header_name_offset =
             u32::from_le_bytes(file[(offset)..(offset + 0x4)].try_into().unwrap()) as usize;
 
@@ -507,40 +642,27 @@ pub fn decode_file(path: &str) -> ElfFile {
             _ => SectionType::SHT_NUM,
         };
 
-        let section_flags_raw = read_file_word_size(&file, offset, word_size, 0x08, 0x08);
+        let section_flags_raw = read_file_word_size(file, offset, word_size, 0x08, 0x08);
 
         let section_flags = SectionFlags::from_bits_truncate(section_flags_raw);
 
-        let section_addr = read_file_word_size(&file, offset, word_size, 0x0C, 0x10) as usize;
+        let section_addr = read_file_word_size(file, offset, word_size, 0x0C, 0x10) as usize;
 
-        let section_offset = read_file_word_size(&file, offset, word_size, 0x10, 0x18) as usize;
+        let section_offset = read_file_word_size(file, offset, word_size, 0x10, 0x18) as usize;
 
-        let section_size = read_file_word_size(&file, offset, word_size, 0x14, 0x20) as usize;
+        let section_size = read_file_word_size(file, offset, word_size, 0x14, 0x20) as usize;
 
-        let section: &[u8] = if section_flags.contains(SectionFlags::SHF_ALLOC)
-            && section_type != SectionType::SHT_NOBITS
-        {
-            &file[section_offset..(section_offset + section_size)]
-        } else {
-            &[]
-        };
+        let section_link = read_file_u32(file, word_size, offset + 0x18, offset + 0x28);
 
-        let section_header = Section {
+        Section {
             name: section_header_name.to_owned(),
             section_type,
             flags: section_flags,
             addr: section_addr,
             offset: section_offset,
             size: section_size,
-            data: section.to_vec(),
-        };
-
-        section_headers.push(section_header);
-    }
-    ElfFile {
-        header: elf_header,
-        program_headers,
-        section_headers,
+            link: section_link,
+        }
     }
 }
 
@@ -587,29 +709,32 @@ pub fn load_program_to_memory(elf: ElfFile, memory: &mut dyn Memory) -> Result<P
     let mut text_section_addr = 0;
     let mut text_section_size = 0;
     let mut end_of_data_addr = 0;
+    let mut loaded_segments = false;
 
-    for program in elf.program_headers {
+    for program in elf.program_headers() {
         if program.header_type == ProgramHeaderType::Load {
-            // Load the segment into memory
-            let segment_address = program.virtual_address as usize;
-
-            for (i, byte) in program.data.iter().enumerate() {
-                memory
-                    .write_mem_u8((segment_address + i) as u64, *byte)
-                    .unwrap();
+            // Copy the file-backed part of the segment, then zero the rest (.bss)
+            memory.write_buf(program.virtual_address, elf.segment_data(&program))?;
+
+            if program.memory_size > program.file_size {
+                memory.fill(
+                    program.virtual_address + program.file_size,
+                    program.memory_size - program.file_size,
+                    0,
+                )?;
             }
+            loaded_segments = true;
         }
     }
 
-    for section in elf.section_headers {
-        if section.flags.contains(SectionFlags::SHF_ALLOC)
+    for section in elf.section_headers() {
+        // Segments already cover every allocated section, sections are only
+        // loaded on their own for files without program headers
+        if !loaded_segments
+            && section.flags.contains(SectionFlags::SHF_ALLOC)
             && section.section_type != SectionType::SHT_NOBITS
         {
-            for (i, byte) in section.data.iter().take(section.size).enumerate() {
-                memory
-                    .write_mem_u8((section.addr + i) as u64, *byte)
-                    .unwrap();
-            }
+            memory.write_buf(section.addr as u64, elf.section_data(&section))?;
         }
 
         if section.flags.contains(SectionFlags::SHF_ALLOC)
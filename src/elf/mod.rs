@@ -1 +1,2 @@
 pub mod elf_loader;
+pub mod symbol_table;
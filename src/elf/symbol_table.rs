@@ -0,0 +1,58 @@
+use super::elf_loader::{ElfFile, Symbol, SymbolType};
+
+// Code symbols sorted by address, used to attribute guest PCs to functions
+#[derive(Default, Clone)]
+pub struct SymbolTable {
+    symbols: Vec<Symbol>,
+}
+
+impl SymbolTable {
+    pub fn new(mut symbols: Vec<Symbol>) -> SymbolTable {
+        // Assembler labels and RISC-V mapping symbols ($x, $d) are not functions
+        symbols.retain(|symbol| {
+            matches!(symbol.symbol_type, SymbolType::Func | SymbolType::NoType)
+                && !symbol.name.starts_with('$')
+                && !symbol.name.starts_with(".L")
+        });
+        // Prefer functions over untyped labels at the same address
+        symbols.sort_by_key(|symbol| (symbol.addr, symbol.symbol_type != SymbolType::Func));
+        symbols.dedup_by_key(|symbol| symbol.addr);
+        SymbolTable { symbols }
+    }
+
+    pub fn from_elf(elf: &ElfFile) -> SymbolTable {
+        SymbolTable::new(elf.symbols())
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.symbols.is_empty()
+    }
+
+    pub fn lookup(&self, addr: u64) -> Option<&Symbol> {
+        let index = self.symbols.partition_point(|symbol| symbol.addr <= addr);
+        let symbol = self.symbols.get(index.checked_sub(1)?)?;
+        if symbol.size != 0 && addr >= symbol.addr + symbol.size {
+            return None;
+        }
+        Some(symbol)
+    }
+
+    pub fn find(&self, name: &str) -> Option<&Symbol> {
+        self.symbols.iter().find(|symbol| symbol.name == name)
+    }
+
+    pub fn function_name(&self, addr: u64) -> String {
+        match self.lookup(addr) {
+            Some(symbol) => symbol.name.clone(),
+            None => format!("{:#x}", addr),
+        }
+    }
+
+    // name+0xoffset, or the raw address when no symbol covers it
+    pub fn symbolize(&self, addr: u64) -> String {
+        match self.lookup(addr) {
+            Some(symbol) => format!("{}+{:#x}", symbol.name, addr - symbol.addr),
+            None => format!("{:#x}", addr),
+        }
+    }
+}
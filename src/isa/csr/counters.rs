@@ -0,0 +1,91 @@
+use crate::{
+    cpu::cpu_core::{Cpu, CpuMode},
+    types::{BitValue, U12},
+};
+
+use super::csr_types::CSRAddress;
+
+// cycle, instret and time are not stored, they are derived from the retired-instruction
+// counter when read. Writes to mcycle/minstret move the offset the counter is read against.
+#[derive(Clone, Copy, PartialEq, Eq, Debug)]
+enum Counter {
+    Cycle,
+    Instret,
+    Time,
+}
+
+const CYCLE: u16 = CSRAddress::Cycle as u16;
+const CYCLE_H: u16 = CSRAddress::CycleH as u16;
+const TIME: u16 = CSRAddress::Time as u16;
+const TIME_H: u16 = CSRAddress::TimeH as u16;
+const INSTRET: u16 = CSRAddress::Instret as u16;
+const INSTRET_H: u16 = CSRAddress::InstretH as u16;
+const MCYCLE: u16 = CSRAddress::Mcycle as u16;
+const MCYCLE_H: u16 = CSRAddress::McycleH as u16;
+const MINSTRET: u16 = CSRAddress::Minstret as u16;
+const MINSTRET_H: u16 = CSRAddress::MinstretH as u16;
+
+// (counter, upper half on RV32, writable)
+fn counter_csr(addr: u16) -> Option<(Counter, bool, bool)> {
+    match addr {
+        CYCLE => Some((Counter::Cycle, false, false)),
+        CYCLE_H => Some((Counter::Cycle, true, false)),
+        TIME => Some((Counter::Time, false, false)),
+        TIME_H => Some((Counter::Time, true, false)),
+        INSTRET => Some((Counter::Instret, false, false)),
+        INSTRET_H => Some((Counter::Instret, true, false)),
+        MCYCLE => Some((Counter::Cycle, false, true)),
+        MCYCLE_H => Some((Counter::Cycle, true, true)),
+        MINSTRET => Some((Counter::Instret, false, true)),
+        MINSTRET_H => Some((Counter::Instret, true, true)),
+        _ => None,
+    }
+}
+
+// Counter CSRs are derived from the retired-instruction count, so a read doesn't
+// return the last value written to them
+pub fn is_counter_csr(addr: u16) -> bool {
+    counter_csr(addr).is_some()
+}
+
+fn offset_addr(counter: Counter) -> U12 {
+    match counter {
+        Counter::Cycle => CSRAddress::Mcycle.as_u12(),
+        Counter::Instret => CSRAddress::Minstret.as_u12(),
+        Counter::Time => unreachable!("time has no writable offset CSR"),
+    }
+}
+
+fn counter_value(cpu: &Cpu, counter: Counter) -> u64 {
+    match counter {
+        // One cycle per retired instruction
+        Counter::Cycle | Counter::Instret => cpu
+            .instret
+            .wrapping_add(cpu.csr_table.read64(offset_addr(counter))),
+        Counter::Time => cpu.read_time(),
+    }
+}
+
+pub fn read_counter(cpu: &Cpu, addr: U12) -> Option<u64> {
+    let (counter, upper, _) = counter_csr(addr.value())?;
+    let value = counter_value(cpu, counter);
+    Some(if upper { value >> 32 } else { value })
+}
+
+// Returns false if the CSR is not a counter. Writes to the user-level counters are ignored.
+pub fn write_counter(cpu: &mut Cpu, addr: U12, value: u64, mode: CpuMode) -> bool {
+    let Some((counter, upper, writable)) = counter_csr(addr.value()) else {
+        return false;
+    };
+    if writable {
+        let current = counter_value(cpu, counter);
+        let new_value = match (upper, mode) {
+            (true, _) => (current & 0xFFFF_FFFF) | (value << 32),
+            (false, CpuMode::RV32) => (current & !0xFFFF_FFFF) | (value & 0xFFFF_FFFF),
+            (false, CpuMode::RV64) => value,
+        };
+        cpu.csr_table
+            .write64(offset_addr(counter), new_value.wrapping_sub(cpu.instret));
+    }
+    true
+}
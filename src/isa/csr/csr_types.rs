@@ -3,6 +3,7 @@ use crate::{
     types::{BitValue, U12},
 };
 use bitfield::bitfield;
+use rustc_hash::FxHashMap;
 
 // Supervisor status register (sstatus) bit positions
 pub const SSTATUS_SIE: u64 = 1 << 1; // Supervisor Interrupt Enable
@@ -104,6 +105,8 @@ pub enum CSRAddress {
     // Machine Counter/Timers
     Mcycle = 0xB00,
     Minstret = 0xB02,
+    McycleH = 0xB80,
+    MinstretH = 0xB82,
     Mhpmcounter3 = 0xB03,
     Mhpmcounter4 = 0xB04,
 
@@ -157,16 +160,166 @@ impl CSRAddress {
     }
 }
 
+// CSRs backed by the dense register file, any other address lives in a sparse map.
+// mstatus, mie, mip, satp and the time offset are hot and kept as plain fields.
+const DENSE_CSRS: &[CSRAddress] = &[
+    CSRAddress::Ustatus,
+    CSRAddress::Uie,
+    CSRAddress::Utvec,
+    CSRAddress::Uscratch,
+    CSRAddress::Uepc,
+    CSRAddress::Ucause,
+    CSRAddress::Utval,
+    CSRAddress::Uip,
+    CSRAddress::Fflags,
+    CSRAddress::Frm,
+    CSRAddress::Fcsr,
+    CSRAddress::Cycle,
+    CSRAddress::CycleH,
+    CSRAddress::TimeH,
+    CSRAddress::Instret,
+    CSRAddress::InstretH,
+    CSRAddress::Sstatus,
+    CSRAddress::Sedeleg,
+    CSRAddress::Sideleg,
+    CSRAddress::Sie,
+    CSRAddress::Stvec,
+    CSRAddress::Scounteren,
+    CSRAddress::Sscratch,
+    CSRAddress::Sepc,
+    CSRAddress::Scause,
+    CSRAddress::Stval,
+    CSRAddress::Sip,
+    CSRAddress::Stimecmp,
+    CSRAddress::Mvendorid,
+    CSRAddress::Marchid,
+    CSRAddress::Mimpid,
+    CSRAddress::Mhartid,
+    CSRAddress::Misa,
+    CSRAddress::Medeleg,
+    CSRAddress::Mideleg,
+    CSRAddress::Mtvec,
+    CSRAddress::Mcounteren,
+    CSRAddress::Mscratch,
+    CSRAddress::Mepc,
+    CSRAddress::Mcause,
+    CSRAddress::Mtval,
+    CSRAddress::Pmpcfg0,
+    CSRAddress::Pmpcfg1,
+    CSRAddress::Pmpcfg2,
+    CSRAddress::Pmpcfg3,
+    CSRAddress::Pmpaddr0,
+    CSRAddress::Pmpaddr1,
+    CSRAddress::Mcycle,
+    CSRAddress::Minstret,
+    CSRAddress::McycleH,
+    CSRAddress::MinstretH,
+    CSRAddress::Mhpmcounter3,
+    CSRAddress::Mhpmcounter4,
+    CSRAddress::Mcountinhibit,
+    CSRAddress::Mhpmevent3,
+    CSRAddress::Mhpmevent4,
+];
+
+#[derive(Clone, Copy, PartialEq, Eq, Debug)]
+enum HotCSR {
+    Mstatus,
+    Mie,
+    Mip,
+    Satp,
+    Time,
+}
+
+#[derive(Clone, Copy, PartialEq, Eq, Debug)]
+enum CSRSlot {
+    Sparse,
+    Dense(u8),
+    Hot(HotCSR),
+}
+
+// Side effects of the 64-bit accessors, the 32-bit accessors use the raw storage
+struct CSRHandler {
+    addr: CSRAddress,
+    read: fn(&CSRTable) -> u64,
+    write: fn(&mut CSRTable, u64),
+}
+
+const CSR_HANDLERS: [CSRHandler; 3] = [
+    // sie and sip are the delegated views of mie and mip
+    CSRHandler {
+        addr: CSRAddress::Sie,
+        read: |csrs| csrs.mie & csrs.read64(CSRAddress::Mideleg.as_u12()),
+        write: |csrs, value| {
+            let mideleg = csrs.read64(CSRAddress::Mideleg.as_u12());
+            csrs.mie = (csrs.mie & !mideleg) | (value & mideleg);
+        },
+    },
+    CSRHandler {
+        addr: CSRAddress::Sip,
+        read: |csrs| csrs.mip & csrs.read64(CSRAddress::Mideleg.as_u12()),
+        write: |csrs, value| {
+            let mideleg = csrs.read64(CSRAddress::Mideleg.as_u12());
+            csrs.mip = (csrs.mip & !mideleg) | (value & mideleg);
+        },
+    },
+    CSRHandler {
+        addr: CSRAddress::Sstatus,
+        read: |csrs| csrs.mstatus & SSTATUS_MASK,
+        write: |csrs, value| {
+            csrs.mstatus = (csrs.mstatus & !SSTATUS_MASK) | (value & SSTATUS_MASK);
+        },
+    },
+];
+
+const NO_HANDLER: u8 = u8::MAX;
+
+// Address to storage slot and handler index, built at compile time
+const CSR_SLOTS: [CSRSlot; 4096] = {
+    let mut slots = [CSRSlot::Sparse; 4096];
+    let mut i = 0;
+    while i < DENSE_CSRS.len() {
+        slots[DENSE_CSRS[i] as usize] = CSRSlot::Dense(i as u8);
+        i += 1;
+    }
+    slots[CSRAddress::Mstatus as usize] = CSRSlot::Hot(HotCSR::Mstatus);
+    slots[CSRAddress::Mie as usize] = CSRSlot::Hot(HotCSR::Mie);
+    slots[CSRAddress::Mip as usize] = CSRSlot::Hot(HotCSR::Mip);
+    slots[CSRAddress::Satp as usize] = CSRSlot::Hot(HotCSR::Satp);
+    slots[CSRAddress::Time as usize] = CSRSlot::Hot(HotCSR::Time);
+    slots
+};
+
+const CSR_HANDLER_INDEX: [u8; 4096] = {
+    let mut index = [NO_HANDLER; 4096];
+    let mut i = 0;
+    while i < CSR_HANDLERS.len() {
+        index[CSR_HANDLERS[i].addr as usize] = i as u8;
+        i += 1;
+    }
+    index
+};
+
 pub struct CSRTable {
-    pub csrs32: [u32; 4096],
-    pub csrs64: [u64; 4096],
+    pub mstatus: u64,
+    pub mie: u64,
+    pub mip: u64,
+    pub satp: u64,
+    // Added to the ticks derived from retired instructions, moves when idle time is skipped
+    pub time: u64,
+    dense: [u64; DENSE_CSRS.len()],
+    sparse: FxHashMap<u16, u64>,
 }
 
 impl CSRTable {
     pub fn new(cpu_mode: CpuMode) -> Self {
         let mut csr_table = CSRTable {
-            csrs32: [0; 4096],
-            csrs64: [0; 4096],
+            mstatus: 0,
+            mie: 0,
+            mip: 0,
+            satp: 0,
+            time: 0,
+            dense: [0; DENSE_CSRS.len()],
+            sparse: FxHashMap::default(),
         };
 
         let mut misa = MisaCSR(0);
@@ -188,60 +341,54 @@ impl CSRTable {
         csr_table
     }
 
+    #[inline(always)]
+    fn read_raw(&self, addr: U12) -> u64 {
+        match CSR_SLOTS[addr.value() as usize] {
+            CSRSlot::Dense(slot) => self.dense[slot as usize],
+            CSRSlot::Hot(HotCSR::Mstatus) => self.mstatus,
+            CSRSlot::Hot(HotCSR::Mie) => self.mie,
+            CSRSlot::Hot(HotCSR::Mip) => self.mip,
+            CSRSlot::Hot(HotCSR::Satp) => self.satp,
+            CSRSlot::Hot(HotCSR::Time) => self.time,
+            CSRSlot::Sparse => self.sparse.get(&addr.value()).copied().unwrap_or(0),
+        }
+    }
+
+    #[inline(always)]
+    fn write_raw(&mut self, addr: U12, value: u64) {
+        match CSR_SLOTS[addr.value() as usize] {
+            CSRSlot::Dense(slot) => self.dense[slot as usize] = value,
+            CSRSlot::Hot(HotCSR::Mstatus) => self.mstatus = value,
+            CSRSlot::Hot(HotCSR::Mie) => self.mie = value,
+            CSRSlot::Hot(HotCSR::Mip) => self.mip = value,
+            CSRSlot::Hot(HotCSR::Satp) => self.satp = value,
+            CSRSlot::Hot(HotCSR::Time) => self.time = value,
+            CSRSlot::Sparse => {
+                self.sparse.insert(addr.value(), value);
+            }
+        }
+    }
+
     pub fn read32(&self, addr: U12) -> u32 {
-        self.csrs32[addr.value() as usize]
+        self.read_raw(addr) as u32
     }
 
     pub fn write32(&mut self, addr: U12, value: u32) {
-        self.csrs32[addr.value() as usize] = value;
+        self.write_raw(addr, value as u64);
     }
 
     pub fn read64(&self, addr: U12) -> u64 {
-        if addr == CSRAddress::Sie.as_u12() {
-            let mideleg = self.read64(CSRAddress::Mideleg.as_u12());
-            let mie = self.read64(CSRAddress::Mie.as_u12());
-            return mie & mideleg;
-        }
-        if addr == CSRAddress::Sip.as_u12() {
-            let mideleg = self.read64(CSRAddress::Mideleg.as_u12());
-            let mip = self.read64(CSRAddress::Mip.as_u12());
-            return mip & mideleg;
+        match CSR_HANDLER_INDEX[addr.value() as usize] {
+            NO_HANDLER => self.read_raw(addr),
+            handler => (CSR_HANDLERS[handler as usize].read)(self),
         }
-        if addr == CSRAddress::Sstatus.as_u12() {
-            let mstatus = self.read64(CSRAddress::Mstatus.as_u12());
-            return mstatus & SSTATUS_MASK;
-        }
-        self.csrs64[addr.value() as usize]
     }
 
     pub fn write64(&mut self, addr: U12, value: u64) {
-        if addr == CSRAddress::Sie.as_u12() {
-            let mideleg = self.read64(CSRAddress::Mideleg.as_u12());
-            let mie = self.read64(CSRAddress::Mie.as_u12());
-            self.write64(
-                CSRAddress::Mie.as_u12(),
-                (mie & !mideleg) | (value & mideleg),
-            );
-            return;
-        }
-        if addr == CSRAddress::Sip.as_u12() {
-            let mideleg = self.read64(CSRAddress::Mideleg.as_u12());
-            let mip = self.read64(CSRAddress::Mip.as_u12());
-            self.write64(
-                CSRAddress::Mip.as_u12(),
-                (mip & !mideleg) | (value & mideleg),
-            );
-            return;
-        }
-        if addr == CSRAddress::Sstatus.as_u12() {
-            let mstatus = self.read64(CSRAddress::Mstatus.as_u12());
-            self.write64(
-                CSRAddress::Mstatus.as_u12(),
-                (mstatus & !SSTATUS_MASK) | (value & SSTATUS_MASK),
-            );
-            return;
+        match CSR_HANDLER_INDEX[addr.value() as usize] {
+            NO_HANDLER => self.write_raw(addr, value),
+            handler => (CSR_HANDLERS[handler as usize].write)(self, value),
         }
-        self.csrs64[addr.value() as usize] = value;
     }
 
     pub fn write_xlen(&mut self, addr: U12, value: u64, mode: CpuMode) {
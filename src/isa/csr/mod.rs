@@ -1 +1,2 @@
+pub mod counters;
 pub mod csr_types;
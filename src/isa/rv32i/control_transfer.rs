@@ -1,4 +1,4 @@
-use crate::types::*;
+use crate::{cpu::cpu_core::Cpu, types::*};
 
 use anyhow::Ok;
 
@@ -17,7 +17,12 @@ pub const RV32I_SET_UJ: [Instruction; 8] = [
             let moved_pc = cpu
                 .read_current_instruction_addr_u32()
                 .wrapping_add_signed(extended_offset);
-            cpu.write_pc_u32(moved_pc);
+            // Calls are not loops, `J` back to the top of one is
+            if instruction.rd.value() == 0 {
+                cpu.jump(moved_pc as u64);
+            } else {
+                cpu.write_pc_u32(moved_pc);
+            }
 
             Ok(())
         },
@@ -55,13 +60,7 @@ pub const RV32I_SET_UJ: [Instruction; 8] = [
             let rs1 = cpu.read_x_i32(instruction.rs1.value());
             let rs2 = cpu.read_x_i32(instruction.rs2.value());
 
-            if rs1 == rs2 {
-                let extended_offset = instruction.imm.as_i32();
-                let moved_pc = cpu
-                    .read_current_instruction_addr_u32()
-                    .wrapping_add_signed(extended_offset);
-                cpu.write_pc_u32(moved_pc);
-            }
+            branch_u32(cpu, instruction.imm.as_i32(), rs1 == rs2);
 
             Ok(())
         },
@@ -77,13 +76,7 @@ pub const RV32I_SET_UJ: [Instruction; 8] = [
             let rs1 = cpu.read_x_i32(instruction.rs1.value());
             let rs2 = cpu.read_x_i32(instruction.rs2.value());
 
-            if rs1 != rs2 {
-                let extended_offset = instruction.imm.as_i32();
-                let moved_pc = cpu
-                    .read_current_instruction_addr_u32()
-                    .wrapping_add_signed(extended_offset);
-                cpu.write_pc_u32(moved_pc);
-            }
+            branch_u32(cpu, instruction.imm.as_i32(), rs1 != rs2);
 
             Ok(())
         },
@@ -99,13 +92,7 @@ pub const RV32I_SET_UJ: [Instruction; 8] = [
             let rs1 = cpu.read_x_i32(instruction.rs1.value());
             let rs2 = cpu.read_x_i32(instruction.rs2.value());
 
-            if rs1 < rs2 {
-                let extended_offset = instruction.imm.as_i32();
-                let moved_pc = cpu
-                    .read_current_instruction_addr_u32()
-                    .wrapping_add_signed(extended_offset);
-                cpu.write_pc_u32(moved_pc);
-            }
+            branch_u32(cpu, instruction.imm.as_i32(), rs1 < rs2);
 
             Ok(())
         },
@@ -121,13 +108,7 @@ pub const RV32I_SET_UJ: [Instruction; 8] = [
             let rs1 = cpu.read_x_i32(instruction.rs1.value());
             let rs2 = cpu.read_x_i32(instruction.rs2.value());
 
-            if rs1 >= rs2 {
-                let extended_offset = instruction.imm.as_i32();
-                let moved_pc = cpu
-                    .read_current_instruction_addr_u32()
-                    .wrapping_add_signed(extended_offset);
-                cpu.write_pc_u32(moved_pc);
-            }
+            branch_u32(cpu, instruction.imm.as_i32(), rs1 >= rs2);
 
             Ok(())
         },
@@ -143,13 +124,7 @@ pub const RV32I_SET_UJ: [Instruction; 8] = [
             let rs1 = cpu.read_x_u32(instruction.rs1.value());
             let rs2 = cpu.read_x_u32(instruction.rs2.value());
 
-            if rs1 < rs2 {
-                let extended_offset = instruction.imm.as_i32();
-                let moved_pc = cpu
-                    .read_current_instruction_addr_u32()
-                    .wrapping_add_signed(extended_offset);
-                cpu.write_pc_u32(moved_pc);
-            }
+            branch_u32(cpu, instruction.imm.as_i32(), rs1 < rs2);
 
             Ok(())
         },
@@ -165,15 +140,17 @@ pub const RV32I_SET_UJ: [Instruction; 8] = [
             let rs1 = cpu.read_x_u32(instruction.rs1.value());
             let rs2 = cpu.read_x_u32(instruction.rs2.value());
 
-            if rs1 >= rs2 {
-                let extended_offset = instruction.imm.as_i32();
-                let moved_pc = cpu
-                    .read_current_instruction_addr_u32()
-                    .wrapping_add_signed(extended_offset);
-                cpu.write_pc_u32(moved_pc);
-            }
+            branch_u32(cpu, instruction.imm.as_i32(), rs1 >= rs2);
 
             Ok(())
         },
     },
 ];
+
+#[inline(always)]
+fn branch_u32(cpu: &mut Cpu, offset: i32, taken: bool) {
+    if taken {
+        let pc = cpu.read_current_instruction_addr_u32();
+        cpu.jump(pc.wrapping_add_signed(offset) as u64);
+    }
+}
@@ -2,8 +2,7 @@ use std::{fs::Metadata, mem, os::unix::fs::MetadataExt};
 
 use crate::{isa, system::kernel::SeekType, types::*};
 
-use anyhow::{bail, Context, Result};
-use nix::time::{clock_gettime, ClockId};
+use anyhow::{bail, Result};
 
 #[repr(C)]
 pub struct Stat {
@@ -216,16 +215,11 @@ pub const RV32I_SET_E: [Instruction; 3] = [
                     let clock_id = cpu.read_x_u32(ABIRegister::A(0).to_x_reg_id() as u8);
                     let timespec_addr = cpu.read_x_u32(ABIRegister::A(1).to_x_reg_id() as u8);
 
-                    #[allow(clippy::useless_conversion)]
-                    let now = clock_gettime(ClockId::from_raw(clock_id.try_into().unwrap()))
-                        .context("clock_gettime")?;
-
-                    let seconds = now.tv_sec() as i64;
-                    let nanos = now.tv_nsec() as i64;
+                    let now = cpu.clock.now(clock_id as u64, cpu.instret)?;
 
                     let time_t = TimeT {
-                        sec: seconds,
-                        nsec: nanos,
+                        sec: now.as_secs() as i64,
+                        nsec: now.subsec_nanos() as i64,
                     };
 
                     cpu.write_buf(timespec_addr as u64, &time_t.to_bytes() as &[u8])?;
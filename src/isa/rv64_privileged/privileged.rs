@@ -1,5 +1,5 @@
 use crate::{
-    cpu::cpu_core::PrivilegeMode,
+    cpu::cpu_core::{ExecutionMode, PrivilegeMode},
     isa::csr::csr_types::{CSRAddress, MstatusCSR},
     types::{
         Instruction, InstructionType, FUNC3_MASK, FUNC7_MASK, FUNC7_POS, OPCODE_MASK, RS2_MASK,
@@ -84,13 +84,21 @@ pub const RV64_PRIVILEGED_SET: [Instruction; 4] = [
         bits: 0b0001001 << FUNC7_POS | 0b1110011,
         name: "SFENCE.VMA",
         instruction_type: InstructionType::R,
-        operation: |_cpu, _word| Ok(()),
+        operation: |cpu, _word| {
+            cpu.translation_cache.flush();
+            Ok(())
+        },
     },
     Instruction {
         mask: OPCODE_MASK | FUNC3_MASK | FUNC7_MASK | RS2_MASK,
         bits: 0b0001000 << FUNC7_POS | 0b1110011 | 0b00101 << RS2_POS,
         name: "WFI",
         instruction_type: InstructionType::R,
-        operation: |_cpu, _word| Ok(()),
+        operation: |cpu, _word| {
+            if cpu.execution_mode == ExecutionMode::Bare {
+                cpu.waiting_for_interrupt = true;
+            }
+            Ok(())
+        },
     },
 ];
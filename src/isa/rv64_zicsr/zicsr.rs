@@ -12,10 +12,10 @@ pub const RV64_ZICSR_SET: [Instruction; 6] = [
             let instruction = parse_instruction_i(word);
             let rs1_value = cpu.read_x_u64(instruction.rs1.value());
             let csr_addr = instruction.imm;
-            let old_csr_value = cpu.csr_table.read64(csr_addr);
+            let old_csr_value = cpu.read_csr64(csr_addr);
 
             cpu.write_x_u64(instruction.rd.value(), old_csr_value);
-            cpu.csr_table.write64(csr_addr, rs1_value);
+            cpu.write_csr64(csr_addr, rs1_value);
 
             Ok(())
         },
@@ -28,11 +28,10 @@ pub const RV64_ZICSR_SET: [Instruction; 6] = [
         operation: |cpu, word| {
             let instruction = parse_instruction_i(word);
             let rs1_value = cpu.read_x_u64(instruction.rs1.value());
-            let old_csr_value = cpu.csr_table.read64(instruction.imm);
+            let old_csr_value = cpu.read_csr64(instruction.imm);
 
             cpu.write_x_u64(instruction.rd.value(), old_csr_value);
-            cpu.csr_table
-                .write64(instruction.imm, old_csr_value | rs1_value);
+            cpu.write_csr64(instruction.imm, old_csr_value | rs1_value);
 
             Ok(())
         },
@@ -45,11 +44,10 @@ pub const RV64_ZICSR_SET: [Instruction; 6] = [
         operation: |cpu, word| {
             let instruction = parse_instruction_i(word);
             let rs1_value = cpu.read_x_u64(instruction.rs1.value());
-            let old_csr_value = cpu.csr_table.read64(instruction.imm);
+            let old_csr_value = cpu.read_csr64(instruction.imm);
 
             cpu.write_x_u64(instruction.rd.value(), old_csr_value);
-            cpu.csr_table
-                .write64(instruction.imm, old_csr_value & !rs1_value);
+            cpu.write_csr64(instruction.imm, old_csr_value & !rs1_value);
 
             Ok(())
         },
@@ -62,10 +60,10 @@ pub const RV64_ZICSR_SET: [Instruction; 6] = [
         operation: |cpu, word| {
             let instruction = parse_instruction_i(word);
             let imm_value = instruction.rs1.value() as u64;
-            let old_csr_value = cpu.csr_table.read64(instruction.imm);
+            let old_csr_value = cpu.read_csr64(instruction.imm);
 
             cpu.write_x_u64(instruction.rd.value(), old_csr_value);
-            cpu.csr_table.write64(instruction.imm, imm_value);
+            cpu.write_csr64(instruction.imm, imm_value);
 
             Ok(())
         },
@@ -78,11 +76,10 @@ pub const RV64_ZICSR_SET: [Instruction; 6] = [
         operation: |cpu, word| {
             let instruction = parse_instruction_i(word);
             let imm_value = instruction.rs1.value() as u64;
-            let old_csr_value = cpu.csr_table.read64(instruction.imm);
+            let old_csr_value = cpu.read_csr64(instruction.imm);
 
             cpu.write_x_u64(instruction.rd.value(), old_csr_value);
-            cpu.csr_table
-                .write64(instruction.imm, old_csr_value | imm_value);
+            cpu.write_csr64(instruction.imm, old_csr_value | imm_value);
 
             Ok(())
         },
@@ -95,11 +92,10 @@ pub const RV64_ZICSR_SET: [Instruction; 6] = [
         operation: |cpu, word| {
             let instruction = parse_instruction_i(word);
             let imm_value = instruction.rs1.value() as u64;
-            let old_csr_value = cpu.csr_table.read64(instruction.imm);
+            let old_csr_value = cpu.read_csr64(instruction.imm);
 
             cpu.write_x_u64(instruction.rd.value(), old_csr_value);
-            cpu.csr_table
-                .write64(instruction.imm, old_csr_value & !imm_value);
+            cpu.write_csr64(instruction.imm, old_csr_value & !imm_value);
 
             Ok(())
         },
@@ -1,4 +1,4 @@
-use crate::types::*;
+use crate::{cpu::cpu_core::Cpu, types::*};
 
 use anyhow::Ok;
 
@@ -17,7 +17,12 @@ pub const RV64I_SET_UJ: [Instruction; 8] = [
             let moved_pc = cpu
                 .read_current_instruction_addr_u64()
                 .wrapping_add_signed(extended_offset);
-            cpu.write_pc_u64(moved_pc);
+            // Calls are not loops, `J` back to the top of one is
+            if instruction.rd.value() == 0 {
+                cpu.jump(moved_pc);
+            } else {
+                cpu.write_pc_u64(moved_pc);
+            }
 
             Ok(())
         },
@@ -53,13 +58,7 @@ pub const RV64I_SET_UJ: [Instruction; 8] = [
             let rs1 = cpu.read_x_i64(instruction.rs1.value());
             let rs2 = cpu.read_x_i64(instruction.rs2.value());
 
-            if rs1 == rs2 {
-                let extended_offset = instruction.imm.as_i64();
-                let moved_pc = cpu
-                    .read_current_instruction_addr_u64()
-                    .wrapping_add_signed(extended_offset);
-                cpu.write_pc_u64(moved_pc);
-            }
+            branch_u64(cpu, instruction.imm.as_i64(), rs1 == rs2);
 
             Ok(())
         },
@@ -75,13 +74,7 @@ pub const RV64I_SET_UJ: [Instruction; 8] = [
             let rs1 = cpu.read_x_i64(instruction.rs1.value());
             let rs2 = cpu.read_x_i64(instruction.rs2.value());
 
-            if rs1 != rs2 {
-                let extended_offset = instruction.imm.as_i64();
-                let moved_pc = cpu
-                    .read_current_instruction_addr_u64()
-                    .wrapping_add_signed(extended_offset);
-                cpu.write_pc_u64(moved_pc);
-            }
+            branch_u64(cpu, instruction.imm.as_i64(), rs1 != rs2);
 
             Ok(())
         },
@@ -97,13 +90,7 @@ pub const RV64I_SET_UJ: [Instruction; 8] = [
             let rs1 = cpu.read_x_i64(instruction.rs1.value());
             let rs2 = cpu.read_x_i64(instruction.rs2.value());
 
-            if rs1 < rs2 {
-                let extended_offset = instruction.imm.as_i64();
-                let moved_pc = cpu
-                    .read_current_instruction_addr_u64()
-                    .wrapping_add_signed(extended_offset);
-                cpu.write_pc_u64(moved_pc);
-            }
+            branch_u64(cpu, instruction.imm.as_i64(), rs1 < rs2);
 
             Ok(())
         },
@@ -119,13 +106,7 @@ pub const RV64I_SET_UJ: [Instruction; 8] = [
             let rs1 = cpu.read_x_i64(instruction.rs1.value());
             let rs2 = cpu.read_x_i64(instruction.rs2.value());
 
-            if rs1 >= rs2 {
-                let extended_offset = instruction.imm.as_i64();
-                let moved_pc = cpu
-                    .read_current_instruction_addr_u64()
-                    .wrapping_add_signed(extended_offset);
-                cpu.write_pc_u64(moved_pc);
-            }
+            branch_u64(cpu, instruction.imm.as_i64(), rs1 >= rs2);
 
             Ok(())
         },
@@ -141,13 +122,7 @@ pub const RV64I_SET_UJ: [Instruction; 8] = [
             let rs1 = cpu.read_x_u64(instruction.rs1.value());
             let rs2 = cpu.read_x_u64(instruction.rs2.value());
 
-            if rs1 < rs2 {
-                let extended_offset = instruction.imm.as_i64();
-                let moved_pc = cpu
-                    .read_current_instruction_addr_u64()
-                    .wrapping_add_signed(extended_offset);
-                cpu.write_pc_u64(moved_pc);
-            }
+            branch_u64(cpu, instruction.imm.as_i64(), rs1 < rs2);
 
             Ok(())
         },
@@ -163,15 +138,17 @@ pub const RV64I_SET_UJ: [Instruction; 8] = [
             let rs1 = cpu.read_x_u64(instruction.rs1.value());
             let rs2 = cpu.read_x_u64(instruction.rs2.value());
 
-            if rs1 >= rs2 {
-                let extended_offset = instruction.imm.as_i64();
-                let moved_pc = cpu
-                    .read_current_instruction_addr_u64()
-                    .wrapping_add_signed(extended_offset);
-                cpu.write_pc_u64(moved_pc);
-            }
+            branch_u64(cpu, instruction.imm.as_i64(), rs1 >= rs2);
 
             Ok(())
         },
     },
 ];
+
+#[inline(always)]
+fn branch_u64(cpu: &mut Cpu, offset: i64, taken: bool) {
+    if taken {
+        let pc = cpu.read_current_instruction_addr_u64();
+        cpu.jump(pc.wrapping_add_signed(offset));
+    }
+}
@@ -1,4 +1,4 @@
-use std::{fs::Metadata, mem, os::unix::fs::MetadataExt, ptr::null_mut};
+use std::{fs::Metadata, mem, os::unix::fs::MetadataExt};
 
 use crate::{
     cpu::cpu_core::{ExecutionMode, PrivilegeMode},
@@ -6,15 +6,12 @@ use crate::{
         self,
         traps::{execute_trap, TrapCause},
     },
-    system::kernel::SeekType,
+    system::{clock::CLOCK_REALTIME, kernel::SeekType},
     types::*,
 };
 
-use anyhow::{bail, Context, Result};
-use nix::{
-    libc::{gettimeofday, timeval},
-    time::{clock_gettime, ClockId},
-};
+use anyhow::{bail, Result};
+use nix::libc::timeval;
 
 #[repr(C)]
 pub struct Stat {
@@ -232,11 +229,12 @@ pub const RV64I_SET_E: [Instruction; 3] = [
                     // gettimeofday
                     let timeval_addr = cpu.read_x_u64(ABIRegister::A(0).to_x_reg_id() as u8);
 
-                    let mut timeval_s: timeval = timeval {
-                        tv_sec: 0,
-                        tv_usec: 0,
+                    let now = cpu.clock.now(CLOCK_REALTIME, cpu.instret)?;
+
+                    let timeval_s: timeval = timeval {
+                        tv_sec: now.as_secs() as i64,
+                        tv_usec: now.subsec_micros() as i64,
                     };
-                    unsafe { gettimeofday(&mut timeval_s, null_mut()) };
 
                     let data = unsafe {
                         let bytes_ptr: *const u8 = &timeval_s as *const timeval as *const u8;
@@ -256,16 +254,11 @@ pub const RV64I_SET_E: [Instruction; 3] = [
                     let clock_id = cpu.read_x_u64(ABIRegister::A(0).to_x_reg_id() as u8);
                     let timespec_addr = cpu.read_x_u64(ABIRegister::A(1).to_x_reg_id() as u8);
 
-                    #[allow(clippy::useless_conversion)]
-                    let now = clock_gettime(ClockId::from_raw(clock_id.try_into().unwrap()))
-                        .context("clock_gettime")?;
-
-                    let seconds = now.tv_sec() as i64;
-                    let nanos = now.tv_nsec() as i64;
+                    let now = cpu.clock.now(clock_id, cpu.instret)?;
 
                     let time_t = TimeT {
-                        sec: seconds,
-                        nsec: nanos,
+                        sec: now.as_secs() as i64,
+                        nsec: now.subsec_nanos() as i64,
                     };
 
                     cpu.write_buf(timespec_addr, &time_t.to_bytes() as &[u8])?;
@@ -32,39 +32,48 @@ pub enum TrapInterruptCause {
     SupervisorExternalGuestInterrupt = 12,
 }
 
-pub fn update_timers(cpu: &mut Cpu) {
-    cpu.csr_table.write64(
-        CSRAddress::Time.as_u12(),
-        cpu.csr_table.read64(CSRAddress::Time.as_u12()) + 1,
-    );
+const STIP_BIT_POS: u64 = 5;
+
+// STIP follows the comparison, writing a later stimecmp clears it
+pub fn update_timer_interrupt(cpu: &mut Cpu) {
+    if cpu.read_time() > cpu.csr_table.read64(CSRAddress::Stimecmp.as_u12()) {
+        cpu.csr_table.mip |= 1 << STIP_BIT_POS;
+    } else {
+        cpu.csr_table.mip &= !(1 << STIP_BIT_POS);
+    }
 }
 
-pub fn check_pending_interrupts(cpu: &mut Cpu) {
-    if cpu.csr_table.read64(CSRAddress::Time.as_u12())
-        > cpu.csr_table.read64(CSRAddress::Stimecmp.as_u12())
-    {
-        let mip = cpu.csr_table.read64(CSRAddress::Mip.as_u12());
+// WFI resumes on any locally enabled pending interrupt, even if globally disabled
+pub fn has_enabled_pending_interrupt(cpu: &Cpu) -> bool {
+    cpu.csr_table.mip & cpu.csr_table.mie != 0
+}
 
-        const STIP_BIT_POS: u64 = 5;
+// Timer ticks left until the supervisor timer interrupt fires, None if it is not enabled
+pub fn ticks_until_timer_interrupt(cpu: &Cpu) -> Option<u64> {
+    if cpu.csr_table.mie & (1 << STIP_BIT_POS) == 0 {
+        return None;
+    }
+    let time = cpu.read_time();
+    let stimecmp = cpu.csr_table.read64(CSRAddress::Stimecmp.as_u12());
+    Some(stimecmp.saturating_sub(time) + 1)
+}
 
-        cpu.csr_table
-            .write64(CSRAddress::Mip.as_u12(), mip | (1 << STIP_BIT_POS));
+pub fn check_pending_interrupts(cpu: &mut Cpu) {
+    update_timer_interrupt(cpu);
+    let mip = cpu.csr_table.mip;
+    let pending = mip & cpu.csr_table.mie;
+    if pending == 0 {
+        return;
     }
-    let mip_addr = CSRAddress::Mip.as_u12();
+
     let sip_addr = CSRAddress::Sip.as_u12();
-    let mie_addr = CSRAddress::Mie.as_u12();
-    let sie_addr = CSRAddress::Sie.as_u12();
     let mideleg = cpu.csr_table.read64(CSRAddress::Mideleg.as_u12());
-
-    let mip = cpu.csr_table.read64(mip_addr);
     let sip = cpu.csr_table.read64(sip_addr);
-    let mie_csr = cpu.csr_table.read64(mie_addr);
-    let sie = cpu.csr_table.read64(sie_addr);
+    let sie = cpu.csr_table.read64(CSRAddress::Sie.as_u12());
 
-    let pending = mip & mie_csr;
     let spending = pending & sie & mideleg;
 
-    let mstatus = MstatusCSR(cpu.csr_table.read64(CSRAddress::Mstatus.as_u12()));
+    let mstatus = MstatusCSR(cpu.csr_table.mstatus);
     let mie = mstatus.mie();
     let sie = mstatus.sie();
 
@@ -72,7 +81,7 @@ pub fn check_pending_interrupts(cpu: &mut Cpu) {
         for i in 0..13 {
             if (pending & (1 << i)) != 0 {
                 // clears the interrupt bit in the ip register
-                cpu.csr_table.write64(mip_addr, mip & !(1 << i));
+                cpu.csr_table.mip = mip & !(1 << i);
                 execute_trap(cpu, i, true);
                 break;
             }
@@ -90,6 +99,7 @@ pub fn check_pending_interrupts(cpu: &mut Cpu) {
 }
 
 pub fn execute_trap(cpu: &mut Cpu, cause: u64, interrupt: bool) {
+    cpu.notify_trap(cause, interrupt);
     let initial_privilage_mode = cpu.privilege_mode;
 
     let deleg = match interrupt {
@@ -146,9 +156,13 @@ pub fn execute_trap(cpu: &mut Cpu, cause: u64, interrupt: bool) {
         }
     }
 
-    let current_pc = cpu.read_current_instruction_addr_u64();
+    // Interrupts are taken after an instruction retired and return past it
+    let epc = match interrupt {
+        false => cpu.read_current_instruction_addr_u64(),
+        true => cpu.read_pc_u64(),
+    };
     cpu.csr_table
-        .write_xlen_epc(current_pc, cpu.arch_mode, cpu.privilege_mode);
+        .write_xlen_epc(epc, cpu.arch_mode, cpu.privilege_mode);
     let tvec = cpu
         .csr_table
         .read_xlen_tvec(cpu.arch_mode, cpu.privilege_mode);
@@ -3,6 +3,7 @@
 pub mod cpu;
 pub mod elf;
 pub mod isa;
+pub mod profiling;
 pub mod system;
 #[cfg(test)]
 pub mod tests;
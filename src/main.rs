@@ -2,7 +2,10 @@
 
 use anyhow::Result;
 use clap::Parser;
-use cli_utils::{print_debug_info, setup_cpu, setup_terminal, CliArgs};
+use cli_utils::{
+    finish_trace, print_debug_info, print_hot_regions, setup_cpu, setup_terminal, wait_for_event,
+    write_call_graph, write_microarch_report, write_profile, CliArgs,
+};
 use ctrlc::set_handler;
 use doom::{doom_init, update_window, DoomEmulation};
 use risc_sim::cpu::cpu_core::ExecutionMode;
@@ -26,7 +29,7 @@ fn main() -> Result<()> {
 
     let stdio_channel = setup_terminal()?;
 
-    let mut cpu = setup_cpu(&args)?;
+    let (mut cpu, symbols) = setup_cpu(&args)?;
 
     let mut emulation: Option<DoomEmulation> = if args.simulate_display {
         Some(doom_init())
@@ -36,7 +39,6 @@ fn main() -> Result<()> {
 
     let start_time = std::time::Instant::now();
 
-    let mut count = 0;
     const COUNT_INTERVAL: u64 = 5000;
     let mut stdio_count = 0;
     const STDIO_READ_INTERVAL: u64 = 500000;
@@ -45,7 +47,13 @@ fn main() -> Result<()> {
             break anyhow::anyhow!("Interrupted by Ctrl-C");
         }
 
-        count += COUNT_INTERVAL;
+        if let Some(idle) = cpu.idle_state() {
+            match wait_for_event(&mut cpu, idle, &stdio_channel) {
+                Some(3) => break anyhow::anyhow!("Interrupted by Ctrl-C"),
+                Some(c) => write_char(&mut cpu, c),
+                None => {}
+            }
+        }
 
         if args.execution_mode == ExecutionMode::Bare {
             if stdio_count > STDIO_READ_INTERVAL {
@@ -94,6 +102,22 @@ fn main() -> Result<()> {
             emulation.frames_drawn as f64 / elapsed_time.as_secs_f64()
         );
     }
+    if let Some(path) = &args.profile {
+        write_profile(&cpu, path)?;
+    }
+    if let Some(path) = &args.call_graph {
+        write_call_graph(&cpu, path)?;
+    }
+    if let Some(path) = &args.microarch {
+        write_microarch_report(&cpu, path)?;
+    }
+    if args.hot_regions {
+        print_hot_regions(&cpu, &symbols)?;
+    }
+    if let Some(path) = &args.trace {
+        finish_trace(&mut cpu, path)?;
+    }
+    let count = cpu.instret;
     print_debug_info(cpu, count, elapsed_time);
 
     Ok(())
@@ -0,0 +1,231 @@
+use std::{
+    collections::BTreeMap,
+    io::{self, Write},
+};
+
+use rustc_hash::FxHashMap;
+
+use crate::{
+    cpu::instrumentation::Instrumentation, elf::symbol_table::SymbolTable, types::ProgramLine,
+};
+
+const OPCODE_MASK: u32 = 0x7F;
+const OPCODE_BRANCH: u32 = 0x63;
+const OPCODE_JALR: u32 = 0x67;
+const OPCODE_JAL: u32 = 0x6F;
+const MRET: u32 = 0x30200073;
+const SRET: u32 = 0x10200073;
+
+// Deeper stacks are assumed to come from unmatched calls (longjmp, context switches)
+const MAX_DEPTH: usize = 256;
+
+const ROOT: usize = 0;
+
+struct Node {
+    // Address the frame was entered at, symbolized when the report is written
+    entry: u64,
+    parent: usize,
+    depth: usize,
+    exclusive: u64,
+}
+
+// Shadow call stack kept as a calling-context tree: calls (JAL/JALR writing ra or t0)
+// enter a child node, returns (JALR through ra or t0) go back to the parent.
+// Traps enter a child node as well and are left on mret/sret.
+pub struct CallGraphProfiler {
+    nodes: Vec<Node>,
+    children: FxHashMap<(usize, u64), usize>,
+    current: usize,
+    // Calls past MAX_DEPTH that got no node, their returns must not pop a real one
+    dropped_frames: usize,
+    expected_pc: Option<u64>,
+    pub symbols: SymbolTable,
+}
+
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub struct FunctionCounts {
+    pub name: String,
+    pub inclusive: u64,
+    pub exclusive: u64,
+}
+
+fn is_link_register(reg: u32) -> bool {
+    reg == 1 || reg == 5
+}
+
+impl CallGraphProfiler {
+    pub fn new(symbols: SymbolTable) -> CallGraphProfiler {
+        CallGraphProfiler {
+            nodes: vec![Node {
+                entry: 0,
+                parent: ROOT,
+                depth: 0,
+                exclusive: 0,
+            }],
+            children: FxHashMap::default(),
+            current: ROOT,
+            dropped_frames: 0,
+            expected_pc: None,
+            symbols,
+        }
+    }
+
+    fn call(&mut self, entry: u64) {
+        let parent = self.current;
+        let depth = self.nodes[parent].depth + 1;
+        if depth > MAX_DEPTH {
+            self.dropped_frames += 1;
+            return;
+        }
+        let nodes = &mut self.nodes;
+        self.current = *self.children.entry((parent, entry)).or_insert_with(|| {
+            nodes.push(Node {
+                entry,
+                parent,
+                depth,
+                exclusive: 0,
+            });
+            nodes.len() - 1
+        });
+    }
+
+    fn ret(&mut self) {
+        if self.dropped_frames > 0 {
+            self.dropped_frames -= 1;
+            return;
+        }
+        self.current = self.nodes[self.current].parent;
+    }
+
+    pub fn depth(&self) -> usize {
+        self.nodes[self.current].depth
+    }
+
+    fn frame_names(&self) -> Vec<String> {
+        self.nodes
+            .iter()
+            .map(|node| self.symbols.function_name(node.entry))
+            .collect()
+    }
+
+    // Brendan Gregg's folded format, one `outer;inner count` line per distinct stack
+    pub fn write_folded(&self, out: &mut dyn Write) -> io::Result<()> {
+        let names = self.frame_names();
+        let mut stacks = BTreeMap::<String, u64>::new();
+        for (id, node) in self.nodes.iter().enumerate() {
+            if node.exclusive == 0 {
+                continue;
+            }
+            let mut frames = vec![names[id].as_str()];
+            let mut parent = id;
+            while parent != ROOT {
+                parent = self.nodes[parent].parent;
+                frames.push(names[parent].as_str());
+            }
+            frames.reverse();
+            *stacks.entry(frames.join(";")).or_default() += node.exclusive;
+        }
+        for (stack, count) in stacks {
+            writeln!(out, "{} {}", stack, count)?;
+        }
+        Ok(())
+    }
+
+    // Recursive frames count towards a function's inclusive total once
+    pub fn function_counts(&self) -> Vec<FunctionCounts> {
+        let names = self.frame_names();
+
+        // Children are always created after their parent
+        let mut subtree: Vec<u64> = self.nodes.iter().map(|node| node.exclusive).collect();
+        for id in (1..self.nodes.len()).rev() {
+            subtree[self.nodes[id].parent] += subtree[id];
+        }
+
+        let mut counts = FxHashMap::<&str, (u64, u64)>::default();
+        for (id, node) in self.nodes.iter().enumerate() {
+            let name = names[id].as_str();
+            let entry = counts.entry(name).or_default();
+            entry.1 += node.exclusive;
+
+            let mut ancestor = id;
+            let mut recursive = false;
+            while ancestor != ROOT {
+                ancestor = self.nodes[ancestor].parent;
+                if names[ancestor] == name {
+                    recursive = true;
+                    break;
+                }
+            }
+            if !recursive {
+                counts.get_mut(name).unwrap().0 += subtree[id];
+            }
+        }
+
+        let mut counts: Vec<FunctionCounts> = counts
+            .into_iter()
+            .map(|(name, (inclusive, exclusive))| FunctionCounts {
+                name: name.to_owned(),
+                inclusive,
+                exclusive,
+            })
+            .collect();
+        counts.sort_by(|a, b| b.inclusive.cmp(&a.inclusive).then(a.name.cmp(&b.name)));
+        counts
+    }
+
+    pub fn write_summary(&self, out: &mut dyn Write, top: usize) -> io::Result<()> {
+        let counts = self.function_counts();
+        let total = counts.iter().map(|c| c.exclusive).sum::<u64>().max(1) as f64;
+        writeln!(out, "Functions (inclusive, exclusive):")?;
+        for function in counts.iter().take(top) {
+            writeln!(
+                out,
+                "  {:6.2}% {:6.2}% {}",
+                function.inclusive as f64 * 100.0 / total,
+                function.exclusive as f64 * 100.0 / total,
+                function.name
+            )?;
+        }
+        Ok(())
+    }
+}
+
+impl Instrumentation for CallGraphProfiler {
+    const REGISTER_WRITES: bool = false;
+    const MEM_ACCESSES: bool = false;
+    const BRANCHES: bool = false;
+    const SYSCALLS: bool = false;
+
+    #[inline(always)]
+    fn on_retire(&mut self, pc: u64, line: &ProgramLine, next_pc: u64) {
+        match self.expected_pc {
+            // Interrupt taken after the previous instruction
+            Some(expected) if expected != pc => self.call(pc),
+            None => self.nodes[ROOT].entry = pc,
+            _ => {}
+        }
+        self.expected_pc = Some(next_pc);
+        self.nodes[self.current].exclusive += 1;
+
+        let word = line.word.0;
+        let rd = (word >> 7) & 0x1F;
+        let rs1 = (word >> 15) & 0x1F;
+        match word & OPCODE_MASK {
+            OPCODE_JAL if is_link_register(rd) => self.call(next_pc),
+            OPCODE_JALR => match (is_link_register(rd), is_link_register(rs1)) {
+                (true, true) if rd != rs1 => {
+                    self.ret();
+                    self.call(next_pc);
+                }
+                (true, _) => self.call(next_pc),
+                (false, true) => self.ret(),
+                (false, false) => {}
+            },
+            OPCODE_JAL | OPCODE_BRANCH => {}
+            _ if word == MRET || word == SRET => self.ret(),
+            // Exception or ecall trapping into a handler
+            _ if next_pc != pc + 4 => self.call(next_pc),
+            _ => {}
+        }
+    }
+}
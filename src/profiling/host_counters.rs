@@ -0,0 +1,223 @@
+#[cfg(target_os = "linux")]
+pub use perf::HostCounters;
+#[cfg(not(target_os = "linux"))]
+pub use unsupported::HostCounters;
+
+#[derive(Clone, Copy, PartialEq, Eq, Debug)]
+pub enum HostEvent {
+    Instructions,
+    Cycles,
+    BranchMisses,
+    L1iMisses,
+    DtlbMisses,
+}
+
+impl HostEvent {
+    pub const ALL: [HostEvent; 5] = [
+        HostEvent::Instructions,
+        HostEvent::Cycles,
+        HostEvent::BranchMisses,
+        HostEvent::L1iMisses,
+        HostEvent::DtlbMisses,
+    ];
+
+    pub fn name(self) -> &'static str {
+        match self {
+            HostEvent::Instructions => "instructions",
+            HostEvent::Cycles => "cycles",
+            HostEvent::BranchMisses => "branch-misses",
+            HostEvent::L1iMisses => "L1-icache-misses",
+            HostEvent::DtlbMisses => "dTLB-misses",
+        }
+    }
+}
+
+#[cfg(target_os = "linux")]
+mod perf {
+    use std::{
+        fs::File,
+        io::Read,
+        os::fd::{AsRawFd, FromRawFd},
+    };
+
+    use anyhow::{bail, Result};
+    use nix::libc;
+
+    use super::HostEvent;
+
+    const PERF_TYPE_HARDWARE: u32 = 0;
+    const PERF_TYPE_HW_CACHE: u32 = 3;
+
+    const PERF_COUNT_HW_CPU_CYCLES: u64 = 0;
+    const PERF_COUNT_HW_INSTRUCTIONS: u64 = 1;
+    const PERF_COUNT_HW_BRANCH_MISSES: u64 = 5;
+
+    // Cache events are cache | op << 8 | result << 16
+    const PERF_COUNT_HW_CACHE_L1I: u64 = 1;
+    const PERF_COUNT_HW_CACHE_DTLB: u64 = 3;
+    const PERF_COUNT_HW_CACHE_OP_READ: u64 = 0;
+    const PERF_COUNT_HW_CACHE_RESULT_MISS: u64 = 1;
+
+    const PERF_FORMAT_TOTAL_TIME_ENABLED: u64 = 1 << 0;
+    const PERF_FORMAT_TOTAL_TIME_RUNNING: u64 = 1 << 1;
+
+    const ATTR_DISABLED: u64 = 1 << 0;
+    const ATTR_EXCLUDE_KERNEL: u64 = 1 << 5;
+    const ATTR_EXCLUDE_HV: u64 = 1 << 6;
+
+    const PERF_EVENT_IOC_ENABLE: libc::c_ulong = 0x2400;
+    const PERF_EVENT_IOC_DISABLE: libc::c_ulong = 0x2401;
+    const PERF_EVENT_IOC_RESET: libc::c_ulong = 0x2403;
+
+    // PERF_ATTR_SIZE_VER0, the kernel zero-extends the fields that follow
+    #[repr(C)]
+    #[derive(Default)]
+    struct PerfEventAttr {
+        event_type: u32,
+        size: u32,
+        config: u64,
+        sample_period: u64,
+        sample_type: u64,
+        read_format: u64,
+        flags: u64,
+        wakeup_events: u32,
+        bp_type: u32,
+        config1: u64,
+    }
+
+    impl HostEvent {
+        fn type_and_config(self) -> (u32, u64) {
+            let cache_miss = |cache: u64| {
+                cache | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16
+            };
+            match self {
+                HostEvent::Instructions => (PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS),
+                HostEvent::Cycles => (PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES),
+                HostEvent::BranchMisses => (PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES),
+                HostEvent::L1iMisses => (PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_L1I)),
+                HostEvent::DtlbMisses => (PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_DTLB)),
+            }
+        }
+
+        fn open(self) -> Result<File> {
+            let (event_type, config) = self.type_and_config();
+            let attr = PerfEventAttr {
+                event_type,
+                size: std::mem::size_of::<PerfEventAttr>() as u32,
+                config,
+                read_format: PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING,
+                flags: ATTR_DISABLED | ATTR_EXCLUDE_KERNEL | ATTR_EXCLUDE_HV,
+                ..Default::default()
+            };
+            // pid 0 and cpu -1 count the calling thread on any CPU
+            let fd = unsafe {
+                libc::syscall(
+                    libc::SYS_perf_event_open,
+                    &attr as *const PerfEventAttr,
+                    0,
+                    -1,
+                    -1,
+                    0,
+                )
+            };
+            if fd < 0 {
+                bail!(
+                    "perf_event_open {}: {}",
+                    self.name(),
+                    std::io::Error::last_os_error()
+                );
+            }
+            Ok(unsafe { File::from_raw_fd(fd as i32) })
+        }
+    }
+
+    // Hardware counters of the host read through perf_event_open(2), counting
+    // the calling thread in user space
+    pub struct HostCounters {
+        counters: Vec<(HostEvent, File)>,
+    }
+
+    impl HostCounters {
+        // Events the host or its permissions don't support are left out,
+        // fails only if none could be opened
+        pub fn open() -> Result<HostCounters> {
+            let mut counters = Vec::new();
+            let mut last_error = None;
+            for event in HostEvent::ALL {
+                match event.open() {
+                    Ok(file) => counters.push((event, file)),
+                    Err(e) => last_error = Some(e),
+                }
+            }
+            match last_error {
+                Some(e) if counters.is_empty() => Err(e),
+                _ => Ok(HostCounters { counters }),
+            }
+        }
+
+        pub fn events(&self) -> Vec<HostEvent> {
+            self.counters.iter().map(|(event, _)| *event).collect()
+        }
+
+        fn ioctl(&self, request: libc::c_ulong) {
+            for (_, file) in &self.counters {
+                unsafe { libc::ioctl(file.as_raw_fd(), request, 0) };
+            }
+        }
+
+        pub fn start(&self) {
+            self.ioctl(PERF_EVENT_IOC_RESET);
+            self.ioctl(PERF_EVENT_IOC_ENABLE);
+        }
+
+        pub fn stop(&self) {
+            self.ioctl(PERF_EVENT_IOC_DISABLE);
+        }
+
+        // Counts since start, scaled up when the kernel multiplexed the counters
+        pub fn read(&mut self) -> Result<Vec<(HostEvent, u64)>> {
+            let mut values = Vec::with_capacity(self.counters.len());
+            for (event, file) in &mut self.counters {
+                let mut buf = [0u8; 24];
+                file.read_exact(&mut buf)?;
+                let word = |i: usize| u64::from_ne_bytes(buf[i * 8..i * 8 + 8].try_into().unwrap());
+                let (value, enabled, running) = (word(0), word(1), word(2));
+                let scaled = if running == 0 {
+                    0
+                } else {
+                    (value as u128 * enabled as u128 / running as u128) as u64
+                };
+                values.push((*event, scaled));
+            }
+            Ok(values)
+        }
+    }
+}
+
+// perf_event_open(2) is Linux only, elsewhere opening fails and callers run without counters
+#[cfg(not(target_os = "linux"))]
+mod unsupported {
+    use anyhow::{bail, Result};
+
+    use super::HostEvent;
+
+    pub struct HostCounters;
+
+    impl HostCounters {
+        pub fn open() -> Result<HostCounters> {
+            bail!("host counters need perf_event_open, which is Linux only")
+        }
+
+        pub fn events(&self) -> Vec<HostEvent> {
+            Vec::new()
+        }
+
+        pub fn start(&self) {}
+
+        pub fn stop(&self) {}
+
+        pub fn read(&mut self) -> Result<Vec<(HostEvent, u64)>> {
+            Ok(Vec::new())
+        }
+    }
+}
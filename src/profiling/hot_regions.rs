@@ -0,0 +1,67 @@
+use std::io::{self, Write};
+
+use crate::{cpu::memory::program_cache::LoopCounter, elf::symbol_table::SymbolTable};
+
+// Loops closed by backward branches and jumps, the candidates for a block cache or JIT
+pub fn write_hot_regions(
+    out: &mut dyn Write,
+    loops: &[LoopCounter],
+    symbols: &SymbolTable,
+    total_instructions: u64,
+    top: usize,
+) -> io::Result<()> {
+    let mut loops = loops.to_vec();
+
+    writeln!(out, "Hot loops by instructions retired (estimated):")?;
+    loops.sort_by(|a, b| {
+        b.estimated_instructions()
+            .cmp(&a.estimated_instructions())
+            .then(a.target.cmp(&b.target))
+    });
+    write_loops(
+        out,
+        &loops[..top.min(loops.len())],
+        symbols,
+        total_instructions,
+    )?;
+
+    writeln!(out, "Hot loops by iterations:")?;
+    loops.sort_by(|a, b| {
+        b.iterations
+            .cmp(&a.iterations)
+            .then(a.target.cmp(&b.target))
+    });
+    write_loops(
+        out,
+        &loops[..top.min(loops.len())],
+        symbols,
+        total_instructions,
+    )
+}
+
+fn write_loops(
+    out: &mut dyn Write,
+    loops: &[LoopCounter],
+    symbols: &SymbolTable,
+    total_instructions: u64,
+) -> io::Result<()> {
+    writeln!(
+        out,
+        "  {:>7} {:>14} {:>12} {:>6}  header",
+        "share", "instructions", "iterations", "body"
+    )?;
+    for counter in loops {
+        let instructions = counter.estimated_instructions();
+        writeln!(
+            out,
+            "  {:6.2}% {:>14} {:>12} {:>6}  {:#010x} {}",
+            instructions as f64 * 100.0 / total_instructions.max(1) as f64,
+            instructions,
+            counter.iterations,
+            counter.body_instructions(),
+            counter.target,
+            symbols.symbolize(counter.target)
+        )?;
+    }
+    Ok(())
+}
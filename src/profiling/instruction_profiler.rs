@@ -0,0 +1,169 @@
+use std::io::{self, Write};
+
+use rustc_hash::FxHashMap;
+
+use crate::{
+    cpu::instrumentation::Instrumentation,
+    elf::symbol_table::SymbolTable,
+    types::{InstructionType, ProgramLine},
+};
+
+#[derive(Clone, Copy, Debug)]
+pub struct PcStats {
+    pub name: &'static str,
+    pub count: u64,
+    // Conditional branches only
+    pub is_branch: bool,
+    pub taken: u64,
+}
+
+// Counts every retired instruction by PC. Opcode and per-function totals are
+// aggregated from the PC histogram when a report is written.
+pub struct InstructionProfiler {
+    pcs: FxHashMap<u64, PcStats>,
+    pub symbols: SymbolTable,
+}
+
+impl InstructionProfiler {
+    pub fn new(symbols: SymbolTable) -> InstructionProfiler {
+        InstructionProfiler {
+            pcs: FxHashMap::default(),
+            symbols,
+        }
+    }
+
+    pub fn pc_stats(&self, pc: u64) -> Option<&PcStats> {
+        self.pcs.get(&pc)
+    }
+
+    pub fn total(&self) -> u64 {
+        self.pcs.values().map(|stats| stats.count).sum()
+    }
+
+    // Sorted by count, most frequent first
+    pub fn opcode_counts(&self) -> Vec<(&'static str, u64)> {
+        let mut counts = FxHashMap::<&'static str, u64>::default();
+        for stats in self.pcs.values() {
+            *counts.entry(stats.name).or_default() += stats.count;
+        }
+        sorted_by_count(counts.into_iter().collect())
+    }
+
+    pub fn function_counts(&self) -> Vec<(String, u64)> {
+        let mut counts = FxHashMap::<String, u64>::default();
+        for (pc, stats) in &self.pcs {
+            *counts.entry(self.symbols.function_name(*pc)).or_default() += stats.count;
+        }
+        sorted_by_count(counts.into_iter().collect())
+    }
+
+    pub fn pc_counts(&self) -> Vec<(u64, PcStats)> {
+        let mut pcs: Vec<(u64, PcStats)> = self.pcs.iter().map(|(pc, s)| (*pc, *s)).collect();
+        pcs.sort_by(|a, b| b.1.count.cmp(&a.1.count).then(a.0.cmp(&b.0)));
+        pcs
+    }
+
+    // One `function;function+0xoffset count` line per PC, for flamegraph.pl and speedscope
+    pub fn write_folded(&self, out: &mut dyn Write) -> io::Result<()> {
+        let mut pcs: Vec<(u64, u64)> = self.pcs.iter().map(|(pc, s)| (*pc, s.count)).collect();
+        pcs.sort_unstable();
+        for (pc, count) in pcs {
+            writeln!(
+                out,
+                "{};{} {}",
+                self.symbols.function_name(pc),
+                self.symbols.symbolize(pc),
+                count
+            )?;
+        }
+        Ok(())
+    }
+
+    pub fn write_summary(&self, out: &mut dyn Write, top: usize) -> io::Result<()> {
+        let total = self.total().max(1) as f64;
+
+        writeln!(out, "Hot functions:")?;
+        for (name, count) in self.function_counts().into_iter().take(top) {
+            writeln!(
+                out,
+                "  {:6.2}% {:>12} {}",
+                percent(count, total),
+                count,
+                name
+            )?;
+        }
+
+        writeln!(out, "Hot instructions:")?;
+        for (pc, stats) in self.pc_counts().into_iter().take(top) {
+            writeln!(
+                out,
+                "  {:6.2}% {:>12} {:#010x} {:8} {}",
+                percent(stats.count, total),
+                stats.count,
+                pc,
+                stats.name,
+                self.symbols.symbolize(pc)
+            )?;
+        }
+
+        writeln!(out, "Opcodes:")?;
+        for (name, count) in self.opcode_counts().into_iter().take(top) {
+            writeln!(
+                out,
+                "  {:6.2}% {:>12} {}",
+                percent(count, total),
+                count,
+                name
+            )?;
+        }
+
+        writeln!(out, "Hot branches (taken ratio):")?;
+        for (pc, stats) in self
+            .pc_counts()
+            .into_iter()
+            .filter(|(_, stats)| stats.is_branch)
+            .take(top)
+        {
+            writeln!(
+                out,
+                "  {:6.2}% {:>12} {:#010x} {:8} {}",
+                percent(stats.taken, stats.count as f64),
+                stats.count,
+                pc,
+                stats.name,
+                self.symbols.symbolize(pc)
+            )?;
+        }
+        Ok(())
+    }
+}
+
+impl Instrumentation for InstructionProfiler {
+    const REGISTER_WRITES: bool = false;
+    const MEM_ACCESSES: bool = false;
+    const BRANCHES: bool = false;
+    const SYSCALLS: bool = false;
+
+    #[inline(always)]
+    fn on_retire(&mut self, pc: u64, line: &ProgramLine, next_pc: u64) {
+        let stats = self.pcs.entry(pc).or_insert(PcStats {
+            name: line.instruction.name,
+            count: 0,
+            is_branch: line.instruction.instruction_type == InstructionType::SB,
+            taken: 0,
+        });
+        stats.count += 1;
+        if stats.is_branch && next_pc != pc + 4 {
+            stats.taken += 1;
+        }
+    }
+}
+
+fn percent(count: u64, total: f64) -> f64 {
+    count as f64 * 100.0 / total
+}
+
+fn sorted_by_count<T: Ord>(mut counts: Vec<(T, u64)>) -> Vec<(T, u64)> {
+    counts.sort_by(|a, b| b.1.cmp(&a.1).then(a.0.cmp(&b.0)));
+    counts
+}
@@ -0,0 +1,530 @@
+use std::{
+    fmt,
+    io::{self, Write},
+    str::FromStr,
+};
+
+use anyhow::{bail, Context, Result};
+use rustc_hash::FxHashMap;
+
+use crate::{
+    cpu::instrumentation::{BranchKind, Instrumentation, MemAccessKind},
+    elf::symbol_table::SymbolTable,
+    types::ProgramLine,
+};
+
+const PAGE_SHIFT: u32 = 12;
+
+const OPCODE_MASK: u32 = 0x7F;
+const OPCODE_SYSTEM: u32 = 0x73;
+const SFENCE_VMA_MASK: u32 = 0xFE007FFF;
+const SFENCE_VMA: u32 = 0x12000073;
+const CSR_SATP: u32 = 0x180;
+
+// `size:ways:line_size`, sizes accept K and M suffixes, e.g. `32K:8:64`
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub struct CacheConfig {
+    pub size: usize,
+    pub ways: usize,
+    pub line_size: usize,
+}
+
+impl CacheConfig {
+    pub const fn new(size: usize, ways: usize, line_size: usize) -> CacheConfig {
+        CacheConfig {
+            size,
+            ways,
+            line_size,
+        }
+    }
+}
+
+impl FromStr for CacheConfig {
+    type Err = anyhow::Error;
+
+    fn from_str(s: &str) -> Result<CacheConfig> {
+        let parts: Vec<&str> = s.split(':').collect();
+        let [size, ways, line_size] = parts[..] else {
+            bail!("Expected size:ways:line_size, got {}", s);
+        };
+        let config = CacheConfig::new(
+            parse_size(size)?,
+            ways.parse().context("Invalid way count")?,
+            parse_size(line_size)?,
+        );
+        if !config.line_size.is_power_of_two() || config.ways == 0 {
+            bail!("Line size must be a power of two and ways non-zero");
+        }
+        let sets = config.size / (config.ways * config.line_size);
+        if sets == 0
+            || !sets.is_power_of_two()
+            || sets * config.ways * config.line_size != config.size
+        {
+            bail!("{} does not give a power of two number of sets", s);
+        }
+        Ok(config)
+    }
+}
+
+impl fmt::Display for CacheConfig {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        write!(
+            f,
+            "{}K {}-way {}B lines",
+            self.size / 1024,
+            self.ways,
+            self.line_size
+        )
+    }
+}
+
+fn parse_size(s: &str) -> Result<usize> {
+    let (digits, multiplier) = match s.as_bytes().last() {
+        Some(b'K' | b'k') => (&s[..s.len() - 1], 1 << 10),
+        Some(b'M' | b'm') => (&s[..s.len() - 1], 1 << 20),
+        _ => (s, 1),
+    };
+    let value: usize = digits
+        .parse()
+        .with_context(|| format!("Invalid size {}", s))?;
+    Ok(value * multiplier)
+}
+
+// Latencies are in cycles and added on top of one cycle per instruction
+#[derive(Clone, Copy, Debug)]
+pub struct MicroarchConfig {
+    pub l1i: CacheConfig,
+    pub l1d: CacheConfig,
+    pub l2: CacheConfig,
+    pub tlb_entries: usize,
+    pub tlb_ways: usize,
+    // Bits of global history and log2 of the gshare counter table
+    pub history_bits: u32,
+    pub l2_latency: u64,
+    pub memory_latency: u64,
+    // Sv39 walks three levels, the page table entries are not cached
+    pub page_walk_latency: u64,
+    pub mispredict_penalty: u64,
+}
+
+impl Default for MicroarchConfig {
+    fn default() -> Self {
+        MicroarchConfig {
+            l1i: CacheConfig::new(32 << 10, 8, 64),
+            l1d: CacheConfig::new(32 << 10, 8, 64),
+            l2: CacheConfig::new(512 << 10, 8, 64),
+            tlb_entries: 64,
+            tlb_ways: 4,
+            history_bits: 12,
+            l2_latency: 12,
+            memory_latency: 100,
+            page_walk_latency: 30,
+            mispredict_penalty: 10,
+        }
+    }
+}
+
+#[derive(Clone, Copy, Default, Debug, PartialEq, Eq)]
+pub struct CacheStats {
+    pub accesses: u64,
+    pub misses: u64,
+}
+
+impl CacheStats {
+    pub fn miss_rate(&self) -> f64 {
+        percent(self.misses, self.accesses)
+    }
+}
+
+// Set-associative with LRU replacement, tags are addresses shifted by `shift`
+pub struct Cache {
+    tags: Vec<u64>,
+    stamps: Vec<u64>,
+    ways: usize,
+    set_mask: u64,
+    shift: u32,
+    clock: u64,
+    pub stats: CacheStats,
+}
+
+impl Cache {
+    pub fn new(config: CacheConfig) -> Cache {
+        Self::with_geometry(
+            config.size / (config.ways * config.line_size),
+            config.ways,
+            config.line_size.trailing_zeros(),
+        )
+    }
+
+    fn with_geometry(sets: usize, ways: usize, shift: u32) -> Cache {
+        assert!(sets.is_power_of_two() && ways != 0);
+        Cache {
+            tags: vec![u64::MAX; sets * ways],
+            stamps: vec![0; sets * ways],
+            ways,
+            set_mask: sets as u64 - 1,
+            shift,
+            clock: 0,
+            stats: CacheStats::default(),
+        }
+    }
+
+    // Returns true on a hit, a miss fills the least recently used way
+    #[inline(always)]
+    pub fn access(&mut self, addr: u64) -> bool {
+        let tag = addr >> self.shift;
+        let base = (tag & self.set_mask) as usize * self.ways;
+        let tags = &self.tags[base..base + self.ways];
+        self.clock += 1;
+        self.stats.accesses += 1;
+        if let Some(way) = tags.iter().position(|&t| t == tag) {
+            self.stamps[base + way] = self.clock;
+            return true;
+        }
+        self.stats.misses += 1;
+        let stamps = &self.stamps[base..base + self.ways];
+        let victim = (0..self.ways).min_by_key(|&way| stamps[way]).unwrap();
+        self.tags[base + victim] = tag;
+        self.stamps[base + victim] = self.clock;
+        false
+    }
+
+    pub fn flush(&mut self) {
+        self.tags.fill(u64::MAX);
+    }
+}
+
+// SFENCE.VMA and CSR instructions that write satp, CSRRS/CSRRC only write with rs1 != x0
+fn flushes_translations(word: u32) -> bool {
+    if word & SFENCE_VMA_MASK == SFENCE_VMA {
+        return true;
+    }
+    let funct3 = (word >> 12) & 0x7;
+    let rs1 = (word >> 15) & 0x1F;
+    word & OPCODE_MASK == OPCODE_SYSTEM
+        && word >> 20 == CSR_SATP
+        && match funct3 {
+            1 | 5 => true,
+            2 | 3 | 6 | 7 => rs1 != 0,
+            _ => false,
+        }
+}
+
+#[derive(Clone, Copy, Default, Debug, PartialEq, Eq)]
+pub struct BranchStats {
+    pub branches: u64,
+    pub mispredicts: u64,
+}
+
+// gshare for conditional branches and a direct-mapped target buffer for
+// JALR. JAL targets are known at decode and never mispredict.
+pub struct BranchPredictor {
+    counters: Vec<u8>,
+    history: u64,
+    history_mask: u64,
+    targets: Vec<u64>,
+    pub stats: BranchStats,
+}
+
+const TARGET_BUFFER_ENTRIES: usize = 1024;
+
+impl BranchPredictor {
+    pub fn new(history_bits: u32) -> BranchPredictor {
+        BranchPredictor {
+            // Weakly not taken
+            counters: vec![1; 1 << history_bits],
+            history: 0,
+            history_mask: (1 << history_bits) - 1,
+            targets: vec![0; TARGET_BUFFER_ENTRIES],
+            stats: BranchStats::default(),
+        }
+    }
+
+    // Returns true when the branch was mispredicted
+    #[inline(always)]
+    pub fn predict(&mut self, pc: u64, kind: BranchKind, target: u64, taken: bool) -> bool {
+        let mispredicted = match kind {
+            BranchKind::Conditional => {
+                let index = (((pc >> 1) ^ self.history) & self.history_mask) as usize;
+                let counter = &mut self.counters[index];
+                let predicted = *counter >= 2;
+                *counter = if taken {
+                    (*counter + 1).min(3)
+                } else {
+                    counter.saturating_sub(1)
+                };
+                self.history = (self.history << 1 | taken as u64) & self.history_mask;
+                predicted != taken
+            }
+            BranchKind::Jump => false,
+            BranchKind::Indirect => {
+                let entry = &mut self.targets[(pc >> 1) as usize % TARGET_BUFFER_ENTRIES];
+                let predicted = *entry;
+                *entry = target;
+                predicted != target
+            }
+        };
+        self.stats.branches += 1;
+        self.stats.mispredicts += mispredicted as u64;
+        mispredicted
+    }
+}
+
+#[derive(Clone, Copy, Default, Debug)]
+pub struct PcCosts {
+    pub instructions: u64,
+    pub cycles: u64,
+    pub l1i_misses: u64,
+    pub l1d_accesses: u64,
+    pub l1d_misses: u64,
+    pub l2_misses: u64,
+    pub tlb_accesses: u64,
+    pub tlb_misses: u64,
+    pub branches: u64,
+    pub mispredicts: u64,
+}
+
+impl PcCosts {
+    fn add(&mut self, other: &PcCosts) {
+        self.instructions += other.instructions;
+        self.cycles += other.cycles;
+        self.l1i_misses += other.l1i_misses;
+        self.l1d_accesses += other.l1d_accesses;
+        self.l1d_misses += other.l1d_misses;
+        self.l2_misses += other.l2_misses;
+        self.tlb_accesses += other.tlb_accesses;
+        self.tlb_misses += other.tlb_misses;
+        self.branches += other.branches;
+        self.mispredicts += other.mispredicts;
+    }
+
+    pub fn cpi(&self) -> f64 {
+        self.cycles as f64 / self.instructions.max(1) as f64
+    }
+}
+
+// In-order core model driven by the run loop hooks. Every instruction costs
+// one cycle plus the latency of its cache, TLB and branch predictor misses.
+// Events are accumulated for the current instruction and charged to its PC
+// when it retires. The TLB is unified, fetches and data accesses share it, and
+// it is flushed when the guest writes satp or executes SFENCE.VMA.
+pub struct MicroarchModel {
+    config: MicroarchConfig,
+    pub l1i: Cache,
+    pub l1d: Cache,
+    pub l2: Cache,
+    pub tlb: Cache,
+    pub predictor: BranchPredictor,
+    pub symbols: SymbolTable,
+    pcs: FxHashMap<u64, PcCosts>,
+    current: PcCosts,
+    last_fetch_line: u64,
+}
+
+impl MicroarchModel {
+    pub fn new(config: MicroarchConfig, symbols: SymbolTable) -> MicroarchModel {
+        MicroarchModel {
+            l1i: Cache::new(config.l1i),
+            l1d: Cache::new(config.l1d),
+            l2: Cache::new(config.l2),
+            tlb: Cache::with_geometry(
+                config.tlb_entries / config.tlb_ways,
+                config.tlb_ways,
+                PAGE_SHIFT,
+            ),
+            predictor: BranchPredictor::new(config.history_bits),
+            symbols,
+            pcs: FxHashMap::default(),
+            current: PcCosts::default(),
+            last_fetch_line: u64::MAX,
+            config,
+        }
+    }
+
+    #[inline(always)]
+    fn translate(&mut self, addr: u64) {
+        self.current.tlb_accesses += 1;
+        if !self.tlb.access(addr) {
+            self.current.tlb_misses += 1;
+            self.current.cycles += self.config.page_walk_latency;
+        }
+    }
+
+    // Returns the L1 miss latency
+    #[inline(always)]
+    fn miss_latency(&mut self, addr: u64) -> u64 {
+        if self.l2.access(addr) {
+            self.config.l2_latency
+        } else {
+            self.current.l2_misses += 1;
+            self.config.l2_latency + self.config.memory_latency
+        }
+    }
+
+    pub fn totals(&self) -> PcCosts {
+        let mut totals = PcCosts::default();
+        for costs in self.pcs.values() {
+            totals.add(costs);
+        }
+        totals
+    }
+
+    pub fn pc_costs(&self, pc: u64) -> Option<&PcCosts> {
+        self.pcs.get(&pc)
+    }
+
+    // Sorted by cycles, most expensive first
+    pub fn function_costs(&self) -> Vec<(String, PcCosts)> {
+        let mut functions = FxHashMap::<String, PcCosts>::default();
+        for (pc, costs) in &self.pcs {
+            functions
+                .entry(self.symbols.function_name(*pc))
+                .or_default()
+                .add(costs);
+        }
+        let mut functions: Vec<(String, PcCosts)> = functions.into_iter().collect();
+        functions.sort_by(|a, b| b.1.cycles.cmp(&a.1.cycles).then(a.0.cmp(&b.0)));
+        functions
+    }
+
+    pub fn write_summary(&self, out: &mut dyn Write) -> io::Result<()> {
+        let totals = self.totals();
+        let config = &self.config;
+        writeln!(
+            out,
+            "Instructions: {} cycles: {} CPI: {:.3}",
+            totals.instructions,
+            totals.cycles,
+            totals.cpi()
+        )?;
+        for (name, config, stats) in [
+            ("L1I", config.l1i, self.l1i.stats),
+            ("L1D", config.l1d, self.l1d.stats),
+            ("L2", config.l2, self.l2.stats),
+        ] {
+            writeln!(
+                out,
+                "  {:4} {:>24} {:>12} accesses {:6.2}% misses",
+                name,
+                config.to_string(),
+                stats.accesses,
+                stats.miss_rate()
+            )?;
+        }
+        writeln!(
+            out,
+            "  TLB  {:>24} {:>12} accesses {:6.2}% misses",
+            format!("{} entries {}-way", config.tlb_entries, config.tlb_ways),
+            self.tlb.stats.accesses,
+            self.tlb.stats.miss_rate()
+        )?;
+        let branches = self.predictor.stats;
+        writeln!(
+            out,
+            "  Branches {:>32} {:6.2}% mispredicted",
+            branches.branches,
+            percent(branches.mispredicts, branches.branches)
+        )
+    }
+
+    pub fn write_report(&self, out: &mut dyn Write) -> io::Result<()> {
+        self.write_summary(out)?;
+        writeln!(
+            out,
+            "{:>14} {:>14} {:>7} {:>8} {:>8} {:>8} {:>8} {:>8}  function",
+            "instructions",
+            "cycles",
+            "CPI",
+            "L1I miss",
+            "L1D miss",
+            "L2 miss",
+            "TLB miss",
+            "mispred"
+        )?;
+        for (name, costs) in self.function_costs() {
+            write_function_costs(out, &name, &costs)?;
+        }
+        Ok(())
+    }
+
+    pub fn write_top_functions(&self, out: &mut dyn Write, top: usize) -> io::Result<()> {
+        writeln!(out, "Most expensive functions:")?;
+        for (name, costs) in self.function_costs().into_iter().take(top) {
+            write_function_costs(out, &name, &costs)?;
+        }
+        Ok(())
+    }
+}
+
+// Miss columns are per access, except L1I which is per instruction
+fn write_function_costs(out: &mut dyn Write, name: &str, costs: &PcCosts) -> io::Result<()> {
+    writeln!(
+        out,
+        "{:>14} {:>14} {:>7.3} {:>7.2}% {:>7.2}% {:>7.2}% {:>7.2}% {:>7.2}%  {}",
+        costs.instructions,
+        costs.cycles,
+        costs.cpi(),
+        percent(costs.l1i_misses, costs.instructions),
+        percent(costs.l1d_misses, costs.l1d_accesses),
+        percent(costs.l2_misses, costs.l1i_misses + costs.l1d_misses),
+        percent(costs.tlb_misses, costs.tlb_accesses),
+        percent(costs.mispredicts, costs.branches),
+        name
+    )
+}
+
+impl Instrumentation for MicroarchModel {
+    const REGISTER_WRITES: bool = false;
+    const SYSCALLS: bool = false;
+
+    #[inline(always)]
+    fn on_fetch(&mut self, pc: u64, _line: &ProgramLine) {
+        self.current.cycles += 1;
+        // Sequential fetches from the same line always hit the TLB and L1I
+        let fetch_line = pc >> self.l1i.shift;
+        if fetch_line == self.last_fetch_line {
+            return;
+        }
+        self.last_fetch_line = fetch_line;
+        self.translate(pc);
+        if !self.l1i.access(pc) {
+            self.current.l1i_misses += 1;
+            self.current.cycles += self.miss_latency(pc);
+        }
+    }
+
+    #[inline(always)]
+    fn on_mem_access(&mut self, addr: u64, _size: u8, _kind: MemAccessKind) {
+        self.current.l1d_accesses += 1;
+        self.translate(addr);
+        if !self.l1d.access(addr) {
+            self.current.l1d_misses += 1;
+            self.current.cycles += self.miss_latency(addr);
+        }
+    }
+
+    #[inline(always)]
+    fn on_branch(&mut self, pc: u64, kind: BranchKind, target: u64, taken: bool) {
+        self.current.branches += 1;
+        if self.predictor.predict(pc, kind, target, taken) {
+            self.current.mispredicts += 1;
+            self.current.cycles += self.config.mispredict_penalty;
+        }
+    }
+
+    #[inline(always)]
+    fn on_retire(&mut self, pc: u64, line: &ProgramLine, _next_pc: u64) {
+        self.current.instructions = 1;
+        self.pcs.entry(pc).or_default().add(&self.current);
+        self.current = PcCosts::default();
+        if flushes_translations(line.word.0) {
+            self.tlb.flush();
+            // The next fetch translates again even within the same line
+            self.last_fetch_line = u64::MAX;
+        }
+    }
+}
+
+fn percent(count: u64, total: u64) -> f64 {
+    count as f64 * 100.0 / total.max(1) as f64
+}
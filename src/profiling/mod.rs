@@ -0,0 +1,6 @@
+pub mod call_graph;
+pub mod host_counters;
+pub mod hot_regions;
+pub mod instruction_profiler;
+pub mod microarch;
+pub mod trace;
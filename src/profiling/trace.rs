@@ -0,0 +1,622 @@
+use std::{
+    fmt,
+    fs::File,
+    io::{self, BufReader, BufWriter, Read, Write},
+    mem, ptr, slice,
+    sync::mpsc::{channel, sync_channel, Receiver, SyncSender},
+    thread::{self, JoinHandle},
+};
+
+use anyhow::{bail, Context, Result};
+
+use crate::{
+    cpu::instrumentation::{integer_destination, Instrumentation, MemAccessKind},
+    types::{ProgramLine, Word},
+};
+
+// The file is a single zstd stream starting with the magic. Each retired instruction
+// is one record:
+//   flags: u8
+//   accesses    up to MAX_MEM_ACCESSES times: varint of the zigzag address - previous
+//               address << 3 | log2 size << 1 | is write
+//   [WRITEBACK] zigzag varint of value - previous value of the register the word writes
+//   [PC_JUMP]   zigzag varint, pc - (previous pc + 4)
+//   [WORD]      u32, omitted while the word cache slot of this pc already holds it
+//   [TRAP]      varint cause of the exception taken by this instruction
+//   [overflow]  varint accesses past MAX_MEM_ACCESSES that were not recorded
+//   [INTERRUPT] varint cause of the interrupt taken after this instruction retired
+const MAGIC: &[u8; 8] = b"RSTRACE3";
+
+const FLAG_PC_JUMP: u8 = 1 << 0;
+const FLAG_WORD: u8 = 1 << 1;
+const FLAG_TRAP: u8 = 1 << 2;
+const FLAG_WRITEBACK_SHIFT: u8 = 3;
+const FLAG_WRITEBACK: u8 = 1 << FLAG_WRITEBACK_SHIFT;
+const MEM_COUNT_SHIFT: u8 = 4;
+const MEM_COUNT_MASK: u8 = 0x7;
+// Access count value meaning MAX_MEM_ACCESSES were recorded and more were dropped
+const MEM_OVERFLOW: u8 = MEM_COUNT_MASK;
+const MAX_MEM_ACCESSES: usize = MEM_OVERFLOW as usize - 1;
+const FLAG_INTERRUPT: u8 = 1 << 7;
+// Set in the flags of records with a trap or more than 3 accesses, on_retire checks
+// for the parts that follow them with one test
+const RARE_PARTS: u8 = FLAG_TRAP | 4 << MEM_COUNT_SHIFT;
+
+const WORD_CACHE_SIZE: usize = 4096;
+const CHUNK_SIZE: usize = 1 << 20;
+// Upper bound of one record including an interrupt appended to it. Chunks are sent
+// once a record ends past CHUNK_SIZE, so with this much extra capacity records are
+// written without capacity checks.
+const MAX_RECORD_SIZE: usize = 128;
+// Chunks queued for the writer thread before emulation blocks on it
+const QUEUED_CHUNKS: usize = 8;
+const COMPRESSION_LEVEL: i32 = 1;
+
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub struct TraceRecord {
+    pub pc: u64,
+    pub word: u32,
+    // Exception taken by this instruction
+    pub trap: Option<u64>,
+    pub writeback: Option<(u8, u64)>,
+    pub mem: Vec<(u64, u8, MemAccessKind)>,
+    // Accesses past MAX_MEM_ACCESSES, counted but not recorded
+    pub mem_dropped: u64,
+    // Interrupt taken after this instruction retired
+    pub interrupt: Option<u64>,
+}
+
+impl fmt::Display for TraceRecord {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        write!(f, "pc={:#x} word={:#010x}", self.pc, self.word)?;
+        if let Some(cause) = self.trap {
+            write!(f, " trap={:#x}", cause)?;
+        }
+        if let Some((reg, value)) = self.writeback {
+            write!(f, " x{}={:#x}", reg, value)?;
+        }
+        for (addr, size, kind) in &self.mem {
+            write!(f, " {:?}{}@{:#x}", kind, size * 8, addr)?;
+        }
+        if self.mem_dropped != 0 {
+            write!(f, " (+{} accesses)", self.mem_dropped)?;
+        }
+        if let Some(cause) = self.interrupt {
+            write!(f, " interrupt={:#x}", cause)?;
+        }
+        Ok(())
+    }
+}
+
+// State shared by the encoder and decoder, both sides update it identically
+struct DeltaState {
+    // Fall-through of the previous record
+    next_pc: u64,
+    regs: [u64; 32],
+    mem_addr: u64,
+    words: [u32; WORD_CACHE_SIZE],
+}
+
+impl DeltaState {
+    fn new() -> DeltaState {
+        DeltaState {
+            next_pc: 0,
+            regs: [0; 32],
+            mem_addr: 0,
+            words: [0; WORD_CACHE_SIZE],
+        }
+    }
+
+    fn word_slot(pc: u64) -> usize {
+        ((pc >> 2) as usize) & (WORD_CACHE_SIZE - 1)
+    }
+}
+
+// Records every retired instruction. Encoding runs on the emulation thread,
+// compression and file IO on a background writer thread. The writer hands
+// compressed chunks back, so the emulation thread refills buffers that are
+// already paged in.
+pub struct TraceWriter {
+    state: DeltaState,
+    // Records are written through `end`, the length of `buf` is set when it is sent
+    buf: Vec<u8>,
+    end: *mut u8,
+    // CHUNK_SIZE bytes into `buf`, the chunk is sent once a record ends past it
+    limit: *mut u8,
+    sender: Option<SyncSender<Vec<u8>>>,
+    recycled: Receiver<Vec<u8>>,
+    worker: Option<JoinHandle<io::Result<()>>>,
+    // Flags of the record of the executing instruction, opened when the previous one
+    // retired. Accesses are encoded into it as they happen, their count and
+    // FLAG_TRAP are set in the flags right away.
+    record: *mut u8,
+    // Cause of the exception while FLAG_TRAP is set in the open record
+    trap: u64,
+    // Accesses of the open record past MAX_MEM_ACCESSES
+    mem_dropped: u64,
+    // Flags of the last retired record, interrupts are appended to it. Null while
+    // `buf` holds none.
+    last_record: *mut u8,
+}
+
+impl TraceWriter {
+    pub fn create(path: &str) -> Result<TraceWriter> {
+        let file = File::create(path).with_context(|| format!("Failed to create {}", path))?;
+        let (sender, receiver) = sync_channel::<Vec<u8>>(QUEUED_CHUNKS);
+        let (recycle, recycled) = channel();
+        let worker = thread::spawn(move || -> io::Result<()> {
+            let mut encoder = zstd::Encoder::new(BufWriter::new(file), COMPRESSION_LEVEL)?;
+            for mut chunk in receiver {
+                encoder.write_all(&chunk)?;
+                chunk.clear();
+                // The emulation thread is gone once it stopped sending
+                let _ = recycle.send(chunk);
+            }
+            encoder.finish()?.flush()
+        });
+
+        let mut buf = Vec::with_capacity(CHUNK_SIZE + MAX_RECORD_SIZE);
+        buf.extend_from_slice(MAGIC);
+        let (end, limit) = write_bounds(&mut buf);
+        let mut writer = TraceWriter {
+            state: DeltaState::new(),
+            buf,
+            end,
+            limit,
+            sender: Some(sender),
+            recycled,
+            worker: Some(worker),
+            record: ptr::null_mut(),
+            trap: 0,
+            mem_dropped: 0,
+            last_record: ptr::null_mut(),
+        };
+        writer.open_record();
+        Ok(writer)
+    }
+
+    // Reserves the flags of the next record at `end`
+    #[inline(always)]
+    fn open_record(&mut self) {
+        self.record = self.end;
+        // SAFETY: records start before `limit`, within the capacity of `buf`
+        unsafe {
+            self.record.write(0);
+            self.end = self.end.add(1);
+        }
+    }
+
+    // The last record and the open one move to the next chunk, so on_trap can still
+    // append to the former
+    #[cold]
+    #[inline(never)]
+    fn send_chunk(&mut self) {
+        let mut next = self
+            .recycled
+            .try_recv()
+            .unwrap_or_else(|_| Vec::with_capacity(CHUNK_SIZE + MAX_RECORD_SIZE));
+        // SAFETY: both records lie between last_record and `end`
+        let open_offset = unsafe {
+            next.extend_from_slice(slice::from_raw_parts(
+                self.last_record,
+                self.end.offset_from(self.last_record) as usize,
+            ));
+            self.record.offset_from(self.last_record) as usize
+        };
+        self.end = self.last_record;
+        let chunk = self.swap_buf(next);
+        self.last_record = self.buf.as_mut_ptr();
+        // SAFETY: the open record was copied along
+        self.record = unsafe { self.last_record.add(open_offset) };
+        self.send(chunk);
+    }
+
+    // Trap cause and dropped access count of the retiring record, returns the new end
+    #[cold]
+    #[inline(never)]
+    fn write_rare_parts(&mut self, end: *mut u8, flags: u8) -> *mut u8 {
+        let mut out = Cursor { end };
+        // SAFETY: the record started before `limit`
+        unsafe {
+            if flags & FLAG_TRAP != 0 {
+                out.varint(self.trap);
+            }
+            if flags >> MEM_COUNT_SHIFT == MEM_OVERFLOW {
+                out.varint(self.mem_dropped);
+                self.mem_dropped = 0;
+            }
+        }
+        out.end
+    }
+
+    // Accesses more than 2^60 bytes from the previous one need more than 64 bits
+    #[cold]
+    #[inline(never)]
+    fn write_far_access(&mut self, addr: u64, mut access: u128) {
+        let mut out = Cursor { end: self.end };
+        // SAFETY: the open record started before `limit`
+        unsafe {
+            while access >= 0x80 {
+                out.push(access as u8 | 0x80);
+                access >>= 7;
+            }
+            out.push(access as u8);
+            *self.record += 1 << MEM_COUNT_SHIFT;
+        }
+        self.end = out.end;
+        self.state.mem_addr = addr;
+    }
+
+    // Continues writing at the end of `next`, returns what was written to `buf`
+    fn swap_buf(&mut self, mut next: Vec<u8>) -> Vec<u8> {
+        // SAFETY: `end` points into `buf`, everything before it was written
+        unsafe {
+            self.buf
+                .set_len(self.end.offset_from(self.buf.as_ptr()) as usize)
+        };
+        (self.end, self.limit) = write_bounds(&mut next);
+        mem::replace(&mut self.buf, next)
+    }
+
+    fn send(&mut self, chunk: Vec<u8>) {
+        if let Some(sender) = &self.sender {
+            // A failed writer reports its error from `finish`
+            if sender.send(chunk).is_err() {
+                self.sender = None;
+            }
+        }
+    }
+
+    // Flushes buffered records and waits for the writer thread
+    pub fn finish(&mut self) -> Result<()> {
+        if self.worker.is_none() {
+            return Ok(());
+        }
+        // The instruction of the open record never retired
+        self.end = self.record;
+        self.mem_dropped = 0;
+        let chunk = self.swap_buf(Vec::with_capacity(CHUNK_SIZE + MAX_RECORD_SIZE));
+        self.last_record = ptr::null_mut();
+        self.open_record();
+        self.send(chunk);
+        self.sender = None;
+        match self.worker.take().unwrap().join() {
+            Ok(result) => result.context("Failed to write trace"),
+            Err(_) => bail!("Trace writer thread panicked"),
+        }
+    }
+}
+
+impl Drop for TraceWriter {
+    fn drop(&mut self) {
+        let _ = self.finish();
+    }
+}
+
+impl Instrumentation for TraceWriter {
+    const BRANCHES: bool = false;
+    const SYSCALLS: bool = false;
+
+    // The engine calls this after the accesses and before on_retire for every line
+    // with a destination register, so the value goes right after the accesses
+    #[inline(always)]
+    fn on_register_write(&mut self, _pc: u64, reg: u8, value: u64) {
+        let previous = &mut self.state.regs[reg as usize & 31];
+        // SAFETY: the open record started before `limit`
+        unsafe {
+            let mut out = Cursor { end: self.end };
+            out.varint(zigzag(value.wrapping_sub(*previous)));
+            self.end = out.end;
+        }
+        *previous = value;
+    }
+
+    #[inline(always)]
+    fn on_mem_access(&mut self, addr: u64, size: u8, kind: MemAccessKind) {
+        // SAFETY: the open record started before `limit`
+        unsafe {
+            let flags = *self.record;
+            if flags >> MEM_COUNT_SHIFT >= MAX_MEM_ACCESSES as u8 {
+                *self.record = flags | MEM_OVERFLOW << MEM_COUNT_SHIFT;
+                self.mem_dropped += 1;
+                return;
+            }
+            let delta = zigzag(addr.wrapping_sub(self.state.mem_addr));
+            let code = (size.trailing_zeros() as u64) << 1 | (kind == MemAccessKind::Write) as u64;
+            if delta >> 61 != 0 {
+                return self.write_far_access(addr, (delta as u128) << 3 | code as u128);
+            }
+            let mut out = Cursor { end: self.end };
+            out.varint(delta << 3 | code);
+            self.end = out.end;
+            self.state.mem_addr = addr;
+            *self.record = flags + (1 << MEM_COUNT_SHIFT);
+        }
+    }
+
+    // Exceptions are raised while the instruction executes, interrupts after it retired
+    fn on_trap(&mut self, _pc: u64, cause: u64, interrupt: bool) {
+        // SAFETY: the open record started before `limit`
+        unsafe {
+            if !interrupt {
+                *self.record |= FLAG_TRAP;
+                self.trap = cause;
+                return;
+            }
+            // Before the first retire and after `finish` there is no record to attach
+            // the interrupt to, and once the open record holds events of an
+            // instruction that never retired the last one is not at the end of `buf`.
+            // It is left out of the trace.
+            if self.last_record.is_null() || *self.record != 0 || self.end != self.record.add(1) {
+                return;
+            }
+            debug_assert!(*self.last_record & FLAG_INTERRUPT == 0);
+            *self.last_record |= FLAG_INTERRUPT;
+            let mut out = Cursor { end: self.record };
+            out.varint(cause);
+            self.end = out.end;
+        }
+        self.open_record();
+        if self.end >= self.limit {
+            self.send_chunk();
+        }
+    }
+
+    // The access count and FLAG_TRAP are already set in the flags of the open record,
+    // the other parts are written right after their checks
+    #[inline(always)]
+    fn on_retire(&mut self, pc: u64, line: &ProgramLine, _next_pc: u64) {
+        let record = self.record;
+        let state = &mut self.state;
+        let word = line.word.0;
+
+        // SAFETY: the record started before `limit`
+        unsafe {
+            let mut flags = *record | (line.rd.is_some() as u8) << FLAG_WRITEBACK_SHIFT;
+            let mut out = Cursor { end: self.end };
+            if pc != state.next_pc {
+                flags |= FLAG_PC_JUMP;
+                out.varint(zigzag(pc.wrapping_sub(state.next_pc)));
+            }
+            let cached_word = &mut state.words[DeltaState::word_slot(pc)];
+            if *cached_word != word {
+                flags |= FLAG_WORD;
+                out.bytes(word.to_le_bytes());
+                *cached_word = word;
+            }
+            state.next_pc = pc + 4;
+            if flags & RARE_PARTS != 0 {
+                out.end = self.write_rare_parts(out.end, flags);
+            }
+            record.write(flags);
+            // Opens the next record
+            out.end.write(0);
+            self.last_record = record;
+            self.record = out.end;
+            self.end = out.end.add(1);
+        }
+        if self.end >= self.limit {
+            self.send_chunk();
+        }
+    }
+}
+
+pub struct TraceReader {
+    state: DeltaState,
+    input: BufReader<zstd::Decoder<'static, BufReader<File>>>,
+}
+
+impl TraceReader {
+    pub fn open(path: &str) -> Result<TraceReader> {
+        let file = File::open(path).with_context(|| format!("Failed to open {}", path))?;
+        let mut input = BufReader::new(zstd::Decoder::new(file)?);
+        let mut magic = [0u8; 8];
+        input
+            .read_exact(&mut magic)
+            .with_context(|| format!("{} is not a trace", path))?;
+        if &magic != MAGIC {
+            bail!("{} is not a trace", path);
+        }
+        Ok(TraceReader {
+            state: DeltaState::new(),
+            input,
+        })
+    }
+
+    fn read_u8(&mut self) -> Result<u8> {
+        let mut byte = [0u8; 1];
+        self.input
+            .read_exact(&mut byte)
+            .context("Truncated trace")?;
+        Ok(byte[0])
+    }
+
+    fn read_varint(&mut self) -> Result<u64> {
+        Ok(self.read_wide_varint()? as u64)
+    }
+
+    // Accesses carry 3 bits next to a 64 bit delta
+    fn read_wide_varint(&mut self) -> Result<u128> {
+        let mut value = 0u128;
+        let mut shift = 0;
+        loop {
+            let byte = self.read_u8()?;
+            value |= ((byte & 0x7F) as u128) << shift;
+            if byte & 0x80 == 0 {
+                return Ok(value);
+            }
+            shift += 7;
+            if shift >= 70 {
+                bail!("Invalid varint in trace");
+            }
+        }
+    }
+
+    // None at the end of the trace
+    pub fn next_record(&mut self) -> Result<Option<TraceRecord>> {
+        let mut flags = [0u8; 1];
+        if self.input.read(&mut flags)? == 0 {
+            return Ok(None);
+        }
+        let flags = flags[0];
+
+        let mem_count = (flags >> MEM_COUNT_SHIFT) & MEM_COUNT_MASK;
+        let mut mem = Vec::new();
+        for _ in 0..(mem_count as usize).min(MAX_MEM_ACCESSES) {
+            let access = self.read_wide_varint()?;
+            let addr = self
+                .state
+                .mem_addr
+                .wrapping_add(unzigzag((access >> 3) as u64));
+            let kind = if access & 1 != 0 {
+                MemAccessKind::Write
+            } else {
+                MemAccessKind::Read
+            };
+            mem.push((addr, 1 << ((access >> 1) & 3), kind));
+            self.state.mem_addr = addr;
+        }
+
+        let writeback_delta = if flags & FLAG_WRITEBACK != 0 {
+            Some(unzigzag(self.read_varint()?))
+        } else {
+            None
+        };
+
+        let mut pc = self.state.next_pc;
+        if flags & FLAG_PC_JUMP != 0 {
+            pc = pc.wrapping_add(unzigzag(self.read_varint()?));
+        }
+
+        let slot = DeltaState::word_slot(pc);
+        let word = if flags & FLAG_WORD != 0 {
+            let mut bytes = [0u8; 4];
+            self.input
+                .read_exact(&mut bytes)
+                .context("Truncated trace")?;
+            let word = u32::from_le_bytes(bytes);
+            self.state.words[slot] = word;
+            word
+        } else {
+            self.state.words[slot]
+        };
+
+        let writeback = match writeback_delta {
+            Some(delta) => {
+                let reg =
+                    integer_destination(Word(word)).context("Writeback without a destination")?;
+                let value = self.state.regs[reg as usize].wrapping_add(delta);
+                self.state.regs[reg as usize] = value;
+                Some((reg, value))
+            }
+            None => None,
+        };
+
+        let trap = if flags & FLAG_TRAP != 0 {
+            Some(self.read_varint()?)
+        } else {
+            None
+        };
+
+        let mem_dropped = if mem_count == MEM_OVERFLOW {
+            self.read_varint()?
+        } else {
+            0
+        };
+
+        let interrupt = if flags & FLAG_INTERRUPT != 0 {
+            Some(self.read_varint()?)
+        } else {
+            None
+        };
+
+        self.state.next_pc = pc + 4;
+        Ok(Some(TraceRecord {
+            pc,
+            word,
+            trap,
+            writeback,
+            mem,
+            mem_dropped,
+            interrupt,
+        }))
+    }
+}
+
+#[derive(Debug)]
+pub struct TraceMismatch {
+    // Index of the first differing record
+    pub index: u64,
+    // None where one trace ended early
+    pub left: Option<TraceRecord>,
+    pub right: Option<TraceRecord>,
+}
+
+// Walks both traces in lockstep, None if they are identical
+pub fn diff_traces(
+    left: &mut TraceReader,
+    right: &mut TraceReader,
+) -> Result<Option<TraceMismatch>> {
+    let mut index = 0;
+    loop {
+        let (a, b) = (left.next_record()?, right.next_record()?);
+        if a.is_none() && b.is_none() {
+            return Ok(None);
+        }
+        if a != b {
+            return Ok(Some(TraceMismatch {
+                index,
+                left: a,
+                right: b,
+            }));
+        }
+        index += 1;
+    }
+}
+
+fn zigzag(value: u64) -> u64 {
+    (value << 1) ^ ((value as i64 >> 63) as u64)
+}
+
+fn unzigzag(value: u64) -> u64 {
+    (value >> 1) ^ (value & 1).wrapping_neg()
+}
+
+// Write position and limit of a chunk buffer
+fn write_bounds(buf: &mut Vec<u8>) -> (*mut u8, *mut u8) {
+    debug_assert!(buf.capacity() >= CHUNK_SIZE + MAX_RECORD_SIZE);
+    let start = buf.as_mut_ptr();
+    // SAFETY: chunk buffers have CHUNK_SIZE + MAX_RECORD_SIZE bytes of capacity
+    unsafe { (start.add(buf.len()), start.add(CHUNK_SIZE)) }
+}
+
+// Writes past the end of a buffer without capacity checks
+struct Cursor {
+    end: *mut u8,
+}
+
+impl Cursor {
+    // SAFETY: the buffer must have spare capacity for the byte
+    #[inline(always)]
+    unsafe fn push(&mut self, byte: u8) {
+        self.end.write(byte);
+        self.end = self.end.add(1);
+    }
+
+    // SAFETY: the buffer must have spare capacity for the bytes
+    #[inline(always)]
+    unsafe fn bytes<const N: usize>(&mut self, bytes: [u8; N]) {
+        (self.end as *mut [u8; N]).write_unaligned(bytes);
+        self.end = self.end.add(N);
+    }
+
+    // SAFETY: the buffer must have spare capacity for 10 bytes
+    #[inline(always)]
+    unsafe fn varint(&mut self, mut value: u64) {
+        while value >= 0x80 {
+            self.push(value as u8 | 0x80);
+            value >>= 7;
+        }
+        self.push(value as u8);
+    }
+}
@@ -0,0 +1,143 @@
+use std::time::Duration;
+
+use anyhow::{Context, Result};
+use nix::time::{clock_gettime, ClockId};
+
+pub const CLOCK_REALTIME: u64 = 0;
+
+pub const DEFAULT_VIRTUAL_CLOCK_HZ: u64 = 100_000_000;
+
+const NANOS_PER_SEC: u64 = 1_000_000_000;
+
+// Instruction count to nanoseconds is a multiply and shift, like the vDSO clocksource
+const CLOCK_SHIFT: u32 = 32;
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum ClockSource {
+    Host,
+    Virtual,
+}
+
+#[derive(Clone, Debug)]
+pub struct GuestClock {
+    source: ClockSource,
+    frequency_hz: u64,
+    mult: u64,
+    // Frequency of the time CSR, ticks are derived from retired instructions too
+    timebase_hz: u64,
+    tick_mult: u64,
+    epoch_ns: u64,
+    skipped_ns: u64,
+}
+
+impl Default for GuestClock {
+    fn default() -> Self {
+        Self::new_host()
+    }
+}
+
+impl GuestClock {
+    pub fn new_host() -> Self {
+        GuestClock {
+            source: ClockSource::Host,
+            frequency_hz: DEFAULT_VIRTUAL_CLOCK_HZ,
+            mult: Self::compute_mult(DEFAULT_VIRTUAL_CLOCK_HZ),
+            timebase_hz: DEFAULT_VIRTUAL_CLOCK_HZ,
+            tick_mult: 1 << CLOCK_SHIFT,
+            epoch_ns: 0,
+            skipped_ns: 0,
+        }
+    }
+
+    // Time advances by 1/frequency_hz per retired instruction, scaled with mult and
+    // CLOCK_SHIFT, CLOCK_REALTIME starts at epoch_ns
+    pub fn new_virtual(frequency_hz: u64, epoch_ns: u64) -> Self {
+        assert!(
+            frequency_hz != 0,
+            "Virtual clock frequency must be non-zero"
+        );
+        GuestClock {
+            source: ClockSource::Virtual,
+            frequency_hz,
+            mult: Self::compute_mult(frequency_hz),
+            timebase_hz: frequency_hz,
+            tick_mult: 1 << CLOCK_SHIFT,
+            epoch_ns,
+            skipped_ns: 0,
+        }
+    }
+
+    fn compute_mult(frequency_hz: u64) -> u64 {
+        (((NANOS_PER_SEC as u128) << CLOCK_SHIFT) / frequency_hz as u128) as u64
+    }
+
+    pub fn source(&self) -> ClockSource {
+        self.source
+    }
+
+    pub fn frequency_hz(&self) -> u64 {
+        self.frequency_hz
+    }
+
+    pub fn timebase_hz(&self) -> u64 {
+        self.timebase_hz
+    }
+
+    // Defaults to the instruction frequency, one time tick per retired instruction
+    pub fn set_timebase_hz(&mut self, timebase_hz: u64) {
+        assert!(timebase_hz != 0, "Timebase frequency must be non-zero");
+        self.timebase_hz = timebase_hz;
+        self.tick_mult =
+            (((timebase_hz as u128) << CLOCK_SHIFT) / self.frequency_hz as u128) as u64;
+    }
+
+    #[inline(always)]
+    pub fn instructions_to_ticks(&self, instret: u64) -> u64 {
+        ((instret as u128 * self.tick_mult as u128) >> CLOCK_SHIFT) as u64
+    }
+
+    pub fn ticks_to_ns(&self, ticks: u64) -> u64 {
+        (ticks as u128 * NANOS_PER_SEC as u128 / self.timebase_hz as u128) as u64
+    }
+
+    pub fn ns_to_ticks(&self, ns: u64) -> u64 {
+        (ns as u128 * self.timebase_hz as u128 / NANOS_PER_SEC as u128) as u64
+    }
+
+    #[inline(always)]
+    pub fn instructions_to_ns(&self, instret: u64) -> u64 {
+        ((instret as u128 * self.mult as u128) >> CLOCK_SHIFT) as u64
+    }
+
+    pub fn ns_to_instructions(&self, ns: u64) -> u64 {
+        (ns as u128 * self.frequency_hz as u128 / NANOS_PER_SEC as u128) as u64
+    }
+
+    // Fast-forwards virtual time over periods where the guest is idle
+    pub fn skip_ns(&mut self, ns: u64) {
+        self.skipped_ns += ns;
+    }
+
+    #[inline(always)]
+    pub fn uptime_ns(&self, instret: u64) -> u64 {
+        self.instructions_to_ns(instret) + self.skipped_ns
+    }
+
+    pub fn now(&self, clock_id: u64, instret: u64) -> Result<Duration> {
+        match self.source {
+            ClockSource::Host => {
+                #[allow(clippy::useless_conversion)]
+                let now = clock_gettime(ClockId::from_raw(clock_id.try_into()?))
+                    .context("clock_gettime")?;
+                Ok(Duration::new(now.tv_sec() as u64, now.tv_nsec() as u32))
+            }
+            ClockSource::Virtual => {
+                let mut ns = self.uptime_ns(instret);
+                if clock_id == CLOCK_REALTIME {
+                    ns += self.epoch_ns;
+                }
+                Ok(Duration::from_nanos(ns))
+            }
+        }
+    }
+}
@@ -1,3 +1,4 @@
+pub mod clock;
 pub mod kernel;
 pub mod passthrough_kernel;
 pub mod plic;
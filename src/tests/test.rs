@@ -1,10 +1,28 @@
 use crate::*;
 
-use cpu::cpu_core::{Cpu, CpuMode};
-use elf::elf_loader::{decode_file, WordSize};
-
+use cpu::{
+    cpu_core::{Cpu, CpuMode, IdleState, PrivilegeMode, KERNEL_ADDR},
+    host_routines::install_host_routines,
+    instrumentation::{BranchKind, Instrumentation, MemAccessKind, NoInstrumentation},
+};
+use elf::{
+    elf_loader::{decode_file, Symbol, SymbolType, WordSize},
+    symbol_table::SymbolTable,
+};
+use isa::csr::{
+    counters::is_counter_csr,
+    csr_types::{CSRAddress, CSRTable, SSTATUS_MASK},
+};
+
+use profiling::{
+    call_graph::CallGraphProfiler,
+    instruction_profiler::InstructionProfiler,
+    microarch::{Cache, CacheConfig, MicroarchConfig, MicroarchModel},
+    trace::{diff_traces, TraceReader, TraceWriter},
+};
 use proptest::prelude::*;
 use std::result::Result::Ok;
+use system::{clock::GuestClock, uart::UART_ADDR};
 use tests::util::*;
 use types::*;
 use utils::binary_utils::*;
@@ -54,6 +72,735 @@ fn test_example_c_programs() {
     }
 }
 
+// Runs a program in tests/ to completion, returns its stdout and the instructions retired
+fn run_example_c_program(file_path: &std::path::Path, host_routines: bool) -> (String, u64) {
+    let program = decode_file(file_path.to_str().unwrap());
+    let mut cpu = if program.header.word_size == WordSize::W32 {
+        setup_cpu()
+    } else {
+        setup_cpu_64()
+    };
+    let symbols = SymbolTable::from_elf(&program);
+    cpu.load_program_from_elf(program).unwrap();
+    if host_routines {
+        let routines = install_host_routines(&mut cpu, &symbols).unwrap();
+        let expected: Vec<&str> = ["memcpy", "memset", "strlen"]
+            .into_iter()
+            .filter(|name| symbols.find(name).is_some())
+            .collect();
+        assert_eq!(routines, expected, "File: {:?}", file_path);
+    }
+    for _ in 0..MAX_CYCLES {
+        if cpu.run_cycles(1).is_err() {
+            return (cpu.kernel.read_and_clear_stdout_buffer(), cpu.instret);
+        }
+    }
+    panic!("Too many cycles, file: {:?}", file_path);
+}
+
+#[test]
+fn test_example_c_programs_with_host_routines() {
+    let test_programs = std::fs::read_dir("tests")
+        .unwrap()
+        .map(|e| e.unwrap().path())
+        .filter(|path| path.extension().is_none());
+    for file_path in test_programs {
+        let (guest_stdout, guest_retired) = run_example_c_program(&file_path, false);
+        let (host_stdout, host_retired) = run_example_c_program(&file_path, true);
+        assert_eq!(guest_stdout, host_stdout, "File: {:?}", file_path);
+        assert!(host_retired <= guest_retired, "File: {:?}", file_path);
+    }
+}
+
+#[test]
+fn test_virtual_clock_gettime() {
+    let mut cpu = setup_cpu_64();
+    cpu.clock = GuestClock::new_virtual(1_000_000, 0);
+    cpu.instret = 2_500_000;
+
+    const TIMESPEC_ADDR: u64 = 0x1000;
+    cpu.write_x_u64(ABIRegister::A(7).to_x_reg_id() as u8, 403);
+    cpu.write_x_u64(ABIRegister::A(0).to_x_reg_id() as u8, 1);
+    cpu.write_x_u64(ABIRegister::A(1).to_x_reg_id() as u8, TIMESPEC_ADDR);
+
+    let op = encode_program_line("ECALL", InstructionData::I(IInstructionData::default())).unwrap();
+    cpu.execute_word(op).unwrap();
+
+    assert_eq!(cpu.read_mem_u64(TIMESPEC_ADDR).unwrap(), 2);
+    assert_eq!(cpu.read_mem_u64(TIMESPEC_ADDR + 8).unwrap(), 500_000_000);
+}
+
+#[test]
+fn test_program_cache_decodes_lazily() {
+    let mut cpu = Cpu::default();
+    // ADDI x1, x0, 5 followed by a data word that is not an instruction
+    let program = vec![0x00500093, 0xFFFFFFFF];
+
+    cpu.load_program_from_opcodes(program, 0x1000, cpu.arch_mode)
+        .unwrap();
+    assert!(cpu.program_cache.try_get_line(0x1000).is_none());
+
+    cpu.run_cycles(1).unwrap();
+    assert_eq!(cpu.read_x_u32(1), 5);
+    assert_eq!(
+        cpu.program_cache
+            .try_get_line(0x1000)
+            .unwrap()
+            .instruction
+            .name,
+        "ADDI"
+    );
+
+    assert!(cpu.run_cycles(1).is_err());
+}
+
+#[test]
+fn test_program_cache_self_modifying_code() {
+    let mut cpu = Cpu::default();
+    // ADDI x1, x0, 5
+    cpu.load_program_from_opcodes(vec![0x00500093], 0x1000, cpu.arch_mode)
+        .unwrap();
+    cpu.run_cycles(1).unwrap();
+    assert_eq!(cpu.read_x_u32(1), 5);
+
+    // Patch it to ADDI x1, x0, 7 and execute it again
+    cpu.write_mem_u32(0x1000, 0x00700093).unwrap();
+    cpu.write_pc_u32(0x1000);
+    cpu.run_cycles(1).unwrap();
+    assert_eq!(cpu.read_x_u32(1), 7);
+
+    // Code generated outside of the loaded program
+    cpu.write_buf(0x9000, &0x00900093u32.to_le_bytes()).unwrap();
+    cpu.write_pc_u32(0x9000);
+    cpu.run_cycles(1).unwrap();
+    assert_eq!(cpu.read_x_u32(1), 9);
+}
+
+#[test]
+fn test_csr_supervisor_views() {
+    let mut csrs = CSRTable::new(CpuMode::RV64);
+    csrs.write64(CSRAddress::Mideleg.as_u12(), 0b10_0010);
+    csrs.write64(CSRAddress::Mie.as_u12(), 0b1000_1000);
+
+    csrs.write64(CSRAddress::Sie.as_u12(), u64::MAX);
+    assert_eq!(csrs.mie, 0b1010_1010);
+    assert_eq!(csrs.read64(CSRAddress::Sie.as_u12()), 0b10_0010);
+
+    csrs.write64(CSRAddress::Sstatus.as_u12(), u64::MAX);
+    assert_eq!(csrs.read64(CSRAddress::Mstatus.as_u12()), SSTATUS_MASK);
+
+    // CSRs without dense storage still round-trip
+    csrs.write64(U12::new(0x7C0), 42);
+    assert_eq!(csrs.read64(U12::new(0x7C0)), 42);
+}
+
+#[test]
+fn test_counters_follow_instret() {
+    let mut cpu = Cpu::default();
+    cpu.instret = 1000;
+    assert_eq!(cpu.read_csr64(CSRAddress::Cycle.as_u12()), 1000);
+    assert_eq!(cpu.read_csr64(CSRAddress::Instret.as_u12()), 1000);
+    assert_eq!(cpu.read_csr64(CSRAddress::Time.as_u12()), 1000);
+
+    // Writing mcycle offsets later reads, user-level counters are read-only
+    cpu.write_csr64(CSRAddress::Mcycle.as_u12(), 10);
+    cpu.write_csr64(CSRAddress::Instret.as_u12(), 10);
+    cpu.instret += 5;
+    assert_eq!(cpu.read_csr64(CSRAddress::Cycle.as_u12()), 15);
+    assert_eq!(cpu.read_csr64(CSRAddress::Instret.as_u12()), 1005);
+
+    cpu.instret = 0x1_0000_0002;
+    assert_eq!(cpu.read_csr32(CSRAddress::InstretH.as_u12()), 1);
+    assert_eq!(cpu.read_csr32(CSRAddress::Instret.as_u12()), 2);
+
+    cpu.clock.set_timebase_hz(cpu.clock.frequency_hz() / 10);
+    assert_eq!(cpu.read_time(), 0x1_0000_0002 / 10);
+}
+
+#[derive(Default)]
+struct RecordingHooks {
+    fetched: usize,
+    retired: usize,
+    accesses: Vec<(u64, u8, MemAccessKind)>,
+    branches: Vec<(u64, BranchKind, u64, bool)>,
+    syscalls: Vec<(u64, u64)>,
+}
+
+impl Instrumentation for RecordingHooks {
+    fn on_fetch(&mut self, _pc: u64, _line: &ProgramLine) {
+        self.fetched += 1;
+    }
+
+    fn on_retire(&mut self, _pc: u64, _line: &ProgramLine, _next_pc: u64) {
+        self.retired += 1;
+    }
+
+    fn on_mem_access(&mut self, addr: u64, size: u8, kind: MemAccessKind) {
+        self.accesses.push((addr, size, kind));
+    }
+
+    fn on_branch(&mut self, pc: u64, kind: BranchKind, target: u64, taken: bool) {
+        self.branches.push((pc, kind, target, taken));
+    }
+
+    fn on_syscall(&mut self, pc: u64, number: u64) {
+        self.syscalls.push((pc, number));
+    }
+}
+
+#[test]
+fn test_instrumentation_hooks() {
+    let mut cpu = setup_cpu_instrumented(RecordingHooks::default());
+    let program = vec![
+        0x00300093, // ADDI x1, x0, 3
+        0x10102023, // SW x1, 0x100(x0)
+        0x10002103, // LW x2, 0x100(x0)
+        0x00208463, // BEQ x1, x2, +8
+        0x00000013, // NOP
+        0x05D00893, // ADDI a7, x0, 93 (exit)
+        0x00000073, // ECALL
+    ];
+    cpu.load_program_from_opcodes(program, 0x1000, cpu.arch_mode)
+        .unwrap();
+    assert!(cpu.run_cycles(10).is_err());
+
+    let hooks = cpu.instrumentation::<RecordingHooks>().unwrap();
+    assert_eq!((hooks.fetched, hooks.retired), (6, 6));
+    assert_eq!(
+        hooks.accesses,
+        vec![
+            (0x100, 4, MemAccessKind::Write),
+            (0x100, 4, MemAccessKind::Read)
+        ]
+    );
+    assert_eq!(
+        hooks.branches,
+        vec![(0x100C, BranchKind::Conditional, 0x1014, true)]
+    );
+    assert_eq!(hooks.syscalls, vec![(0x1018, 93)]);
+    assert!(cpu.instrumentation::<NoInstrumentation>().is_none());
+}
+
+#[test]
+fn test_hot_loop_counters() {
+    for mut cpu in [setup_cpu(), setup_cpu_64()] {
+        // ADDI x1, x0, 4; loop: ADDI x1, x1, -1; BNE x1, x0, loop; NOP
+        cpu.load_program_from_opcodes(
+            vec![0x00400093, 0xFFF08093, 0xFE009EE3, 0x00000013],
+            0x1000,
+            cpu.arch_mode,
+        )
+        .unwrap();
+        cpu.run_cycles(9).unwrap();
+        assert_eq!(cpu.read_pc_u64(), 0x100C);
+
+        let loops = cpu.program_cache.loop_counters();
+        assert_eq!(loops.len(), 1);
+        assert_eq!(
+            (loops[0].target, loops[0].end, loops[0].iterations),
+            (0x1004, 0x1008, 3)
+        );
+        assert_eq!(loops[0].estimated_instructions(), 6);
+    }
+}
+
+#[test]
+fn test_hot_loop_counters_backward_jump() {
+    for mut cpu in [setup_cpu(), setup_cpu_64()] {
+        // ADDI x1, x0, 3; loop: BEQ x1, x0, done; ADDI x1, x1, -1; J loop; done: NOP
+        cpu.load_program_from_opcodes(
+            vec![0x00300093, 0x00008663, 0xFFF08093, 0xFF9FF06F, 0x00000013],
+            0x1000,
+            cpu.arch_mode,
+        )
+        .unwrap();
+        cpu.run_cycles(11).unwrap();
+        assert_eq!(cpu.read_pc_u64(), 0x1010);
+
+        let loops = cpu.program_cache.loop_counters();
+        assert_eq!(loops.len(), 1);
+        assert_eq!(
+            (loops[0].target, loops[0].end, loops[0].iterations),
+            (0x1004, 0x100C, 3)
+        );
+    }
+}
+
+#[test]
+fn test_instruction_profiler() {
+    let mut cpu = setup_cpu_instrumented(InstructionProfiler::new(SymbolTable::default()));
+    // ADDI x1, x0, 3; loop: ADDI x1, x1, -1; BNE x1, x0, loop
+    cpu.load_program_from_opcodes(
+        vec![0x00300093, 0xFFF08093, 0xFE009EE3],
+        0x1000,
+        cpu.arch_mode,
+    )
+    .unwrap();
+    cpu.run_cycles(7).unwrap();
+
+    let profiler = cpu.instrumentation::<InstructionProfiler>().unwrap();
+    assert_eq!(profiler.total(), 7);
+    assert_eq!(profiler.opcode_counts(), vec![("ADDI", 4), ("BNE", 3)]);
+    let branch = profiler.pc_stats(0x1008).unwrap();
+    assert_eq!((branch.count, branch.taken), (3, 2));
+}
+
+#[test]
+fn test_call_graph_profiler() {
+    let symbols = SymbolTable::new(vec![
+        Symbol {
+            name: "main".to_owned(),
+            addr: 0x1000,
+            size: 8,
+            symbol_type: SymbolType::Func,
+        },
+        Symbol {
+            name: "callee".to_owned(),
+            addr: 0x1008,
+            size: 8,
+            symbol_type: SymbolType::Func,
+        },
+    ]);
+    let mut cpu = setup_cpu_instrumented(CallGraphProfiler::new(symbols));
+    // main: JAL ra, callee; ADDI x2, x0, 1; callee: ADDI x3, x0, 2; RET
+    let program = vec![0x008000EF, 0x00100113, 0x00200193, 0x00008067];
+    cpu.load_program_from_opcodes(program, 0x1000, cpu.arch_mode)
+        .unwrap();
+    cpu.run_cycles(4).unwrap();
+
+    let call_graph = cpu.instrumentation::<CallGraphProfiler>().unwrap();
+    assert_eq!(call_graph.depth(), 0);
+    let mut folded = Vec::new();
+    call_graph.write_folded(&mut folded).unwrap();
+    assert_eq!(
+        String::from_utf8(folded).unwrap(),
+        "main 2\nmain;callee 2\n"
+    );
+
+    let counts = call_graph.function_counts();
+    assert_eq!(
+        (
+            counts[0].name.as_str(),
+            counts[0].inclusive,
+            counts[0].exclusive
+        ),
+        ("main", 4, 2)
+    );
+    assert_eq!(
+        (
+            counts[1].name.as_str(),
+            counts[1].inclusive,
+            counts[1].exclusive
+        ),
+        ("callee", 2, 2)
+    );
+}
+
+#[test]
+fn test_call_graph_profiler_past_max_depth() {
+    let symbols = SymbolTable::new(vec![
+        Symbol {
+            name: "main".to_owned(),
+            addr: 0x1000,
+            size: 16,
+            symbol_type: SymbolType::Func,
+        },
+        Symbol {
+            name: "rec".to_owned(),
+            addr: 0x1010,
+            size: 32,
+            symbol_type: SymbolType::Func,
+        },
+    ]);
+    let mut cpu = setup_cpu_instrumented(CallGraphProfiler::new(symbols));
+    // main: LUI sp, 0x8; ADDI a0, x0, 300; JAL ra, rec; ADDI x3, x0, 1
+    // rec: ADDI sp, sp, -16; SW ra, 0(sp); ADDI a0, a0, -1; BEQ a0, x0, 8; JAL ra, rec
+    //      LW ra, 0(sp); ADDI sp, sp, 16; RET
+    let program = vec![
+        0x00008137, 0x12C00513, 0x008000EF, 0x00100193, 0xFF010113, 0x00112023, 0xFFF50513,
+        0x00050463, 0xFF1FF0EF, 0x00012083, 0x01010113, 0x00008067,
+    ];
+    cpu.load_program_from_opcodes(program, 0x1000, cpu.arch_mode)
+        .unwrap();
+    // 300 nested calls, deeper than the profiler keeps frames for
+    cpu.run_cycles(3 + 299 * 8 + 7 + 1).unwrap();
+    assert_eq!(cpu.read_x_u32(3), 1);
+
+    let call_graph = cpu.instrumentation::<CallGraphProfiler>().unwrap();
+    assert_eq!(call_graph.depth(), 0);
+    let counts = call_graph.function_counts();
+    let main = counts.iter().find(|c| c.name == "main").unwrap();
+    assert_eq!((main.inclusive, main.exclusive), (2403, 4));
+}
+
+#[test]
+fn test_cache_model() {
+    assert_eq!(
+        "32K:8:64".parse::<CacheConfig>().unwrap(),
+        CacheConfig::new(32 << 10, 8, 64)
+    );
+    assert!("3K:8:64".parse::<CacheConfig>().is_err());
+
+    // One set with two ways
+    let mut cache = Cache::new(CacheConfig::new(128, 2, 64));
+    let hits: Vec<bool> = [0x0, 0x40, 0x8, 0x80, 0x0, 0x40]
+        .iter()
+        .map(|&addr| cache.access(addr))
+        .collect();
+    assert_eq!(hits, vec![false, false, true, false, true, false]);
+}
+
+#[test]
+fn test_microarch_model() {
+    let config = MicroarchConfig::default();
+    let mut cpu = setup_cpu_instrumented(MicroarchModel::new(config, SymbolTable::default()));
+    // ADDI x1, x0, 4; loop: LW x2, 0x100(x0); ADDI x1, x1, -1; BNE x1, x0, loop
+    let program = vec![0x00400093, 0x10002103, 0xFFF08093, 0xFE009CE3];
+    cpu.load_program_from_opcodes(program, 0x1000, cpu.arch_mode)
+        .unwrap();
+    cpu.run_cycles(13).unwrap();
+
+    let model = cpu.instrumentation::<MicroarchModel>().unwrap();
+    let totals = model.totals();
+    assert_eq!(totals.instructions, 13);
+    assert_eq!((model.l1d.stats.accesses, model.l1d.stats.misses), (4, 1));
+    // The code and data pages each miss the TLB once
+    assert_eq!((totals.l1i_misses, totals.tlb_misses), (1, 2));
+    assert_eq!(model.predictor.stats.branches, 4);
+    let miss = config.l2_latency + config.memory_latency;
+    assert_eq!(
+        totals.cycles,
+        13 + 2 * miss
+            + 2 * config.page_walk_latency
+            + model.predictor.stats.mispredicts * config.mispredict_penalty
+    );
+    assert_eq!(model.pc_costs(0x1004).unwrap().l1d_misses, 1);
+}
+
+#[test]
+fn test_microarch_tlb_under_translation() {
+    let model = MicroarchModel::new(MicroarchConfig::default(), SymbolTable::default());
+    let mut cpu = Cpu::new_bare_instrumented(None, model);
+    let code = 0x40000000;
+    map_sv39_page(&mut cpu, code, KERNEL_ADDR + 0x20000);
+    for page in 1..4 {
+        map_sv39_page(
+            &mut cpu,
+            code + page * 0x1000,
+            KERNEL_ADDR + 0x20000 + page * 0x1000,
+        );
+        cpu.write_x_u64(page as u8, code + page * 0x1000);
+    }
+    enable_sv39(&mut cpu);
+    cpu.write_x_u64(8, cpu.csr_table.satp);
+    // LD x5, 0(x1); LD x6, 0(x2); LD x7, 0(x3); LD x5, 0(x1); SFENCE.VMA; LD x5, 0(x1)
+    // CSRRW x0, satp, x8; LD x5, 0(x1)
+    let program = [
+        0x0000B283, 0x00013303, 0x0001B383, 0x0000B283, 0x12000073, 0x0000B283, 0x18041073,
+        0x0000B283,
+    ];
+    for (i, word) in program.iter().enumerate() {
+        cpu.memory
+            .write_mem_u32(KERNEL_ADDR + 0x20000 + i as u64 * 4, *word)
+            .unwrap();
+    }
+    cpu.write_pc_u64(code);
+    cpu.run_cycles(program.len() as u64).unwrap();
+
+    let model = cpu.instrumentation::<MicroarchModel>().unwrap();
+    let totals = model.totals();
+    // The first fetch and three data pages walk, then every flush costs a fetch and a load walk
+    assert_eq!((totals.tlb_accesses, totals.tlb_misses), (9, 8));
+    assert_eq!(model.pc_costs(code + 12).unwrap().tlb_misses, 0);
+    assert_eq!(model.pc_costs(code + 20).unwrap().tlb_misses, 2);
+    assert_eq!(model.pc_costs(code + 28).unwrap().tlb_misses, 2);
+}
+
+#[test]
+fn test_trace_round_trip() {
+    let path = std::env::temp_dir().join(format!("risc-sim-trace-{}", std::process::id()));
+    let path = path.to_str().unwrap();
+    let mut cpu = setup_cpu_instrumented(TraceWriter::create(path).unwrap());
+    let program = vec![
+        0x00300093, // ADDI x1, x0, 3
+        0x10102023, // SW x1, 0x100(x0)
+        0x10002103, // LW x2, 0x100(x0)
+        0x00208463, // BEQ x1, x2, +8
+        0x00000013, // NOP
+        0x00000013, // NOP
+    ];
+    cpu.load_program_from_opcodes(program, 0x1000, cpu.arch_mode)
+        .unwrap();
+    cpu.run_cycles(5).unwrap();
+    cpu.instrumentation_mut::<TraceWriter>()
+        .unwrap()
+        .finish()
+        .unwrap();
+
+    let mut reader = TraceReader::open(path).unwrap();
+    let mut records = Vec::new();
+    while let Some(record) = reader.next_record().unwrap() {
+        records.push(record);
+    }
+    let pcs: Vec<u64> = records.iter().map(|record| record.pc).collect();
+    assert_eq!(pcs, vec![0x1000, 0x1004, 0x1008, 0x100C, 0x1014]);
+    assert_eq!(records[0].writeback, Some((1, 3)));
+    assert_eq!(records[1].mem, vec![(0x100, 4, MemAccessKind::Write)]);
+    assert_eq!(records[2].writeback, Some((2, 3)));
+    assert_eq!(records[2].mem, vec![(0x100, 4, MemAccessKind::Read)]);
+    assert_eq!(records[3].writeback, None);
+
+    let mut left = TraceReader::open(path).unwrap();
+    let mut right = TraceReader::open(path).unwrap();
+    assert!(diff_traces(&mut left, &mut right).unwrap().is_none());
+    std::fs::remove_file(path).unwrap();
+}
+
+#[test]
+fn test_trace_traps_and_dropped_accesses() {
+    let path = std::env::temp_dir().join(format!("risc-sim-trace-traps-{}", std::process::id()));
+    let path = path.to_str().unwrap();
+    let mut trace = TraceWriter::create(path).unwrap();
+    let ecall = decode_program_line(Word(0x00000073), CpuMode::RV64).unwrap();
+    let nop = decode_program_line(Word(0x00000013), CpuMode::RV64).unwrap();
+
+    // ECALL traps while it executes, a timer interrupt arrives after the NOP retired.
+    // Interrupts before the first and after the last record are dropped.
+    trace.on_trap(0x1000, 5, true);
+    trace.on_fetch(0x1000, &ecall);
+    trace.on_trap(0x1000, 8, false);
+    trace.on_retire(0x1000, &ecall, 0x2000);
+    trace.on_fetch(0x2000, &nop);
+    for i in 0..10 {
+        trace.on_mem_access(0x100 + i * 8, 8, MemAccessKind::Read);
+    }
+    trace.on_retire(0x2000, &nop, 0x2004);
+    trace.on_trap(0x2000, 5, true);
+    trace.on_fetch(0x3000, &nop);
+    // Far enough from the previous access that the encoding needs more than 64 bits
+    trace.on_mem_access(1 << 62, 2, MemAccessKind::Write);
+    trace.on_retire(0x3000, &nop, 0x3004);
+    trace.finish().unwrap();
+    trace.on_trap(0x3004, 5, true);
+
+    let mut reader = TraceReader::open(path).unwrap();
+    let ecall = reader.next_record().unwrap().unwrap();
+    assert_eq!((ecall.trap, ecall.interrupt), (Some(8), None));
+    let interrupted = reader.next_record().unwrap().unwrap();
+    assert_eq!((interrupted.trap, interrupted.interrupt), (None, Some(5)));
+    assert_eq!(interrupted.mem.len() as u64 + interrupted.mem_dropped, 10);
+    assert_eq!(interrupted.mem[1], (0x108, 8, MemAccessKind::Read));
+    let handler = reader.next_record().unwrap().unwrap();
+    assert_eq!(
+        (handler.pc, handler.trap, handler.interrupt),
+        (0x3000, None, None)
+    );
+    assert_eq!(handler.mem, vec![(1 << 62, 2, MemAccessKind::Write)]);
+    assert!(reader.next_record().unwrap().is_none());
+    std::fs::remove_file(path).unwrap();
+}
+
+#[test]
+fn test_symbol_table_from_elf() {
+    let program = decode_file("tests/fib_heavy");
+    let symbols = SymbolTable::from_elf(&program);
+    let main = program
+        .symbols()
+        .into_iter()
+        .find(|symbol| symbol.name == "main")
+        .unwrap();
+
+    assert_eq!(symbols.function_name(main.addr + 4), "main");
+    assert_eq!(symbols.symbolize(main.addr + 4), "main+0x4");
+}
+
+#[test]
+fn test_wfi_fast_forwards_to_timer() {
+    let mut cpu = Cpu::new_bare(None);
+    cpu.memory.write_mem_u32(KERNEL_ADDR, 0x00000013).unwrap(); // nop at the trap vector
+    cpu.csr_table
+        .write64(CSRAddress::Mtvec.as_u12(), KERNEL_ADDR);
+    cpu.csr_table.write64(CSRAddress::Mstatus.as_u12(), 1 << 3); // MIE
+    cpu.csr_table.write64(CSRAddress::Mie.as_u12(), 1 << 5); // STIE
+    cpu.csr_table.write64(CSRAddress::Stimecmp.as_u12(), 1000);
+    cpu.write_pc_u64(KERNEL_ADDR + 0x100);
+
+    cpu.execute_word(Word(0x10500073)).unwrap(); // wfi
+
+    cpu.run_cycles(100).unwrap();
+    assert_eq!(cpu.instret, 0);
+    assert_eq!(cpu.idle_state(), Some(IdleState::Timer(1001)));
+
+    cpu.fast_forward(1001);
+    cpu.run_cycles(1).unwrap();
+
+    assert_eq!(cpu.idle_state(), None);
+    assert_eq!(cpu.instret, 1);
+    assert_eq!(
+        cpu.csr_table.read64(CSRAddress::Mcause.as_u12()),
+        1 << 63 | 5
+    );
+    assert_eq!(
+        cpu.csr_table.read64(CSRAddress::Mepc.as_u12()),
+        KERNEL_ADDR + 0x100
+    );
+    assert_eq!(cpu.read_pc_u64(), KERNEL_ADDR + 4);
+}
+
+#[test]
+fn test_interrupt_returns_past_retired_instruction() {
+    let mut cpu = Cpu::new_bare(None);
+    cpu.privilege_mode = PrivilegeMode::Supervisor;
+    let program = vec![
+        0x00128293, // ADDI x5, x5, 1
+        0x00130313, // ADDI x6, x6, 1
+    ];
+    cpu.load_program_from_opcodes(program, KERNEL_ADDR, CpuMode::RV64)
+        .unwrap();
+    cpu.memory
+        .write_mem_u32(KERNEL_ADDR + 0x100, 0x14D39073) // csrw stimecmp, x7
+        .unwrap();
+    cpu.memory
+        .write_mem_u32(KERNEL_ADDR + 0x104, 0x10200073) // sret
+        .unwrap();
+    cpu.csr_table
+        .write64(CSRAddress::Stvec.as_u12(), KERNEL_ADDR + 0x100);
+    cpu.csr_table.write64(CSRAddress::Mideleg.as_u12(), 1 << 5);
+    cpu.csr_table.write64(CSRAddress::Sstatus.as_u12(), 1 << 1); // SIE
+    cpu.csr_table.write64(CSRAddress::Mie.as_u12(), 1 << 5); // STIE
+    cpu.write_x_u64(7, u64::MAX);
+
+    // The timer is already due, so it fires as soon as the first ADDI retired
+    cpu.run_cycles(4).unwrap();
+
+    assert_eq!(
+        cpu.csr_table.read64(CSRAddress::Sepc.as_u12()),
+        KERNEL_ADDR + 4
+    );
+    assert_eq!(cpu.read_x_u64(5), 1);
+    assert_eq!(cpu.read_x_u64(6), 1);
+}
+
+#[test]
+fn test_timer_interrupt_once_per_deadline() {
+    let mut cpu = Cpu::new_bare(None);
+    cpu.privilege_mode = PrivilegeMode::Supervisor;
+    let program = vec![
+        0x00128293, // ADDI x5, x5, 1
+        0xFFDFF06F, // JAL x0, -4
+    ];
+    cpu.load_program_from_opcodes(program, KERNEL_ADDR, CpuMode::RV64)
+        .unwrap();
+    let handler = [
+        0x00150513, // ADDI x10, x10, 1
+        0xC01025F3, // csrr x11, time
+        0x06458593, // ADDI x11, x11, 100
+        0x14D59073, // csrw stimecmp, x11
+        0x10200073, // sret
+    ];
+    for (i, word) in handler.iter().enumerate() {
+        cpu.memory
+            .write_mem_u32(KERNEL_ADDR + 0x100 + i as u64 * 4, *word)
+            .unwrap();
+    }
+    cpu.csr_table
+        .write64(CSRAddress::Stvec.as_u12(), KERNEL_ADDR + 0x100);
+    cpu.csr_table.write64(CSRAddress::Mideleg.as_u12(), 1 << 5);
+    cpu.csr_table.write64(CSRAddress::Sstatus.as_u12(), 1 << 1); // SIE
+    cpu.csr_table.write64(CSRAddress::Mie.as_u12(), 1 << 5); // STIE
+    cpu.csr_table.write64(CSRAddress::Stimecmp.as_u12(), 10);
+
+    cpu.run_cycles(50).unwrap();
+    assert_eq!(cpu.read_x_u64(10), 1);
+    assert_eq!(cpu.csr_table.mip & 1 << 5, 0);
+
+    cpu.run_cycles(100).unwrap();
+    assert_eq!(cpu.read_x_u64(10), 2);
+}
+
+#[test]
+fn test_translation_cache_follows_page_tables() {
+    let mut cpu = Cpu::new_bare(None);
+    let (page_a, page_b) = (KERNEL_ADDR + 0x20000, KERNEL_ADDR + 0x21000);
+    let va = 0x40000000;
+    map_sv39_page(&mut cpu, va, page_a);
+    cpu.memory.write_mem_u64(page_a + 8, 0xaaaa).unwrap();
+    cpu.memory.write_mem_u64(page_b + 8, 0xbbbb).unwrap();
+
+    enable_sv39(&mut cpu);
+    assert_eq!(cpu.read_mem_u64(va + 8).unwrap(), 0xaaaa);
+
+    // Remapped, visible once the guest fences
+    map_sv39_page(&mut cpu, va, page_b);
+    cpu.execute_word(Word(0x12000073)).unwrap(); // sfence.vma
+    assert_eq!(cpu.read_mem_u64(va + 8).unwrap(), 0xbbbb);
+    cpu.write_mem_u16(va + 16, 0xcafe).unwrap();
+    assert_eq!(cpu.memory.read_mem_u16(page_b + 16).unwrap(), 0xcafe);
+
+    cpu.write_csr64(CSRAddress::Satp.as_u12(), 0);
+    assert_eq!(cpu.read_mem_u64(page_a + 8).unwrap(), 0xaaaa);
+    assert_eq!(cpu.read_mem_u16(page_b + 16).unwrap(), 0xcafe);
+}
+
+#[test]
+fn test_misaligned_access_across_virtual_pages() {
+    let mut cpu = Cpu::new_bare(None);
+    let (page_a, page_b) = (KERNEL_ADDR + 0x20000, KERNEL_ADDR + 0x21000);
+    let va = 0x40000000;
+    // Virtually adjacent pages, physically in reverse order
+    map_sv39_page(&mut cpu, va, page_b);
+    map_sv39_page(&mut cpu, va + 0x1000, page_a);
+    enable_sv39(&mut cpu);
+
+    cpu.write_mem_u64(va + 0xffd, 0x0807060504030201).unwrap();
+    assert_eq!(cpu.memory.read_mem_u32(page_b + 0xffc).unwrap(), 0x03020100);
+    assert_eq!(cpu.memory.read_mem_u64(page_a).unwrap(), 0x0807060504);
+    assert_eq!(cpu.read_mem_u64(va + 0xffd).unwrap(), 0x0807060504030201);
+    assert_eq!(cpu.read_mem_u32(va + 0xffe).unwrap(), 0x05040302);
+    assert_eq!(cpu.read_mem_u16(va + 0xfff).unwrap(), 0x0403);
+
+    // The second page is unmapped, the store faults without writing the first half
+    assert!(cpu.write_mem_u32(va + 0x1ffe, 0xffffffff).is_err());
+    assert_eq!(cpu.memory.read_mem_u16(page_a + 0xffe).unwrap(), 0);
+}
+
+#[test]
+fn test_misaligned_access_across_pages_into_device() {
+    let mut cpu = Cpu::new_bare(None);
+    let page = KERNEL_ADDR + 0x20000;
+    let va = 0x40000000;
+    map_sv39_page(&mut cpu, va, page);
+    map_sv39_page(&mut cpu, va + 0x1000, UART_ADDR);
+    map_sv39_page(&mut cpu, va + 0x2000, page + 0x1000);
+    enable_sv39(&mut cpu);
+
+    // Neither half may reach RAM at the device's physical address
+    assert!(cpu.read_mem_u32(va + 0xffe).is_err());
+    assert!(cpu.write_mem_u32(va + 0xffe, 0xffffffff).is_err());
+    assert!(cpu.read_mem_u64(va + 0x1ffc).is_err());
+    assert!(cpu.write_mem_u64(va + 0x1ffc, u64::MAX).is_err());
+    assert_eq!(cpu.memory.read_mem_u16(page + 0xffe).unwrap(), 0);
+    assert_eq!(cpu.memory.read_mem_u32(page + 0x1000).unwrap(), 0);
+}
+
+#[test]
+fn test_dirty_pages_with_cached_stores() {
+    let mut cpu = Cpu::new_bare(None);
+    let page = KERNEL_ADDR + 0x5000;
+    cpu.write_mem_u64(page + 8, 1).unwrap();
+    assert!(cpu.translation_cache.write_ptr(page + 16, 8).is_some());
+    cpu.write_mem_u64(page + 16, 2).unwrap();
+    assert_eq!(cpu.take_dirty_pages(), Some(vec![page]));
+    assert_eq!(cpu.take_dirty_pages(), Some(vec![]));
+
+    cpu.read_mem_u64(page).unwrap();
+    assert_eq!(cpu.take_dirty_pages(), Some(vec![]));
+    cpu.write_mem_u8(page + 24, 3).unwrap();
+    cpu.write_buf(page + 0xfff, &[4, 5]).unwrap();
+    assert_eq!(cpu.take_dirty_pages(), Some(vec![page, page + 0x1000]));
+    assert_eq!(cpu.read_mem_u64(page + 16).unwrap(), 2);
+}
+
 // Calculates n-th fibbonacci number and stores it in x5
 const FIB_PROGRAM_BIN: &[u32] = &[
     0x00100093, 0x00100113, 0x00002183, // lw x3, x0 - load n from memory
@@ -257,6 +1004,20 @@ proptest! {
         prop_assert_eq!(cpu.read_x_u32(5), fib(n));
     }
 
+    #[test]
+    fn test_register_views(rd in 1u8..32, value in 0u32..u32::MAX) {
+        let mut cpu = setup_cpu_64();
+        cpu.write_x_u32(rd, value);
+        prop_assert_eq!(cpu.read_x_u32(rd), value);
+        prop_assert_eq!(cpu.read_x_i64(rd), value as i32 as i64);
+
+        cpu.write_x_u64(rd, 0x1234_5678_0000_0000 | value as u64);
+        prop_assert_eq!(cpu.read_x_u32(rd), value);
+
+        cpu.write_x_u32(0, value);
+        prop_assert_eq!(cpu.read_x_u64(0), 0);
+    }
+
     #[test]
     fn test_encode_decode_i16(rd in 1u8..30, rs1 in 1u8..30, immi16 in -2048i16..2047){
         let imm = U12(i16_to_u16(immi16) & 0xFFF);
@@ -555,6 +1316,7 @@ proptest! {
 
     #[test]
     fn test_csrrw(rd in 1u8..30, rs1 in 1u8..30, csr in 0u16..0xFFF, rs1_val in u32::MIN..u32::MAX, csr_val in u32::MIN..u32::MAX) {
+        prop_assume!(!is_counter_csr(csr));
         let mut cpu = Cpu::default();
         let csrrw_instruction = IInstructionData {
             rd: U5(rd),
@@ -577,6 +1339,7 @@ proptest! {
 
     #[test]
     fn test_csrrs(rd in 1u8..30, rs1 in 1u8..30, csr in 0u16..0xFFF, rs1_val in u32::MIN..u32::MAX, csr_val in u32::MIN..u32::MAX) {
+        prop_assume!(!is_counter_csr(csr));
         let mut cpu = Cpu::default();
         let csrrs_instruction = IInstructionData {
             rd: U5(rd),
@@ -598,6 +1361,7 @@ proptest! {
 
     #[test]
     fn test_csrrc(rd in 1u8..30, rs1 in 1u8..30, csr in 0u16..0xFFF, rs1_val in u32::MIN..u32::MAX, csr_val in u32::MIN..u32::MAX) {
+        prop_assume!(!is_counter_csr(csr));
         let mut cpu = Cpu::default();
         let csrrc_instruction = IInstructionData {
             rd: U5(rd),
@@ -619,6 +1383,7 @@ proptest! {
 
     #[test]
     fn test_csrrwi(rd in 1u8..30, zimm in 0i8..31, csr in 0u16..0xFFF, csr_val in u32::MIN..u32::MAX) {
+        prop_assume!(!is_counter_csr(csr));
         let mut cpu = Cpu::default();
         let csrrwi_instruction = IInstructionData {
             rd: U5(rd),
@@ -639,6 +1404,7 @@ proptest! {
 
     #[test]
     fn test_csrrsi(rd in 1u8..30, zimm in 0u8..31, csr in 0u16..0xFFF, csr_val in u32::MIN..u32::MAX) {
+        prop_assume!(!is_counter_csr(csr));
         let mut cpu = Cpu::default();
         let csrrsi_instruction = IInstructionData {
             rd: U5(rd),
@@ -659,6 +1425,7 @@ proptest! {
 
     #[test]
     fn test_csrrci(rd in 1u8..30, zimm in 0u8..31, csr in 0u16..0xFFF, csr_val in u32::MIN..u32::MAX) {
+        prop_assume!(!is_counter_csr(csr));
         let mut cpu = Cpu::default();
         let csrrci_instruction = IInstructionData {
             rd: U5(rd),
@@ -1,10 +1,44 @@
 use proptest::{prop_assert_eq, proptest};
 
 use crate::{
-    cpu::memory::{memory_core::Memory, page_storage::PAGE_SIZE, raw_memory::ContinuousMemory},
+    cpu::memory::{
+        dirty_bitmap::DIRTY_PAGE_SIZE,
+        hashmap_memory::FxHashMemory,
+        huge_page_memory::{HugePageMemory, HugePages, HUGE_PAGE_SIZE},
+        memory_core::Memory,
+        paged_memory::{HashMemory, RadixMemory, SortedVecMemory, PAGE_SIZE},
+        raw_memory::ContinuousMemory,
+        raw_vec_memory::RawVecMemory,
+        vec_u8_memory::VecU8Memory,
+    },
     tests::util::{execute_i_instruction, execute_s_instruction, setup_cpu, setup_cpu_64},
 };
 
+// Dirty pages reported after a u32 store at `addr`, a second take and a write spanning two pages
+fn dirty_pages_after_writes<M: Memory>(memory: &mut M, addr: u64) -> [Option<Vec<u64>>; 3] {
+    memory.write_mem_u32(addr, 0x12345678).unwrap();
+    let store = memory.take_dirty_pages();
+    let again = memory.take_dirty_pages();
+    memory
+        .write_buf(
+            addr & !(DIRTY_PAGE_SIZE - 1),
+            &[1; DIRTY_PAGE_SIZE as usize + 1],
+        )
+        .unwrap();
+    [store, again, memory.take_dirty_pages()]
+}
+
+// Reads back a u64 stored at `addr` whole, shifted and partially overlapping
+fn reads_after_u64_write<M: Memory>(memory: &mut M, addr: u64) -> [u64; 4] {
+    memory.write_mem_u64(addr, 0x123456789abcdef0).unwrap();
+    [
+        memory.read_mem_u64(addr).unwrap(),
+        memory.read_mem_u32(addr + 3).unwrap() as u64,
+        memory.read_mem_u16(addr + 7).unwrap() as u64,
+        memory.read_mem_u64(addr - 1).unwrap(),
+    ]
+}
+
 proptest! {
     #[test]
     fn test_memory_mapping_u32(addr in 0x0u64..(u32::MAX as u64 - 3 - 3)) {
@@ -151,6 +185,90 @@ proptest! {
         prop_assert_eq!(cpu.read_mem_u16(addr + 1).unwrap(), 0x0056);
     }
 
+    #[test]
+    fn test_memory_cross_boundary_buf(addr_v in 1u64..10, offset in 0u64..64u64) {
+        let mut memory = RawVecMemory::new();
+        let data: Vec<u8> = (1..=64).collect();
+        let addr = addr_v * PAGE_SIZE + offset - 64;
+        memory.write_buf(addr, &data).unwrap();
+        let mut read_back = vec![0u8; data.len()];
+        memory.read_buf(addr, &mut read_back).unwrap();
+        prop_assert_eq!(&read_back, &data);
+        prop_assert_eq!(memory.read_mem_u8(addr + 63).unwrap(), 64);
+
+        memory.fill(addr + 1, 62, 0).unwrap();
+        prop_assert_eq!(memory.read_mem_u8(addr).unwrap(), 1);
+        prop_assert_eq!(memory.read_mem_u32(addr + 30).unwrap(), 0);
+        prop_assert_eq!(memory.read_mem_u8(addr + 63).unwrap(), 64);
+    }
+
+    #[test]
+    fn test_memory_huge_pages(addr in 0x1u64..(2 * HUGE_PAGE_SIZE as u64 - 0x48), offset in 0x0..(u64::MAX - 0x400000)) {
+        let value = 0x123456789abcdef0u64;
+        let mut memory = HugePageMemory::new(offset, 2 * HUGE_PAGE_SIZE as u64, HugePages::Transparent);
+        let addr = addr + offset;
+        memory.write_mem_u64(addr, value).unwrap();
+        prop_assert_eq!(memory.read_mem_u64(addr).unwrap(), value);
+        prop_assert_eq!(memory.read_mem_u32(addr + 3).unwrap(), 0x3456789a);
+        prop_assert_eq!(memory.read_mem_u16(addr + 7).unwrap(), 0x0012);
+        prop_assert_eq!(memory.read_mem_u64(addr - 1).unwrap(), 0x3456789abcdef000);
+
+        let data: Vec<u8> = (1..=64).collect();
+        memory.write_buf(addr, &data).unwrap();
+        memory.fill(addr + 1, 62, 0).unwrap();
+        let mut read_back = vec![0u8; data.len()];
+        memory.read_buf(addr, &mut read_back).unwrap();
+        prop_assert_eq!(read_back[0], 1);
+        prop_assert_eq!(read_back[31], 0);
+        prop_assert_eq!(read_back[63], 64);
+    }
+
+    #[test]
+    fn test_memory_paged_indexes(page in 1u64..(1 << 51), offset in 0u64..16) {
+        // Straddles the boundary of a 4 KiB page for most offsets
+        let addr = (page << 12) - 8 + offset;
+        let expected = [0x123456789abcdef0, 0x3456789a, 0x0012, 0x3456789abcdef000];
+        prop_assert_eq!(reads_after_u64_write(&mut RadixMemory::<12>::new(), addr), expected);
+        prop_assert_eq!(reads_after_u64_write(&mut HashMemory::<12>::new(), addr), expected);
+        prop_assert_eq!(reads_after_u64_write(&mut SortedVecMemory::<16>::new(), addr), expected);
+        prop_assert_eq!(reads_after_u64_write(&mut RadixMemory::<21>::new(), addr), expected);
+    }
+
+    #[test]
+    fn test_memory_misaligned_across_backend_pages(page in 1u64..64, offset in 0u64..16) {
+        let expected = [0x123456789abcdef0, 0x3456789a, 0x0012, 0x3456789abcdef000];
+        // 16 MiB and 64 KiB pages
+        let addr = page * PAGE_SIZE - 8 + offset;
+        prop_assert_eq!(reads_after_u64_write(&mut FxHashMemory::new(), addr), expected);
+        let addr = page * 0x10000 - 8 + offset;
+        prop_assert_eq!(reads_after_u64_write(&mut VecU8Memory::new(), addr), expected);
+    }
+
+    #[test]
+    fn test_memory_dirty_pages(page in 0u64..30, offset in 0u64..DIRTY_PAGE_SIZE) {
+        let base = 0x80000000;
+        let addr = base + page * DIRTY_PAGE_SIZE + offset;
+        let page_addr = base + page * DIRTY_PAGE_SIZE;
+        let mut store = vec![page_addr];
+        if offset > DIRTY_PAGE_SIZE - 4 {
+            store.push(page_addr + DIRTY_PAGE_SIZE);
+        }
+        let expected = [
+            Some(store),
+            Some(vec![]),
+            Some(vec![page_addr, page_addr + DIRTY_PAGE_SIZE]),
+        ];
+
+        let mut memory = ContinuousMemory::new(base, 32 * DIRTY_PAGE_SIZE);
+        prop_assert_eq!(&dirty_pages_after_writes(&mut memory, addr), &expected);
+        let mut memory = RawVecMemory::new();
+        prop_assert_eq!(&dirty_pages_after_writes(&mut memory, addr), &expected);
+        let mut memory = HashMemory::<12>::new();
+        prop_assert_eq!(&dirty_pages_after_writes(&mut memory, addr), &expected);
+        let mut memory = FxHashMemory::new();
+        prop_assert_eq!(&dirty_pages_after_writes(&mut memory, addr), &expected);
+    }
+
     #[test]
     fn test_lb(rd in 1u8..31, rs1 in 1u8..31, imm in 0u16..0xF, value in i8::MIN..i8::MAX) {
         if rs1 == rd {
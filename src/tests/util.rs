@@ -1,5 +1,11 @@
 use crate::{
-    cpu::{self, cpu_core::Cpu, memory::raw_vec_memory::RawVecMemory},
+    cpu::{
+        self,
+        cpu_core::{Cpu, KERNEL_ADDR},
+        instrumentation::Instrumentation,
+        memory::raw_vec_memory::RawVecMemory,
+    },
+    isa::csr::csr_types::CSRAddress,
     system::passthrough_kernel::PassthroughKernel,
     types::{
         encode_program_line, BitValue, IInstructionData, InstructionData, SImmediate,
@@ -23,6 +29,17 @@ pub fn setup_cpu_64() -> Cpu {
     )
 }
 
+pub fn setup_cpu_instrumented<I: Instrumentation>(instrumentation: I) -> Cpu {
+    Cpu::new_instrumented(
+        RawVecMemory::default(),
+        PassthroughKernel::default(),
+        instrumentation,
+        cpu::cpu_core::CpuMode::RV32,
+        None,
+        cpu::cpu_core::ExecutionMode::UserSpace,
+    )
+}
+
 pub fn execute_s_instruction(
     cpu: &mut Cpu,
     opcode: &str,
@@ -60,3 +77,50 @@ pub fn execute_u_instruction(cpu: &mut Cpu, opcode: &str, rd: u8, imm: u32) -> R
 }
 
 pub const MAX_CYCLES: u32 = 1000000;
+
+pub const SV39_ROOT: u64 = KERNEL_ADDR + 0x10000;
+const SATP_MODE_SV39: u64 = 8 << 60;
+const PTE_V: u64 = 0x1;
+const PTE_VRWXAD: u64 = 0xCF;
+const PAGE_TABLE_ENTRIES: u64 = 512;
+
+// Maps the 4 KiB page at `va` to `pa` in the page tables at SV39_ROOT, remapping it if
+// already mapped. Missing tables are placed in the first empty page after the root.
+pub fn map_sv39_page(cpu: &mut Cpu, va: u64, pa: u64) {
+    let mut table = SV39_ROOT;
+    for level in [2, 1] {
+        let pte_addr = table + ((va >> (12 + 9 * level)) & 0x1FF) * 8;
+        let pte = cpu.memory.read_mem_u64(pte_addr).unwrap();
+        table = if pte & PTE_V != 0 {
+            (pte >> 10) << 12
+        } else {
+            let next = empty_page_table(cpu, table);
+            cpu.memory
+                .write_mem_u64(pte_addr, (next >> 12) << 10 | PTE_V)
+                .unwrap();
+            next
+        };
+    }
+    cpu.memory
+        .write_mem_u64(
+            table + ((va >> 12) & 0x1FF) * 8,
+            (pa >> 12) << 10 | PTE_VRWXAD,
+        )
+        .unwrap();
+}
+
+// `parent` may still be empty, its first entry is written after this returns
+fn empty_page_table(cpu: &mut Cpu, parent: u64) -> u64 {
+    (1..)
+        .map(|i| SV39_ROOT + i * 0x1000)
+        .find(|&table| {
+            table != parent
+                && (0..PAGE_TABLE_ENTRIES)
+                    .all(|i| cpu.memory.read_mem_u64(table + i * 8).unwrap() == 0)
+        })
+        .unwrap()
+}
+
+pub fn enable_sv39(cpu: &mut Cpu) {
+    cpu.write_csr64(CSRAddress::Satp.as_u12(), SATP_MODE_SV39 | SV39_ROOT >> 12);
+}
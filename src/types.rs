@@ -1,7 +1,10 @@
 use std::fmt;
 
 use crate::{
-    cpu::cpu_core::{Cpu, CpuMode},
+    cpu::{
+        cpu_core::{Cpu, CpuMode},
+        instrumentation::{branch_kind, integer_destination, BranchKind},
+    },
     isa::{
         rv32_zicsr::zicsr::RV32_ZICSR_SET,
         rv32_zifencei::zifencei::RV32_ZIFENCEI_SET,
@@ -32,6 +35,21 @@ use once_cell::sync::Lazy;
 pub struct ProgramLine {
     pub instruction: Instruction,
     pub word: Word,
+    // Decoded with the instruction for the hooks, so retiring doesn't decode the word again
+    pub rd: Option<u8>,
+    pub branch: Option<BranchKind>,
+}
+
+impl ProgramLine {
+    #[inline(always)]
+    pub fn new(instruction: Instruction, word: Word) -> ProgramLine {
+        ProgramLine {
+            instruction,
+            word,
+            rd: integer_destination(word),
+            branch: branch_kind(word),
+        }
+    }
 }
 
 impl fmt::Display for ProgramLine {
@@ -303,7 +321,7 @@ pub fn decode_program_line(word: Word, mode: CpuMode) -> Result<ProgramLine> {
             .find(|ins| (word.0 & ins.mask) == ins.bits)
             .context(context)?)
     };
-    Ok(ProgramLine { instruction, word })
+    Ok(ProgramLine::new(instruction, word))
 }
 
 pub fn decode_program_line_unchecked(word: &Word, mode: CpuMode) -> ProgramLine {
@@ -317,10 +335,7 @@ pub fn decode_program_line_unchecked(word: &Word, mode: CpuMode) -> ProgramLine
             .find(|ins| (word.0 & ins.mask) == ins.bits)
             .unwrap_unchecked()
     };
-    ProgramLine {
-        instruction: *instruction,
-        word: *word,
-    }
+    ProgramLine::new(*instruction, *word)
 }
 
 pub fn encode_program_line(name: &str, instruction_data: InstructionData) -> Result<Word> {